@@ -0,0 +1,68 @@
+//
+// Scaling benchmark for the parallel evaluator, throughput from 1 to N threads
+// usage: bench_parallel [expressions] [iterations] [chunk size] [max threads]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "src/expsolver.h"
+#include "src/compiledexpression.h"
+#include "src/parallel.h"
+
+using namespace gnilk;
+
+int main(int argc, char **argv) {
+    size_t numExpressions = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t iterations = (argc > 2) ? strtoul(argv[2], nullptr, 10) : 20;
+    size_t chunkSize = (argc > 3) ? strtoul(argv[3], nullptr, 10) : EXP_SOLVER_PARALLEL_CHUNK;
+
+    // Distinct expressions over one variable set, prepared once
+    std::vector<std::shared_ptr<const CompiledExpression> > compiled;
+    std::vector<const CompiledExpression *> expressions;
+    for (size_t i = 0; i < numExpressions; i++) {
+        char buffer[160];
+        snprintf(buffer, sizeof(buffer), "a*%zu + b/%zu - (a > %zu ? c*c : sqrt(b + %zu)) + max(a, b, c)", i, i + 1, i % 11, i % 5);
+        ExpSolver exp(buffer);
+        exp.EnableBuiltInFunctions();
+        if (!exp.Prepare()) {
+            return 1;
+        }
+        compiled.push_back(exp.GetCompiledExpression());
+        expressions.push_back(compiled.back().get());
+    }
+
+    double a = 7.5, b = 3.0, c = -2.25;
+    const double *bindings[] = { &a, &b, &c };
+    EvalContext context;
+    context.pSlots = bindings;
+    std::vector<double> out(numExpressions);
+
+    size_t maxThreads = (argc > 4) ? strtoul(argv[4], nullptr, 10) : std::thread::hardware_concurrency();
+    if (maxThreads == 0) {
+        maxThreads = 1;
+    }
+    printf("expressions: %zu, iterations: %zu, chunk: %zu\n", numExpressions, iterations, chunkSize);
+    printf("%8s %16s %10s\n", "threads", "evals/s", "speedup");
+
+    double baseline = 0.0;
+    for (size_t threads = 1; threads <= maxThreads; threads++) {
+        ParallelEvaluator evaluator(threads, chunkSize);
+        // warm up
+        evaluator.Evaluate(expressions.data(), expressions.size(), context, out.data());
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            evaluator.Evaluate(expressions.data(), expressions.size(), context, out.data());
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double throughput = (double) (numExpressions * iterations) / elapsed.count();
+        if (threads == 1) {
+            baseline = throughput;
+        }
+        printf("%8zu %16.0f %9.2fx\n", threads, throughput, throughput / baseline);
+    }
+    return 0;
+}
@@ -0,0 +1,238 @@
+//
+// Parse and evaluate throughput over a fixed corpus, results are written as JSON to stdout
+// usage: solver_bench [min time per benchmark in ms]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+#include "src/expsolver.h"
+#include "src/tokenizer.h"
+#include "src/arena.h"
+
+using namespace gnilk;
+
+//
+// Allocation counting, every operator new in the process goes through here - arena blocks are
+// allocated with malloc and counted by the arena, see Measure
+//
+static size_t numAllocations = 0;
+
+void *operator new(size_t size) {
+    numAllocations++;
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+// Over-aligned types, like the cache shards
+void *operator new(size_t size, std::align_val_t align) {
+    numAllocations++;
+    void *ptr = nullptr;
+    size_t alignment = ((size_t) align < sizeof(void *)) ? sizeof(void *) : (size_t) align;
+    if (posix_memalign(&ptr, alignment, size == 0 ? 1 : size) != 0) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+struct BenchResult {
+    double nsPerOp;
+    double allocsPerOp;     // operator new and arena blocks
+    double arenaBlocksPerOp;
+    double opsPerSec;
+    double mbPerSec;        // input bytes, zero when not meaningful
+};
+
+struct CorpusEntry {
+    const char *name;
+    std::string expression;
+};
+
+// Keeps the compiler from dropping the measured work
+static volatile double sink = 0.0;
+
+//
+// Runs 'op' in growing batches until the minimum time has passed
+//
+static BenchResult Measure(const std::function<void()> &op, double minSeconds, size_t bytesPerOp = 0) {
+    op();       // warm up, fills caches
+
+    size_t batch = 1;
+    size_t ops = 0;
+    size_t allocations = 0;
+    size_t arenaBlocks = 0;
+    double elapsed = 0.0;
+    while (elapsed < minSeconds) {
+        size_t allocStart = numAllocations;
+        size_t blockStart = Arena::NumBlocksAllocated();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < batch; i++) {
+            op();
+        }
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        size_t blocks = Arena::NumBlocksAllocated() - blockStart;
+        allocations += numAllocations - allocStart + blocks;
+        arenaBlocks += blocks;
+        elapsed += duration.count();
+        ops += batch;
+        if (batch < (1 << 20)) {
+            batch *= 2;
+        }
+    }
+    BenchResult result;
+    result.nsPerOp = elapsed * 1e9 / (double) ops;
+    result.allocsPerOp = (double) allocations / (double) ops;
+    result.arenaBlocksPerOp = (double) arenaBlocks / (double) ops;
+    result.opsPerSec = (double) ops / elapsed;
+    result.mbPerSec = result.opsPerSec * (double) bytesPerOp / 1e6;
+    return result;
+}
+
+//
+// Representative expressions, the generated ones are sized to stress one part of the solver
+//
+static std::vector<CorpusEntry> BuildCorpus() {
+    std::vector<CorpusEntry> corpus;
+    corpus.push_back({ "arithmetic", "1+2*3-4/5 + 17*3 - 100/7 + 2*2*2 - 9" });
+    corpus.push_back({ "shifts_hex", "($ff << 4) + (%1011 >> 1) + ($1234 >> 2) - (1 << 10)" });
+
+    std::string nested;
+    for (int i = 0; i < 64; i++) {
+        nested += "(";
+    }
+    nested += "1";
+    for (int i = 0; i < 64; i++) {
+        nested += (i % 2) ? "*2)" : "+1)";
+    }
+    corpus.push_back({ "deep_nesting", nested });
+    corpus.push_back({ "deep_parentheses", std::string(10000, '(') + "1+2" + std::string(10000, ')') });
+
+    std::string variables;
+    for (int i = 0; i < 64; i++) {
+        variables += (i == 0) ? "" : " + ";
+        variables += "v" + std::to_string(i) + "*" + std::to_string(i + 1);
+    }
+    corpus.push_back({ "many_variables", variables });
+
+    corpus.push_back({ "functions", "sqrt(pow(v0, 2) + pow(v1, 2)) + max(sin(v0), cos(v1), abs(v2)) + floor(min(v0, v1, v2)*10)" });
+    corpus.push_back({ "ternaries", "v0 > 1 ? v1 > 2 ? v0*v1 : v1 : v2 < 0 ? (v3 > v4 ? v3 : v4) : v2 + 1" });
+    corpus.push_back({ "statements", "d = v0*v0 + v1*v1; e = sqrt(d); e > 1 ? d/e : e" });
+    return corpus;
+}
+
+// Same operators as ExpSolver::Prepare
+static const char *kOperators = "<< >> * / + - ( ) , < > ? : ; =";
+
+static void PrintResult(const char *name, const BenchResult &result, bool last) {
+    printf("        \"%s\": { \"ns_per_op\": %.2f, \"allocs_per_op\": %.2f, \"arena_blocks_per_op\": %.2f, \"ops_per_sec\": %.0f",
+           name, result.nsPerOp, result.allocsPerOp, result.arenaBlocksPerOp, result.opsPerSec);
+    if (result.mbPerSec > 0.0) {
+        printf(", \"mb_per_sec\": %.2f", result.mbPerSec);
+    }
+    printf(" }%s\n", last ? "" : ",");
+}
+
+static std::string JsonEscape(const std::string &str) {
+    std::string result;
+    for (char c : str) {
+        if ((c == '"') || (c == '\\')) {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    double minSeconds = ((argc > 1) ? strtod(argv[1], nullptr) : 200.0) / 1000.0;
+
+    // Values for v0..v63, indexed by slot
+    std::vector<double> values(64);
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = 1.5 + (double) i * 0.25;
+    }
+
+    auto corpus = BuildCorpus();
+    printf("{\n");
+    printf("  \"benchmark\": \"solver_bench\",\n");
+    printf("  \"min_time_ms\": %.0f,\n", minSeconds * 1000.0);
+    printf("  \"results\": [\n");
+    for (size_t idx = 0; idx < corpus.size(); idx++) {
+        const char *expression = corpus[idx].expression.c_str();
+        size_t length = corpus[idx].expression.length();
+
+        BenchResult tokenize = Measure([expression]() {
+            Tokenizer tokens(expression, kOperators, Tokenizer::kTokenizerMode_Spans);
+            size_t tokenBytes = 0;
+            while (tokens.HasMore()) {
+                tokenBytes += tokens.NextView().length();
+            }
+            sink = sink + (double) tokenBytes;
+        }, minSeconds, length);
+
+        BenchResult prepare = Measure([expression]() {
+            ExpSolver exp(expression);
+            exp.EnableBuiltInFunctions();
+            sink = sink + (exp.Prepare() ? 1.0 : 0.0);
+        }, minSeconds, length);
+
+        ExpSolver prepared(expression);
+        prepared.EnableBuiltInFunctions();
+        if (!prepared.Prepare()) {
+            fprintf(stderr, "[!] Error: Prepare failed for '%s'\n", expression);
+            return 1;
+        }
+        bool hasVariables = prepared.GetNumVariables() > 0;
+        prepared.BindVariables(values.data());
+        BenchResult evaluate = Measure([&prepared]() {
+            sink = sink + prepared.Evaluate();
+        }, minSeconds);
+
+        printf("    {\n");
+        printf("      \"name\": \"%s\",\n", corpus[idx].name);
+        printf("      \"expression\": \"%s\",\n", JsonEscape(corpus[idx].expression).c_str());
+        printf("      \"variables\": %zu,\n", prepared.GetNumVariables());
+        printf("      \"results\": {\n");
+        PrintResult("tokenize", tokenize, false);
+        PrintResult("prepare", prepare, false);
+        // Solve has nothing to bind variables to
+        if (!hasVariables) {
+            BenchResult solve = Measure([expression]() {
+                double value = 0.0;
+                ExpSolver::Solve(&value, expression);
+                sink = sink + value;
+            }, minSeconds);
+            PrintResult("evaluate", evaluate, false);
+            PrintResult("solve", solve, true);
+        } else {
+            PrintResult("evaluate", evaluate, true);
+        }
+        printf("      }\n");
+        printf("    }%s\n", (idx + 1 < corpus.size()) ? "," : "");
+    }
+    printf("  ]\n");
+    printf("}\n");
+    return 0;
+}
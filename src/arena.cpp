@@ -0,0 +1,94 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: arena.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-18, 20:05
+Descr   : Bump allocator for expression nodes and their strings. A tree
+          is allocated from one or a few blocks and freed in one shot
+          instead of one new/delete per node.
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 19.10.26, FKling, Process wide block count for allocation statistics
+- 18.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#include "arena.h"
+
+using namespace gnilk;
+
+static std::atomic<size_t> numBlocksAllocated(0);
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize) {
+}
+
+Arena::~Arena() {
+    while (blocks != nullptr) {
+        Block *next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+}
+
+void *Arena::Alloc(size_t size, size_t align) {
+    uintptr_t ptr = ((uintptr_t) current + align - 1) & ~(uintptr_t) (align - 1);
+    if ((current == nullptr) || (ptr + size > (uintptr_t) end)) {
+        NewBlock(size + align);
+        ptr = ((uintptr_t) current + align - 1) & ~(uintptr_t) (align - 1);
+    }
+    bytesUsed += size;
+    current = (char *) (ptr + size);
+    return (void *) ptr;
+}
+
+const char *Arena::StrDup(std::string_view str) {
+    char *dst = (char *) Alloc(str.length() + 1, 1);
+    memcpy(dst, str.data(), str.length());
+    dst[str.length()] = '\0';
+    return dst;
+}
+
+//
+// Large allocations get a block of their own
+//
+void Arena::NewBlock(size_t minSize) {
+    size_t size = (minSize > blockSize) ? minSize : blockSize;
+    Block *block = (Block *) malloc(sizeof(Block) + size);
+    if (block == nullptr) {
+        abort();
+    }
+    numBlocksAllocated.fetch_add(1, std::memory_order_relaxed);
+    block->next = blocks;
+    block->size = size;
+    blocks = block;
+    bytesReserved += size;
+
+    current = (char *) (block + 1);
+    end = current + size;
+}
+
+size_t Arena::NumBlocksAllocated() {
+    return numBlocksAllocated.load(std::memory_order_relaxed);
+}
+
+void Arena::Reset() {
+    if (blocks == nullptr) {
+        return;
+    }
+    while (blocks->next != nullptr) {
+        Block *next = blocks->next;
+        bytesReserved -= blocks->next->size;
+        blocks->next = next->next;
+        free(next);
+    }
+    current = (char *) (blocks + 1);
+    end = current + blocks->size;
+    bytesUsed = 0;
+}
@@ -0,0 +1,59 @@
+// See arena.cpp for more details
+#pragma once
+
+#include <stddef.h>
+#include <string_view>
+
+namespace gnilk
+{
+    //
+    // Bump allocator, memory is only released all at once by Reset or when the arena is destroyed
+    // Not thread safe
+    //
+    class Arena {
+    public:
+        explicit Arena(size_t blockSize = 4096);
+        virtual ~Arena();
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        void *Alloc(size_t size, size_t align = alignof(max_align_t));
+        template<typename T>
+        T *AllocArray(size_t count) { return static_cast<T *>(Alloc(count * sizeof(T), alignof(T))); }
+        // Zero terminated copy
+        const char *StrDup(std::string_view str);
+
+        // Releases all allocations, the most recent block is kept for reuse
+        void Reset();
+        size_t BytesUsed() const { return bytesUsed; }
+        size_t BytesReserved() const { return bytesReserved; }
+        // Blocks allocated by all arenas in the process, arenas allocate with malloc - not seen by an operator new hook
+        static size_t NumBlocksAllocated();
+    protected:
+        struct Block {
+            Block *next;
+            size_t size;
+        };
+        void NewBlock(size_t minSize);
+    protected:
+        size_t blockSize;
+        Block *blocks = nullptr;    // most recent first
+        char *current = nullptr;
+        char *end = nullptr;
+        size_t bytesUsed = 0;
+        size_t bytesReserved = 0;
+    };
+
+    //
+    // Objects allocated from an arena with 'new (arena) T(...)', never deleted individually
+    // destructors are not called - members must not own any other memory
+    //
+    class ArenaObject {
+    public:
+        static void *operator new(size_t size, Arena &arena) { return arena.Alloc(size); }
+        // Only used if a constructor throws
+        static void operator delete(void *, Arena &) { }
+        // The memory belongs to the arena
+        static void operator delete(void *) { }
+    };
+}
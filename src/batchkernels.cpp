@@ -0,0 +1,253 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: batchkernels.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-18, 13:40
+Descr   : Column kernels for batch evaluation. Each kernel processes
+          'n' rows, SSE2/AVX2 versions are selected at runtime on x86-64.
+          All versions produce the same bits as the scalar operator
+          kernels in expsolver.h.
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 18.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include "expsolver.h"
+#include "batchkernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#if defined(KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define KERNELS_AVX2
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+using namespace gnilk;
+using namespace gnilk::kernels;
+
+//
+// Scalar kernels, also used for the tail of the SIMD kernels
+//
+template<double (*OP)(double, double)>
+static void ScalarBinOp(double *out, const double *left, const double *right, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = OP(left[i], right[i]);
+    }
+}
+
+static void ScalarSelect(double *out, const double *cond, const double *valueTrue, const double *valueFalse, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = ops::IsTrue(cond[i]) ? valueTrue[i] : valueFalse[i];
+    }
+}
+
+static void ScalarFill(double *out, double value, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        out[i] = value;
+    }
+}
+
+static const KernelTable scalarKernels = {
+    "scalar",
+    {
+        ScalarBinOp<ops::ShiftLeft>,
+        ScalarBinOp<ops::ShiftRight>,
+        ScalarBinOp<ops::Add>,
+        ScalarBinOp<ops::Sub>,
+        ScalarBinOp<ops::Mul>,
+        ScalarBinOp<ops::Div>,
+        ScalarBinOp<ops::Greater>,
+        ScalarBinOp<ops::Less>,
+    },
+    ScalarSelect,
+    ScalarFill,
+};
+
+#ifdef KERNELS_X86
+//
+// SSE2 kernels, SSE2 is always available on x86-64
+//
+
+// (double)(int)v - same truncation as the scalar (int) cast, including out of range values
+static inline __m128d TruncSSE2(__m128d v) {
+    return _mm_cvtepi32_pd(_mm_cvttpd_epi32(v));
+}
+
+#define SSE2_ARITH_KERNEL(name, intrinsic, scalar)                                          \
+static void name(double *out, const double *left, const double *right, size_t n) {         \
+    size_t i = 0;                                                                           \
+    for (; i + 2 <= n; i += 2) {                                                            \
+        _mm_storeu_pd(&out[i], intrinsic(_mm_loadu_pd(&left[i]), _mm_loadu_pd(&right[i]))); \
+    }                                                                                       \
+    ScalarBinOp<scalar>(&out[i], &left[i], &right[i], n - i);                               \
+}
+
+SSE2_ARITH_KERNEL(SSE2Add, _mm_add_pd, ops::Add)
+SSE2_ARITH_KERNEL(SSE2Sub, _mm_sub_pd, ops::Sub)
+SSE2_ARITH_KERNEL(SSE2Mul, _mm_mul_pd, ops::Mul)
+SSE2_ARITH_KERNEL(SSE2Div, _mm_div_pd, ops::Div)
+
+static void SSE2Greater(double *out, const double *left, const double *right, size_t n) {
+    const __m128d one = _mm_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d mask = _mm_cmpgt_pd(_mm_loadu_pd(&left[i]), TruncSSE2(_mm_loadu_pd(&right[i])));
+        _mm_storeu_pd(&out[i], _mm_and_pd(mask, one));
+    }
+    ScalarBinOp<ops::Greater>(&out[i], &left[i], &right[i], n - i);
+}
+
+static void SSE2Less(double *out, const double *left, const double *right, size_t n) {
+    const __m128d one = _mm_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d mask = _mm_cmplt_pd(_mm_loadu_pd(&left[i]), TruncSSE2(_mm_loadu_pd(&right[i])));
+        _mm_storeu_pd(&out[i], _mm_and_pd(mask, one));
+    }
+    ScalarBinOp<ops::Less>(&out[i], &left[i], &right[i], n - i);
+}
+
+static void SSE2Select(double *out, const double *cond, const double *valueTrue, const double *valueFalse, size_t n) {
+    const __m128d zero = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d mask = _mm_cmpgt_pd(_mm_loadu_pd(&cond[i]), zero);
+        __m128d res = _mm_or_pd(_mm_and_pd(mask, _mm_loadu_pd(&valueTrue[i])),
+                                _mm_andnot_pd(mask, _mm_loadu_pd(&valueFalse[i])));
+        _mm_storeu_pd(&out[i], res);
+    }
+    ScalarSelect(&out[i], &cond[i], &valueTrue[i], &valueFalse[i], n - i);
+}
+
+static void SSE2Fill(double *out, double value, size_t n) {
+    const __m128d v = _mm_set1_pd(value);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(&out[i], v);
+    }
+    ScalarFill(&out[i], value, n - i);
+}
+
+static const KernelTable sse2Kernels = {
+    "sse2",
+    {
+        ScalarBinOp<ops::ShiftLeft>,
+        ScalarBinOp<ops::ShiftRight>,
+        SSE2Add,
+        SSE2Sub,
+        SSE2Mul,
+        SSE2Div,
+        SSE2Greater,
+        SSE2Less,
+    },
+    SSE2Select,
+    SSE2Fill,
+};
+#endif
+
+#ifdef KERNELS_AVX2
+//
+// AVX2 kernels, compiled for AVX2 regardless of compiler flags - only used when the CPU supports it
+//
+TARGET_AVX2 static inline __m256d TruncAVX2(__m256d v) {
+    return _mm256_cvtepi32_pd(_mm256_cvttpd_epi32(v));
+}
+
+#define AVX2_ARITH_KERNEL(name, intrinsic, scalar)                                                      \
+TARGET_AVX2 static void name(double *out, const double *left, const double *right, size_t n) {         \
+    size_t i = 0;                                                                                       \
+    for (; i + 4 <= n; i += 4) {                                                                        \
+        _mm256_storeu_pd(&out[i], intrinsic(_mm256_loadu_pd(&left[i]), _mm256_loadu_pd(&right[i])));    \
+    }                                                                                                   \
+    ScalarBinOp<scalar>(&out[i], &left[i], &right[i], n - i);                                           \
+}
+
+AVX2_ARITH_KERNEL(AVX2Add, _mm256_add_pd, ops::Add)
+AVX2_ARITH_KERNEL(AVX2Sub, _mm256_sub_pd, ops::Sub)
+AVX2_ARITH_KERNEL(AVX2Mul, _mm256_mul_pd, ops::Mul)
+AVX2_ARITH_KERNEL(AVX2Div, _mm256_div_pd, ops::Div)
+
+TARGET_AVX2 static void AVX2Greater(double *out, const double *left, const double *right, size_t n) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d mask = _mm256_cmp_pd(_mm256_loadu_pd(&left[i]), TruncAVX2(_mm256_loadu_pd(&right[i])), _CMP_GT_OQ);
+        _mm256_storeu_pd(&out[i], _mm256_and_pd(mask, one));
+    }
+    ScalarBinOp<ops::Greater>(&out[i], &left[i], &right[i], n - i);
+}
+
+TARGET_AVX2 static void AVX2Less(double *out, const double *left, const double *right, size_t n) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d mask = _mm256_cmp_pd(_mm256_loadu_pd(&left[i]), TruncAVX2(_mm256_loadu_pd(&right[i])), _CMP_LT_OQ);
+        _mm256_storeu_pd(&out[i], _mm256_and_pd(mask, one));
+    }
+    ScalarBinOp<ops::Less>(&out[i], &left[i], &right[i], n - i);
+}
+
+TARGET_AVX2 static void AVX2Select(double *out, const double *cond, const double *valueTrue, const double *valueFalse, size_t n) {
+    const __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d mask = _mm256_cmp_pd(_mm256_loadu_pd(&cond[i]), zero, _CMP_GT_OQ);
+        _mm256_storeu_pd(&out[i], _mm256_blendv_pd(_mm256_loadu_pd(&valueFalse[i]), _mm256_loadu_pd(&valueTrue[i]), mask));
+    }
+    ScalarSelect(&out[i], &cond[i], &valueTrue[i], &valueFalse[i], n - i);
+}
+
+TARGET_AVX2 static void AVX2Fill(double *out, double value, size_t n) {
+    const __m256d v = _mm256_set1_pd(value);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(&out[i], v);
+    }
+    ScalarFill(&out[i], value, n - i);
+}
+
+static const KernelTable avx2Kernels = {
+    "avx2",
+    {
+        ScalarBinOp<ops::ShiftLeft>,
+        ScalarBinOp<ops::ShiftRight>,
+        AVX2Add,
+        AVX2Sub,
+        AVX2Mul,
+        AVX2Div,
+        AVX2Greater,
+        AVX2Less,
+    },
+    AVX2Select,
+    AVX2Fill,
+};
+#endif
+
+static const KernelTable &DetectKernels() {
+#ifdef KERNELS_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return avx2Kernels;
+    }
+#endif
+#ifdef KERNELS_X86
+    return sse2Kernels;
+#else
+    // Other architectures rely on the compiler to vectorize the scalar loops
+    return scalarKernels;
+#endif
+}
+
+const KernelTable &kernels::GetKernels() {
+    static const KernelTable &kernels = DetectKernels();
+    return kernels;
+}
+
+const KernelTable &kernels::GetScalarKernels() {
+    return scalarKernels;
+}
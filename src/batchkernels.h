@@ -0,0 +1,26 @@
+// See batchkernels.cpp for more details
+#pragma once
+
+#include <stddef.h>
+#include "expsolver.h"
+
+namespace gnilk
+{
+    namespace kernels {
+        typedef void (*PFNBINOPKERNEL)(double *out, const double *left, const double *right, size_t n);
+        typedef void (*PFNSELECTKERNEL)(double *out, const double *cond, const double *valueTrue, const double *valueFalse, size_t n);
+        typedef void (*PFNFILLKERNEL)(double *out, double value, size_t n);
+
+        struct KernelTable {
+            const char *name;
+            PFNBINOPKERNEL binop[kOpCode_NumOpCodes];   // indexed by kOpCode
+            PFNSELECTKERNEL select;
+            PFNFILLKERNEL fill;
+        };
+
+        // Best kernels for the running CPU, detected once
+        const KernelTable &GetKernels();
+        // Plain C++ kernels, the reference for the SIMD versions
+        const KernelTable &GetScalarKernels();
+    }
+}
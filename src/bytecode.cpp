@@ -0,0 +1,542 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: bytecode.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-18, 10:12
+Descr   : Compiles a prepared expression tree to a linear instruction
+          array which is run by a small stack machine. Results are
+          identical to the tree evaluator - both use the same operator
+          kernels and evaluate in the same order.
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 19.10.26, FKling, Shared sub-expressions are compiled once and called, code no longer grows with every reference
+- 19.10.26, FKling, Batches call column versions of functions once per block
+- 18.10.26, FKling, Shared sub-expressions are evaluated once per run
+- 18.10.26, FKling, Native function calls
+- 18.10.26, FKling, Variables are loaded by slot
+- 18.10.26, FKling, Batch evaluation over columns
+- 18.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include <string.h>
+#include <algorithm>
+
+#include "expsolver.h"
+#include "bytecode.h"
+#include "batchkernels.h"
+
+using namespace gnilk;
+
+// Programs with deeper stacks than this use a heap allocated stack
+static const size_t kLocalStackSize = 64;
+// Same for the shared sub-expression cache
+static const size_t kLocalSharedSize = 16;
+
+//
+// Compile a tree, can be called multiple times - the previous program is discarded
+//
+bool Program::Compile(const BaseNode *root, kCompileMode mode) {
+    this->mode = mode;
+    code.clear();
+    constants.clear();
+    variables.clear();
+    functions.clear();
+    natives.clear();
+    shared.clear();
+    sharedCode.clear();
+    sharedDepth.clear();
+    numShared = 0;
+    stackDepth = 0;
+    maxStackDepth = 0;
+
+    if (root == nullptr) {
+        return false;
+    }
+    if (!CompileNode(root)) {
+        return false;
+    }
+    Emit(kByteCode_End);
+    // The expressions belong to the tree, only the number of cache slots is needed when running
+    numShared = shared.size();
+    shared.clear();
+    sharedCode.clear();
+    sharedDepth.clear();
+    return true;
+}
+
+bool Program::CompileNode(const BaseNode *node) {
+    switch (node->Type()) {
+        case kNodeType_Const :
+            constants.push_back(static_cast<const ConstNode *>(node)->Value());
+            Emit(kByteCode_PushConst, constants.size() - 1);
+            AdjustStack(1);
+            break;
+        case kNodeType_ConstUser : {
+            auto var = static_cast<const ConstUserNode *>(node);
+            SetVariable(var->Slot(), var->Name());
+            Emit(kByteCode_LoadVar, var->Slot());
+            AdjustStack(1);
+            break;
+        }
+        case kNodeType_Func : {
+            auto func = static_cast<const FuncNode *>(node);
+            for (int i = 0; i < func->NumArguments(); i++) {
+                if (!CompileNode(func->Argument(i))) {
+                    return false;
+                }
+            }
+            Emit(kByteCode_Call, AddName(functions, func->Name()), func->NumArguments());
+            AdjustStack(1 - func->NumArguments());
+            break;
+        }
+        case kNodeType_NativeFunc : {
+            auto func = static_cast<const NativeFuncNode *>(node);
+            for (int i = 0; i < func->NumArguments(); i++) {
+                if (!CompileNode(func->Argument(i))) {
+                    return false;
+                }
+            }
+            natives.push_back(func->Function());
+            Emit(kByteCode_CallNative, natives.size() - 1, func->NumArguments());
+            AdjustStack(1 - func->NumArguments());
+            break;
+        }
+        case kNodeType_BinOp :
+        case kNodeType_BoolOp : {
+            auto binop = static_cast<const BinOpNode *>(node);
+            if (!CompileNode(binop->Left()) || !CompileNode(binop->Right())) {
+                return false;
+            }
+            Emit((kByteCode) (kByteCode_ShiftLeft + binop->Op()));
+            AdjustStack(-1);
+            break;
+        }
+        case kNodeType_If : {
+            auto ifop = static_cast<const IfOperatorNode *>(node);
+            if (!CompileNode(ifop->Condition())) {
+                return false;
+            }
+            if (mode == kCompileMode_Select) {
+                if (!CompileNode(ifop->TrueBranch()) || !CompileNode(ifop->FalseBranch())) {
+                    return false;
+                }
+                Emit(kByteCode_Select);
+                AdjustStack(-2);
+                break;
+            }
+            size_t idxJumpFalse = Emit(kByteCode_JumpIfFalse);
+            AdjustStack(-1);
+            if (!CompileNode(ifop->TrueBranch())) {
+                return false;
+            }
+            size_t idxJumpEnd = Emit(kByteCode_Jump);
+            // Only one of the branches is left on the stack
+            AdjustStack(-1);
+            Patch(idxJumpFalse, code.size());
+            if (!CompileNode(ifop->FalseBranch())) {
+                return false;
+            }
+            Patch(idxJumpEnd, code.size());
+            break;
+        }
+        case kNodeType_Shared : {
+            // The expression is compiled once, where it is first referenced, and jumped over
+            // every reference calls it - it only runs when it has no value yet in this run
+            auto expression = static_cast<const SharedNode *>(node)->Expression();
+            size_t idxShared = SharedIndex(expression);
+            if (idxShared > UINT16_MAX) {
+                return false;
+            }
+            if (idxShared == sharedCode.size()) {
+                size_t idxSkip = Emit(kByteCode_Jump);
+                sharedCode.push_back((uint32_t) code.size());
+                sharedDepth.push_back(0);
+                // Runs on top of the stack of any reference, only its own use is counted
+                size_t callerDepth = stackDepth;
+                size_t callerMaxDepth = maxStackDepth;
+                stackDepth = 0;
+                maxStackDepth = 0;
+                if (!CompileNode(expression->node)) {
+                    return false;
+                }
+                Emit(kByteCode_StoreShared, 0, (uint16_t) idxShared);
+                sharedDepth[idxShared] = maxStackDepth;
+                stackDepth = callerDepth;
+                maxStackDepth = callerMaxDepth;
+                Patch(idxSkip, code.size());
+            }
+            Emit(kByteCode_CallShared, sharedCode[idxShared], (uint16_t) idxShared);
+            if (stackDepth + sharedDepth[idxShared] > maxStackDepth) {
+                maxStackDepth = stackDepth + sharedDepth[idxShared];
+            }
+            AdjustStack(1);
+            break;
+        }
+        default:
+            return false;
+    }
+    return true;
+}
+
+size_t Program::Emit(kByteCode code, uint32_t operand, uint16_t args) {
+    Instruction instr;
+    instr.code = code;
+    instr.args = args;
+    instr.operand = operand;
+    this->code.push_back(instr);
+    return this->code.size() - 1;
+}
+
+void Program::Patch(size_t idxInstr, size_t target) {
+    code[idxInstr].operand = (uint32_t) target;
+}
+
+void Program::AdjustStack(int delta) {
+    stackDepth += delta;
+    if (stackDepth > maxStackDepth) {
+        maxStackDepth = stackDepth;
+    }
+}
+
+//
+// Variables are indexed by the slot assigned when the tree was built
+//
+void Program::SetVariable(size_t slot, const char *name) {
+    if (slot >= variables.size()) {
+        variables.resize(slot + 1);
+    }
+    variables[slot] = name;
+}
+
+uint32_t Program::AddName(std::vector<std::string> &names, const char *name) {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) {
+            return (uint32_t) i;
+        }
+    }
+    names.push_back(name);
+    return (uint32_t) (names.size() - 1);
+}
+
+size_t Program::SharedIndex(const SharedExpression *expression) {
+    for (size_t i = 0; i < shared.size(); i++) {
+        if (shared[i] == expression) {
+            return i;
+        }
+    }
+    shared.push_back(expression);
+    return shared.size() - 1;
+}
+
+//
+// The interpreter, the program is not modified - all state is on the local stack
+//
+double Program::Run(const EvalContext &context) const {
+    if (code.empty()) {
+        return 0.0;
+    }
+
+    double localStack[kLocalStackSize];
+    std::vector<double> heapStack;
+    double *sp = localStack;
+    if (maxStackDepth > kLocalStackSize) {
+        heapStack.resize(maxStackDepth);
+        sp = heapStack.data();
+    }
+
+    // Values of shared sub-expressions, evaluated by the first reference reached
+    // an expression never calls itself, one return address per expression is enough
+    double localShared[kLocalSharedSize];
+    char localValid[kLocalSharedSize];
+    const Instruction *localReturn[kLocalSharedSize];
+    std::vector<double> heapShared;
+    std::vector<char> heapValid;
+    std::vector<const Instruction *> heapReturn;
+    double *sharedValues = localShared;
+    char *sharedValid = localValid;
+    const Instruction **sharedReturn = localReturn;
+    if (numShared > kLocalSharedSize) {
+        heapShared.resize(numShared);
+        heapValid.resize(numShared);
+        heapReturn.resize(numShared);
+        sharedValues = heapShared.data();
+        sharedValid = heapValid.data();
+        sharedReturn = heapReturn.data();
+    }
+    memset(sharedValid, 0, numShared);
+
+    const Instruction *start = code.data();
+    const Instruction *ip = start;
+    for (;;) {
+        switch (ip->code) {
+            case kByteCode_PushConst :
+                *sp++ = constants[ip->operand];
+                break;
+            case kByteCode_LoadVar : {
+                if ((context.pSlots != nullptr) && (context.pSlots[ip->operand] != nullptr)) {
+                    *sp++ = *context.pSlots[ip->operand];
+                    break;
+                }
+                int bOk = 0;
+                *sp++ = (context.pVariableCallback == nullptr) ? 0.0 :
+                        context.pVariableCallback(context.pVariableContext, variables[ip->operand].c_str(), &bOk);
+                break;
+            }
+            case kByteCode_Call : {
+                // Arguments are passed straight from the stack
+                int bOk = 0;
+                double *args = sp - ip->args;
+                double result = (context.pFuncCallback == nullptr) ? 0.0 :
+                        context.pFuncCallback(context.pFunctionContext, functions[ip->operand].c_str(), ip->args, args, &bOk);
+                sp = args;
+                *sp++ = result;
+                break;
+            }
+            case kByteCode_CallNative : {
+                double *args = sp - ip->args;
+                double result = natives[ip->operand].Call(ip->args, args);
+                sp = args;
+                *sp++ = result;
+                break;
+            }
+            case kByteCode_ShiftLeft :
+                sp[-2] = ops::ShiftLeft(sp[-2], sp[-1]);
+                sp--;
+                break;
+            case kByteCode_ShiftRight :
+                sp[-2] = ops::ShiftRight(sp[-2], sp[-1]);
+                sp--;
+                break;
+            case kByteCode_Add :
+                sp[-2] = ops::Add(sp[-2], sp[-1]);
+                sp--;
+                break;
+            case kByteCode_Sub :
+                sp[-2] = ops::Sub(sp[-2], sp[-1]);
+                sp--;
+                break;
+            case kByteCode_Mul :
+                sp[-2] = ops::Mul(sp[-2], sp[-1]);
+                sp--;
+                break;
+            case kByteCode_Div :
+                sp[-2] = ops::Div(sp[-2], sp[-1]);
+                sp--;
+                break;
+            case kByteCode_Greater :
+                sp[-2] = ops::Greater(sp[-2], sp[-1]);
+                sp--;
+                break;
+            case kByteCode_Less :
+                sp[-2] = ops::Less(sp[-2], sp[-1]);
+                sp--;
+                break;
+            case kByteCode_Select :
+                sp[-3] = ops::IsTrue(sp[-3]) ? sp[-2] : sp[-1];
+                sp -= 2;
+                break;
+            case kByteCode_JumpIfFalse :
+                sp--;
+                if (!ops::IsTrue(*sp)) {
+                    ip = start + ip->operand;
+                    continue;
+                }
+                break;
+            case kByteCode_Jump :
+                ip = start + ip->operand;
+                continue;
+            case kByteCode_CallShared :
+                if (!sharedValid[ip->args]) {
+                    sharedReturn[ip->args] = ip + 1;
+                    ip = start + ip->operand;
+                    continue;
+                }
+                *sp++ = sharedValues[ip->args];
+                break;
+            case kByteCode_StoreShared :
+                sharedValues[ip->args] = sp[-1];
+                sharedValid[ip->args] = 1;
+                ip = sharedReturn[ip->args];
+                continue;
+            case kByteCode_End :
+                return sp[-1];
+        }
+        ip++;
+    }
+}
+
+//
+// Column calls must not write to an argument, the first argument may already be in 'dst'
+//
+static double *ColumnOutput(double *dst, double *scratch, const double * const *args, size_t numArgs) {
+    for (size_t a = 0; a < numArgs; a++) {
+        if (args[a] == dst) {
+            return scratch;
+        }
+    }
+    return dst;
+}
+
+//
+// Batch interpreter, runs each instruction over a block of rows at a time.
+// Every stack entry is a pointer to a block, variables point straight into the caller's columns
+//
+bool Program::RunBatch(const EvalContext &context, const double * const *columns, size_t nRows, double *out) const {
+    if (code.empty() || (mode != kCompileMode_Select)) {
+        return false;
+    }
+
+    auto &kernels = kernels::GetKernels();
+
+    // One result block per stack entry plus a scratch block for column calls, allocated once per call
+    std::vector<double> blocks((maxStackDepth + 1) * EXP_SOLVER_BATCH_BLOCK);
+    double *scratch = &blocks[maxStackDepth * EXP_SOLVER_BATCH_BLOCK];
+    std::vector<const double *> stack(maxStackDepth);
+    std::vector<double> args;
+    // One block per shared sub-expression, valid flags are reset for each block of rows
+    std::vector<double> sharedBlocks(numShared * EXP_SOLVER_BATCH_BLOCK);
+    std::vector<char> sharedValid(numShared);
+    std::vector<const Instruction *> sharedReturn(numShared);
+
+    for (size_t rowStart = 0; rowStart < nRows; rowStart += EXP_SOLVER_BATCH_BLOCK) {
+        size_t n = nRows - rowStart;
+        if (n > EXP_SOLVER_BATCH_BLOCK) {
+            n = EXP_SOLVER_BATCH_BLOCK;
+        }
+        size_t sp = 0;
+        std::fill(sharedValid.begin(), sharedValid.end(), 0);
+        for (const Instruction *ip = code.data(); ip->code != kByteCode_End; ip++) {
+            switch (ip->code) {
+                case kByteCode_PushConst : {
+                    double *dst = &blocks[sp * EXP_SOLVER_BATCH_BLOCK];
+                    kernels.fill(dst, constants[ip->operand], n);
+                    stack[sp++] = dst;
+                    break;
+                }
+                case kByteCode_LoadVar : {
+                    if (columns[ip->operand] != nullptr) {
+                        stack[sp++] = columns[ip->operand] + rowStart;
+                        break;
+                    }
+                    double *dst = &blocks[sp * EXP_SOLVER_BATCH_BLOCK];
+                    if ((context.pSlots != nullptr) && (context.pSlots[ip->operand] != nullptr)) {
+                        // Bound variables are the same for all rows
+                        kernels.fill(dst, *context.pSlots[ip->operand], n);
+                        stack[sp++] = dst;
+                        break;
+                    }
+                    const char *name = variables[ip->operand].c_str();
+                    for (size_t i = 0; i < n; i++) {
+                        int bOk = 0;
+                        dst[i] = (context.pVariableCallback == nullptr) ? 0.0 :
+                                context.pVariableCallback(context.pVariableContext, name, &bOk);
+                    }
+                    stack[sp++] = dst;
+                    break;
+                }
+                case kByteCode_Call : {
+                    size_t base = sp - ip->args;
+                    double *dst = &blocks[base * EXP_SOLVER_BATCH_BLOCK];
+                    const char *name = functions[ip->operand].c_str();
+                    if (context.pFuncBatchCallback != nullptr) {
+                        int bOk = 0;
+                        double *result = ColumnOutput(dst, scratch, &stack[base], ip->args);
+                        context.pFuncBatchCallback(context.pFunctionBatchContext, name, ip->args, &stack[base], n, result, &bOk);
+                        if (bOk) {
+                            if (result != dst) {
+                                memcpy(dst, result, n * sizeof(double));
+                            }
+                            sp = base;
+                            stack[sp++] = dst;
+                            break;
+                        }
+                    }
+                    // Not handled as columns, called per row
+                    args.resize(ip->args + 1);
+                    for (size_t i = 0; i < n; i++) {
+                        for (size_t a = 0; a < ip->args; a++) {
+                            args[a] = stack[base + a][i];
+                        }
+                        int bOk = 0;
+                        dst[i] = (context.pFuncCallback == nullptr) ? 0.0 :
+                                context.pFuncCallback(context.pFunctionContext, name, ip->args, args.data(), &bOk);
+                    }
+                    sp = base;
+                    stack[sp++] = dst;
+                    break;
+                }
+                case kByteCode_CallNative : {
+                    size_t base = sp - ip->args;
+                    double *dst = &blocks[base * EXP_SOLVER_BATCH_BLOCK];
+                    auto &func = natives[ip->operand];
+                    if (func.batch != nullptr) {
+                        double *result = ColumnOutput(dst, scratch, &stack[base], ip->args);
+                        func.batch(func.pUser, ip->args, &stack[base], n, result);
+                        if (result != dst) {
+                            memcpy(dst, result, n * sizeof(double));
+                        }
+                        sp = base;
+                        stack[sp++] = dst;
+                        break;
+                    }
+                    args.resize(ip->args + 1);
+                    for (size_t i = 0; i < n; i++) {
+                        for (size_t a = 0; a < ip->args; a++) {
+                            args[a] = stack[base + a][i];
+                        }
+                        dst[i] = func.Call(ip->args, args.data());
+                    }
+                    sp = base;
+                    stack[sp++] = dst;
+                    break;
+                }
+                case kByteCode_ShiftLeft :
+                case kByteCode_ShiftRight :
+                case kByteCode_Add :
+                case kByteCode_Sub :
+                case kByteCode_Mul :
+                case kByteCode_Div :
+                case kByteCode_Greater :
+                case kByteCode_Less : {
+                    double *dst = &blocks[(sp - 2) * EXP_SOLVER_BATCH_BLOCK];
+                    kernels.binop[ip->code - kByteCode_ShiftLeft](dst, stack[sp - 2], stack[sp - 1], n);
+                    sp--;
+                    stack[sp - 1] = dst;
+                    break;
+                }
+                case kByteCode_Select : {
+                    double *dst = &blocks[(sp - 3) * EXP_SOLVER_BATCH_BLOCK];
+                    kernels.select(dst, stack[sp - 3], stack[sp - 2], stack[sp - 1], n);
+                    sp -= 2;
+                    stack[sp - 1] = dst;
+                    break;
+                }
+                // Loop increment takes the jumps to their target
+                case kByteCode_Jump :
+                    ip = code.data() + ip->operand - 1;
+                    break;
+                case kByteCode_CallShared :
+                    if (!sharedValid[ip->args]) {
+                        sharedReturn[ip->args] = ip;
+                        ip = code.data() + ip->operand - 1;
+                        break;
+                    }
+                    stack[sp++] = &sharedBlocks[ip->args * EXP_SOLVER_BATCH_BLOCK];
+                    break;
+                case kByteCode_StoreShared :
+                    memcpy(&sharedBlocks[ip->args * EXP_SOLVER_BATCH_BLOCK], stack[sp - 1], n * sizeof(double));
+                    sharedValid[ip->args] = 1;
+                    ip = sharedReturn[ip->args];
+                    break;
+                default:
+                    // Conditional jumps are never emitted in select mode
+                    return false;
+            }
+        }
+        memcpy(&out[rowStart], stack[0], n * sizeof(double));
+    }
+    return true;
+}
@@ -0,0 +1,99 @@
+// See bytecode.cpp for more details
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include "expsolver.h"
+#include "functions.h"
+
+namespace gnilk
+{
+    typedef enum : uint8_t {
+        kByteCode_PushConst,        // push constants[operand]
+        kByteCode_LoadVar,          // push value of variable slot 'operand', bound value or through the variable callback
+        kByteCode_Call,             // call functions[operand], arguments are the topmost 'args' values on the stack
+        kByteCode_CallNative,       // call natives[operand], arguments as for kByteCode_Call
+        kByteCode_ShiftLeft,        // binary operators, same order as kOpCode
+        kByteCode_ShiftRight,
+        kByteCode_Add,
+        kByteCode_Sub,
+        kByteCode_Mul,
+        kByteCode_Div,
+        kByteCode_Greater,
+        kByteCode_Less,
+        kByteCode_Select,           // pop false, true, condition - push true or false value, used instead of jumps in batches
+        kByteCode_JumpIfFalse,      // pop condition, jump to operand unless it is true
+        kByteCode_Jump,             // jump to operand
+        kByteCode_CallShared,       // push shared expression 'args', runs its code at operand first unless it has a value
+        kByteCode_StoreShared,      // top of stack is the value of shared expression 'args', stays on the stack - returns to the caller
+        kByteCode_End,              // result is top of stack
+    } kByteCode;
+
+    struct Instruction {
+        kByteCode code;
+        uint16_t args;
+        uint32_t operand;
+    };
+
+    // Per call evaluation context, a program is never modified when running
+    struct EvalContext {
+        const double * const *pSlots = nullptr;     // indexed by variable slot, nullptr entries use the callback
+        PFNEVALUATE pVariableCallback = nullptr;
+        void *pVariableContext = nullptr;
+        PFNEVALUATEFUNC pFuncCallback = nullptr;
+        void *pFunctionContext = nullptr;
+        PFNEVALUATEFUNCBATCH pFuncBatchCallback = nullptr;     // batches only, optional
+        void *pFunctionBatchContext = nullptr;
+    };
+
+    // Rows per block when running batches
+    #define EXP_SOLVER_BATCH_BLOCK 256
+
+    //
+    // Flattened expression tree, evaluated by a stack machine
+    // A compiled program holds no references to the tree and is not modified by running it
+    //
+    class Program {
+    public:
+        typedef enum {
+            kCompileMode_Branch,        // '?:' jumps, only the taken branch is evaluated
+            kCompileMode_Select,        // '?:' evaluates both branches and selects, required for batches
+        } kCompileMode;
+    public:
+        Program() = default;
+        virtual ~Program() = default;
+
+        bool Compile(const BaseNode *root, kCompileMode mode = kCompileMode_Branch);
+        double Run(const EvalContext &context) const;
+        // Columns are indexed by variable slot, a nullptr column uses the slot binding or the variable callback
+        bool RunBatch(const EvalContext &context, const double * const *columns, size_t nRows, double *out) const;
+
+        const std::vector<Instruction> &Code() const { return code; }
+        const std::vector<std::string> &Variables() const { return variables; }
+        const std::vector<std::string> &Functions() const { return functions; }
+        size_t MaxStackDepth() const { return maxStackDepth; }
+        size_t NumShared() const { return numShared; }
+    protected:
+        bool CompileNode(const BaseNode *node);
+        size_t Emit(kByteCode code, uint32_t operand = 0, uint16_t args = 0);
+        void Patch(size_t idxInstr, size_t target);
+        void AdjustStack(int delta);
+        void SetVariable(size_t slot, const char *name);
+        static uint32_t AddName(std::vector<std::string> &names, const char *name);
+        size_t SharedIndex(const SharedExpression *expression);
+    protected:
+        kCompileMode mode = kCompileMode_Branch;
+        std::vector<Instruction> code;
+        std::vector<double> constants;
+        std::vector<std::string> variables;
+        std::vector<std::string> functions;
+        std::vector<NativeFunction> natives;
+        std::vector<const SharedExpression *> shared;   // compile time only, index is the runtime cache slot
+        std::vector<uint32_t> sharedCode;               // compile time only, first instruction of each expression
+        std::vector<size_t> sharedDepth;                // compile time only, stack used by each expression
+        size_t numShared = 0;
+        size_t stackDepth = 0;
+        size_t maxStackDepth = 0;
+    };
+}
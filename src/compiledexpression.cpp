@@ -0,0 +1,85 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: compiledexpression.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-18, 22:40
+Descr   : Immutable compiled expression. Holds the byte code for single
+          and batch evaluation plus the variable slot names, nothing from
+          the tokenizer or the tree. All state while evaluating is local
+          to the call, one instance can be evaluated by many threads
+          without locking.
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 18.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include "expsolver.h"
+#include "bytecode.h"
+#include "compiledexpression.h"
+
+using namespace gnilk;
+
+// Variables bound from a value array on the stack up to this count
+static const size_t kLocalBindings = 16;
+
+bool CompiledExpression::Compile(const char *expression, const BaseNode *root, const VariableSlots &slots) {
+    this->expression = expression;
+    variables = slots.names;
+    if (!program.Compile(root)) {
+        return false;
+    }
+    return batchProgram.Compile(root, Program::kCompileMode_Select);
+}
+
+double CompiledExpression::Evaluate(const EvalContext &context) const {
+    return program.Run(context);
+}
+
+double CompiledExpression::Evaluate(const double *values) const {
+    const double *localBindings[kLocalBindings];
+    std::vector<const double *> heapBindings;
+    const double **bindings = localBindings;
+    if (variables.size() > kLocalBindings) {
+        heapBindings.resize(variables.size());
+        bindings = heapBindings.data();
+    }
+    for (size_t i = 0; i < variables.size(); i++) {
+        bindings[i] = &values[i];
+    }
+
+    EvalContext context;
+    context.pSlots = bindings;
+    return program.Run(context);
+}
+
+bool CompiledExpression::EvaluateBatch(const EvalContext &context, double *out, size_t nRows, const BatchColumn *columns, size_t nColumns) const {
+    std::vector<const double *> varColumns(variables.size(), nullptr);
+    for (size_t i = 0; i < variables.size(); i++) {
+        for (size_t c = 0; c < nColumns; c++) {
+            if (variables[i] == columns[c].name) {
+                varColumns[i] = columns[c].data;
+                break;
+            }
+        }
+    }
+    return batchProgram.RunBatch(context, varColumns.data(), nRows, out);
+}
+
+const char *CompiledExpression::GetVariableName(size_t slot) const {
+    if (slot >= variables.size()) {
+        return nullptr;
+    }
+    return variables[slot].c_str();
+}
+
+int CompiledExpression::GetVariableSlot(const char *name) const {
+    for (size_t i = 0; i < variables.size(); i++) {
+        if (variables[i] == name) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,38 @@
+// See compiledexpression.cpp for more details
+#pragma once
+
+#include <string>
+#include <vector>
+#include "expsolver.h"
+#include "bytecode.h"
+
+namespace gnilk
+{
+    //
+    // Prepared expression without parse-time state, created by ExpSolver::GetCompiledExpression
+    // Nothing is modified when evaluating - bindings and callbacks are passed per call in an EvalContext
+    //
+    class CompiledExpression {
+    public:
+        CompiledExpression() = default;
+        virtual ~CompiledExpression() = default;
+
+        bool Compile(const char *expression, const BaseNode *root, const VariableSlots &slots);
+
+        double Evaluate(const EvalContext &context) const;
+        // Variable values indexed by slot, for expressions without callbacks
+        double Evaluate(const double *values) const;
+        // Variables are read from the named columns, other variables use the context
+        bool EvaluateBatch(const EvalContext &context, double *out, size_t nRows, const BatchColumn *columns, size_t nColumns) const;
+
+        const char *Expression() const { return expression.c_str(); }
+        size_t GetNumVariables() const { return variables.size(); }
+        const char *GetVariableName(size_t slot) const;
+        int GetVariableSlot(const char *name) const;
+    protected:
+        std::string expression;
+        std::vector<std::string> variables;     // indexed by slot
+        Program program;
+        Program batchProgram;
+    };
+}
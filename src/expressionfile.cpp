@@ -0,0 +1,210 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: expressionfile.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-19, 14:00
+Descr   : Binary files of prepared expressions. Every expression is a
+          node pool record (see NodePool::Serialize), loading copies the
+          sections and validates all indices - no tokenizing and no tree
+          building. Layout, host byte order:
+
+            FileHeader                  16 bytes
+            FileEntry[count]            offset and size of every record
+            records                     8 byte aligned
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 19.10.26, FKling, Opening an in memory image closes the previous file
+- 19.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "expressionfile.h"
+
+using namespace gnilk;
+
+static const char kFileMagic[4] = { 'G', 'X', 'P', 'R' };
+// Written as 0x0102, reads as 0x0201 on a machine with the other byte order
+static const uint16_t kByteOrderMark = 0x0102;
+
+struct FileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t byteOrder;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct FileEntry {
+    uint64_t offset;        // from the start of the file
+    uint64_t size;
+};
+
+//
+// Writer
+//
+bool ExpressionFileWriter::Add(const ExpSolver &solver) {
+    size_t offset = records.size();
+    if (!solver.Serialize(records)) {
+        records.resize(offset);
+        return false;
+    }
+    // Serialize aligns the start of the record
+    offset = (offset + 7) & ~(size_t) 7;
+    entries.push_back({ offset, records.size() - offset });
+    return true;
+}
+
+void ExpressionFileWriter::Add(const NodePool &pool) {
+    size_t offset = (records.size() + 7) & ~(size_t) 7;
+    pool.Serialize(records);
+    entries.push_back({ offset, records.size() - offset });
+}
+
+void ExpressionFileWriter::Write(std::vector<uint8_t> &out) const {
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kFileMagic, sizeof(header.magic));
+    header.version = EXP_SOLVER_FILE_VERSION;
+    header.byteOrder = kByteOrderMark;
+    header.count = (uint32_t) entries.size();
+
+    // Records follow the entry table, both are multiples of 8 bytes
+    uint64_t base = sizeof(FileHeader) + entries.size() * sizeof(FileEntry);
+    std::vector<FileEntry> table;
+    for (auto &entry: entries) {
+        table.push_back({ base + entry.offset, entry.size });
+    }
+
+    out.clear();
+    out.reserve(base + records.size());
+    out.insert(out.end(), (const uint8_t *) &header, (const uint8_t *) &header + sizeof(header));
+    out.insert(out.end(), (const uint8_t *) table.data(), (const uint8_t *) table.data() + table.size() * sizeof(FileEntry));
+    out.insert(out.end(), records.begin(), records.end());
+}
+
+bool ExpressionFileWriter::Write(const char *filename) const {
+    std::vector<uint8_t> image;
+    Write(image);
+    FILE *f = fopen(filename, "wb");
+    if (f == nullptr) {
+        return false;
+    }
+    bool ok = (fwrite(image.data(), 1, image.size(), f) == image.size());
+    ok = (fclose(f) == 0) && ok;
+    return ok;
+}
+
+//
+// Reader
+//
+ExpressionFile::~ExpressionFile() {
+    Close();
+}
+
+bool ExpressionFile::Open(const char *filename) {
+    Close();
+#ifndef WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if ((fstat(fd, &st) == 0) && (st.st_size > 0)) {
+        void *ptr = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) {
+            close(fd);
+            mapped = ptr;
+            mappedSize = (size_t) st.st_size;
+            if (!Attach(mapped, mappedSize)) {
+                Close();
+                return false;
+            }
+            return true;
+        }
+    }
+    close(fd);
+#endif
+    FILE *f = fopen(filename, "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    std::vector<uint8_t> contents;
+    uint8_t block[4096];
+    size_t nRead;
+    while ((nRead = fread(block, 1, sizeof(block), f)) > 0) {
+        contents.insert(contents.end(), block, block + nRead);
+    }
+    fclose(f);
+    buffer.swap(contents);
+    if (!Attach(buffer.data(), buffer.size())) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool ExpressionFile::Open(const void *data, size_t size) {
+    Close();
+    return Attach(data, size);
+}
+
+//
+// Validates the header of an image owned by the caller, a mapping or our buffer
+//
+bool ExpressionFile::Attach(const void *data, size_t size) {
+    FileHeader header;
+    if ((data == nullptr) || (size < sizeof(header))) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, kFileMagic, sizeof(header.magic)) ||
+        (header.version != EXP_SOLVER_FILE_VERSION) ||
+        (header.byteOrder != kByteOrderMark)) {
+        return false;
+    }
+    if (sizeof(FileHeader) + (uint64_t) header.count * sizeof(FileEntry) > size) {
+        return false;
+    }
+    this->data = (const uint8_t *) data;
+    this->size = size;
+    count = header.count;
+    return true;
+}
+
+void ExpressionFile::Close() {
+#ifndef WIN32
+    if (mapped != nullptr) {
+        munmap(mapped, mappedSize);
+    }
+#endif
+    mapped = nullptr;
+    mappedSize = 0;
+    buffer.clear();
+    data = nullptr;
+    size = 0;
+    count = 0;
+}
+
+bool ExpressionFile::Load(size_t idx, NodePool &pool, const FunctionRegistry *functions) const {
+    if (idx >= count) {
+        return false;
+    }
+    FileEntry entry;
+    memcpy(&entry, data + sizeof(FileHeader) + idx * sizeof(FileEntry), sizeof(entry));
+    if ((entry.offset > size) || (entry.size > size - entry.offset)) {
+        return false;
+    }
+    return pool.Deserialize(data + entry.offset, (size_t) entry.size, functions);
+}
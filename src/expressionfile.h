@@ -0,0 +1,68 @@
+// See expressionfile.cpp for more details
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "expsolver.h"
+#include "functions.h"
+#include "nodepool.h"
+
+namespace gnilk
+{
+    // Bumped for any change of the file or record layout, files with another version are rejected
+    #define EXP_SOLVER_FILE_VERSION 1
+
+    //
+    // Collects prepared expressions and writes them to one file
+    //
+    class ExpressionFileWriter {
+    public:
+        ExpressionFileWriter() = default;
+        virtual ~ExpressionFileWriter() = default;
+
+        // The solver must be prepared in double mode, returns false otherwise
+        bool Add(const ExpSolver &solver);
+        void Add(const NodePool &pool);
+        size_t Count() const { return entries.size(); }
+
+        void Write(std::vector<uint8_t> &out) const;
+        bool Write(const char *filename) const;
+    protected:
+        struct Entry {
+            uint64_t offset;        // in 'records'
+            uint64_t size;
+        };
+        std::vector<uint8_t> records;
+        std::vector<Entry> entries;
+    };
+
+    //
+    // Read side, the file is mapped and expressions are loaded on demand - nothing is parsed
+    //
+    class ExpressionFile {
+    public:
+        ExpressionFile() = default;
+        virtual ~ExpressionFile();
+        ExpressionFile(const ExpressionFile &) = delete;
+        ExpressionFile &operator=(const ExpressionFile &) = delete;
+
+        bool Open(const char *filename);
+        // In memory image, must stay alive while the file is open
+        bool Open(const void *data, size_t size);
+        void Close();
+
+        size_t Count() const { return count; }
+        // Native functions are resolved by name in 'functions' and then in the built-ins
+        bool Load(size_t idx, NodePool &pool, const FunctionRegistry *functions = nullptr) const;
+    protected:
+        bool Attach(const void *data, size_t size);
+    protected:
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+        size_t count = 0;
+        void *mapped = nullptr;     // owned mapping, when opened by name
+        size_t mappedSize = 0;
+        std::vector<uint8_t> buffer;    // file contents when mapping is not available
+    };
+}
@@ -19,6 +19,36 @@ TODO: [ -:Not done, +:In progress, !:Completed]
 
 
 \History
+- 19.10.26, FKling, Unary minus on names and parenthesis, a '-' without an operand is an error
+- 19.10.26, FKling, Column function calls are counted in the statistics
+- 19.10.26, FKling, Solve reports a failed compile through the error as well
+- 19.10.26, FKling, Prepare clears the whole error up front, successful parses leave none behind
+- 19.10.26, FKling, Prepare rejects trees deeper than EXP_SOLVER_MAX_DEPTH
+- 19.10.26, FKling, Node statistics walk the tree with an explicit stack
+- 19.10.26, FKling, Only the last statement can be a plain expression
+- 19.10.26, FKling, Built-in functions are opt-in, a function callback is no longer shadowed by them
+- 19.10.26, FKling, Column function callback for batches
+- 19.10.26, FKling, Errors are reported through GetError, no output from the library
+- 19.10.26, FKling, Table driven parser with explicit stacks, nesting is no longer limited by the call stack
+- 19.10.26, FKling, Prepared expressions can be serialized
+- 19.10.26, FKling, Expressions can be replaced, parser storage is reused between Prepare calls
+- 19.10.26, FKling, Optional runtime statistics (EXP_SOLVER_STATS)
+- 19.10.26, FKling, Exact 64 bit integer evaluation modes
+- 19.10.26, FKling, Optional incremental evaluation
+- 18.10.26, FKling, Programs of ';' separated statements with named results, empty input is an error
+- 18.10.26, FKling, Optional native code generation
+- 18.10.26, FKling, Shareable compiled expressions, the tokenizer only lives during Prepare
+- 18.10.26, FKling, Solve caches compiled expressions
+- 18.10.26, FKling, Optional flattening to a compact node pool
+- 18.10.26, FKling, Nodes and their names are allocated from an arena
+- 18.10.26, FKling, Identical pure sub-expressions are shared when optimizing
+- 18.10.26, FKling, Optional optimization pass
+- 18.10.26, FKling, Native function registry and built-in functions, no argument limit
+- 18.10.26, FKling, Variables are bound to slots when preparing
+- 18.10.26, FKling, Batch evaluation over variable columns
+- 18.10.26, FKling, Optional compile to byte code
+- 18.10.26, FKling, Operators are resolved to opcodes when building the tree
+- 18.10.26, FKling, Parsing works on token spans, no per-token allocations
 - 22.09.22, FKling, Added support for '<<' and '>>'
 - 04.08.14, FKling, Fixed bug related to priority of expressions and functions
                     Added multiple function arguments
@@ -30,47 +60,137 @@ TODO: [ -:Not done, +:In progress, !:Completed]
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 #ifndef WIN32
 //#include <alloc.h>
 #endif
 
 #include <math.h>
+#include <stdint.h>
+#include <chrono>
 #include "tokenizer.h"
 #include "expsolver.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "nodepool.h"
+#include "incremental.h"
+#include "solvecache.h"
+#include "compiledexpression.h"
+#include "optimizer.h"
 
 #include <vector>
 
 using namespace gnilk;
 
+#ifdef EXP_SOLVER_STATS
+static uint64_t NowNs() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+// Statement separators, operators and assignment
+static const char *kOperators = "<< >> * / + - ( ) , < > ? : ; =";
+// Initial size of the parser stacks
+static const size_t kParseStackReserve = 16;
+
 // Local helpers, forward declaration
-static unsigned long long hex2dec_c(const char *s);
-static unsigned long bin2dec(const char *binary);
+static unsigned long long hex2dec_c(std::string_view s);
+static unsigned long long bin2dec(std::string_view binary);
+static double dec2double(std::string_view s);
+static int64_t dec2int(std::string_view s);
+static bool dec2uint(std::string_view s, uint64_t &out);
 
 
 //
 // constructor
 //
-ExpSolver::ExpSolver(const char *expression) {
-    //this->expression = strdup(expression);
-    tokenizer = new Tokenizer(expression, "<< >> * / + - ( ) , < > ? :");
+ExpSolver::ExpSolver(const char *expression, Arena *pArena) :
+        expression(expression),
+        parser("", kOperators, Tokenizer::kTokenizerMode_Spans) {
+    tokenizer = nullptr;
     pVariableCallback = nullptr;
     pFuncCallback = nullptr;
+    pFuncBatchCallback = nullptr;
+    pVariableContext = nullptr;
+    pFunctionContext = nullptr;
+    pFunctionBatchContext = nullptr;
     tree = nullptr;
+    program = nullptr;
+    jit = nullptr;
+    pool = nullptr;
+    incremental = nullptr;
+    batchProgram = nullptr;
+    generation = 0;
+    numericMode = kNumericMode_Double;
+    useBuiltIns = false;
+    this->pArena = (pArena != nullptr) ? pArena : &arena;
 }
 
-bool ExpSolver::Solve(double *out, const char *expression) {
+//
+// Recurring expressions are compiled once, see SolveCache
+//
+bool ExpSolver::Solve(double *out, const char *expression, ExpSolverError *pError) {
+    auto &cache = SolveCache::Instance();
+    std::shared_ptr<const Program> compiled = cache.Find(expression);
+    if (compiled == nullptr) {
+        ExpSolver solver(expression);
+        // There is no function callback to shadow, the built-ins are always available here
+        solver.EnableBuiltInFunctions();
+        // Nothing can provide values for variables here
+        if (!solver.Prepare() || (solver.GetNumVariables() > 0)) {
+            if (solver.GetNumVariables() > 0) {
+                solver.SetEvaluationError(kExpError_NoVariableCallback, solver.GetVariableName(0));
+            }
+            if (pError != nullptr) {
+                *pError = solver.GetError();
+            }
+            return false;
+        }
+        // Only the built-in functions are available, mostly folds to a single constant
+        solver.Optimize();
+        if (!solver.Compile()) {
+            solver.SetEvaluationError(kExpError_NotCompiled, nullptr);
+            if (pError != nullptr) {
+                *pError = solver.GetError();
+            }
+            return false;
+        }
+        compiled.reset(solver.program);
+        solver.program = nullptr;
+        cache.Insert(expression, compiled);
+    }
+    EvalContext context;
+    *out = compiled->Run(context);
+    return true;
+}
+
+//
+// Integer modes are not cached, the compiled forms are double only
+//
+bool ExpSolver::SolveInt(int64_t *out, const char *expression, kNumericMode mode, ExpSolverError *pError) {
     ExpSolver solver(expression);
-    if (!solver.Prepare()) return false;
-    *out = solver.Evaluate();
+    solver.EnableBuiltInFunctions();
+    if (!solver.Prepare(mode) || (solver.GetNumVariables() > 0)) {
+        if (solver.GetNumVariables() > 0) {
+            solver.SetEvaluationError(kExpError_NoVariableCallback, solver.GetVariableName(0));
+        }
+        if (pError != nullptr) {
+            *pError = solver.GetError();
+        }
+        return false;
+    }
+    *out = solver.EvaluateInt();
     return true;
 }
 
 ExpSolver::~ExpSolver() {
-    delete tokenizer;
-    if (tree != nullptr) {
-        delete tree;
-    }
+    delete program;
+    delete jit;
+    delete pool;
+    delete incremental;
+    delete batchProgram;
+    // Nodes are released with the arena
 }
 
 //
@@ -89,6 +209,37 @@ void ExpSolver::RegisterUserFunctionCallback(PFNEVALUATEFUNC pFunc, void *pUser)
     pFunctionContext = pUser;
 }
 
+void ExpSolver::RegisterUserFunctionBatchCallback(PFNEVALUATEFUNCBATCH pFunc, void *pUser) {
+    pFuncBatchCallback = pFunc;
+    pFunctionBatchContext = pUser;
+}
+
+//
+// Pure callback functions, identical calls may be shared
+//
+void ExpSolver::SetUserFunctionPure(const char *name, bool pure) {
+    for (auto it = pureUserFunctions.begin(); it != pureUserFunctions.end(); it++) {
+        if (*it == name) {
+            if (!pure) {
+                pureUserFunctions.erase(it);
+            }
+            return;
+        }
+    }
+    if (pure) {
+        pureUserFunctions.push_back(name);
+    }
+}
+
+bool ExpSolver::IsUserFunctionPure(std::string_view name) const {
+    for (auto &pureName: pureUserFunctions) {
+        if (pureName == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
 //
 // determines if a char is a numerical token or not
 //
@@ -101,8 +252,11 @@ static bool IsNumeric(char c) {
 //
 // Classification of a token when building factors
 //
-ExpSolver::kTokenClass ExpSolver::ClassifyToken(const char *token) {
+ExpSolver::kTokenClass ExpSolver::ClassifyToken(std::string_view token) {
     kTokenClass result = kTokenClass_Unknown;
+    if (token.empty()) {
+        return result;
+    }
     if (IsNumeric(token[0])) {
         result = kTokenClass_Numeric;
     } else {
@@ -112,419 +266,1295 @@ ExpSolver::kTokenClass ExpSolver::ClassifyToken(const char *token) {
 }
 
 //
-// user function calls and variables
+// Names and parenthesis can follow a unary '-', numbers are negated by BuildConstant
 //
-BaseNode *ExpSolver::BuildUserCall() {
-    BaseNode *exp = nullptr;
-    BaseNode *arg = nullptr;
-    int argcounter = 0;
-    BaseNode *funcargs[EXP_SOLVER_MAX_ARGS];
-
-
-    const char *token = tokenizer->Next();
+static bool IsNegatable(std::string_view token) {
+    if (token == "(") {
+        return true;
+    }
+    return !token.empty() && !IsNumeric(token[0]) && (isalpha((unsigned char) token[0]) || (token[0] == '_'));
+}
 
-    const char *next = tokenizer->Peek();
-    if ((next != nullptr) && (next[0] == '(')) {
-        next = tokenizer->Next();
+//
+// Numeric constant, a leading '-' makes it negative
+//
+BaseNode *ExpSolver::BuildConstant() {
+    bool negative = false;
+    std::string_view token = tokenizer->NextView();
+    // Ugly - but I want to avoid string concat
+    // will not handle multiple '--'
+    if (token == "-") {
+        // negative numeric token, anything else after the '-' is a missing operand
+        std::string_view next = tokenizer->PeekView();
+        if (!tokenizer->HasMore() || (next == "-") || (ClassifyToken(next) != kTokenClass_Numeric)) {
+            SetError(kExpError_MissingOperand, next);
+            return nullptr;
+        }
+        token = tokenizer->NextView();
+        negative = true;
+    }
+    // build constant node, this is a leaf
+    return new (*pArena) ConstNode(token, negative);
+}
 
-        // Assume arguments to function call..
-        arg = BuildTree();
+//
+// Named result of an earlier statement or a variable
+//
+BaseNode *ExpSolver::BuildVariable(std::string_view name) {
+    BaseNode *exp = FindLocal(name);
+    if (exp != nullptr) {
+        return exp;
+    }
+    // variable, the value comes from a slot binding or the variable callback
+    size_t slot = slots.Add(name);
+    return new (*pArena) ConstUserNode(*pArena, VariableCallback(), VariableContext(), name, &slots, slot);
+}
 
-        // nullptr == Empty expression - i.e. no parameters to function call
-        if (arg != nullptr) {
-            funcargs[argcounter++] = arg;
+//
+// Function call with parsed arguments
+//
+BaseNode *ExpSolver::BuildCall(std::string_view name, BaseNode **args, size_t numArgs) {
+    // Native functions first, then built-ins when enabled and last the function callback
+    const NativeFunction *native = functions.Find(name);
+    if ((native == nullptr) && useBuiltIns) {
+        native = FunctionRegistry::BuiltIns().Find(name);
+    }
+    if (native != nullptr) {
+        if (!native->AcceptsArguments((int)numArgs)) {
+            SetError(kExpError_ArgumentCount, name);
+            return nullptr;
         }
-        next = tokenizer->Peek();
+        return new (*pArena) NativeFuncNode(*pArena, *native, name, (int)numArgs, args);
+    }
+    if (pFuncCallback == nullptr) {
+        SetError(kExpError_NoFunctionCallback, name);
+        return nullptr;
+    }
+    auto func = new (*pArena) FuncNode(*pArena, FunctionCallback(), FunctionContext(), name, (int)numArgs, args);
+    func->SetPure(IsUserFunctionPure(name));
+    return func;
+}
 
-        // Parse additional arguments
-        while (next[0] == ',') {
-            tokenizer->Next();
-            arg = BuildTree();
-            funcargs[argcounter++] = arg;
-            next = tokenizer->Peek();
-        }
+void ExpSolver::PushFrame(kParseContext context) {
+    ParseFrame frame = {};
+    frame.context = context;
+    frame.operandBase = operands.size();
+    frame.operatorBase = operators.size();
+    frames.push_back(frame);
+}
 
-        if (next[0] == ')') {
-            tokenizer->Next();
-            if (pFuncCallback != nullptr) {
-                exp = new FuncNode(pFuncCallback, pFunctionContext, token, argcounter, funcargs);
+//
+// Builds the pending operations of the top frame binding at least as tight as 'precedence'
+// Returns false when an operand is missing, the expression then ends before the next operator of the same precedence
+//
+bool ExpSolver::ReduceOperators(int precedence) {
+    const ParseFrame &frame = frames.back();
+    while (operators.size() > frame.operatorBase) {
+        kOpCode op = operators.back();
+        if (BinOpNode::Precedence(op) < precedence) {
+            break;
+        }
+        operators.pop_back();
+        BaseNode *right = operands.back();
+        operands.pop_back();
+        BaseNode *left = operands.back();
+        BaseNode *exp = nullptr;
+        if ((left != nullptr) && (right != nullptr)) {
+            if (BinOpNode::IsBoolOperator(op)) {
+                exp = new (*pArena) BoolOpNode(op, left, right);
             } else {
-                printf("[!] Error: No functional callback assigned\n");
+                exp = new (*pArena) BinOpNode(op, left, right);
             }
         } else {
-            printf("[!] Error: Unterminated function call: %s\n", token);
+            // Incomplete operation, kept when the operand failed with an error of its own
+            SetError(kExpError_MissingOperand, tokenizer->PeekView());
         }
-    } else {
-        // variable
-        if (pVariableCallback != nullptr) {
-            exp = new ConstUserNode(pVariableCallback, pVariableContext, token);
-        } else {
-            printf("[!] Error: No variable callback defined, token=%s\n", token);
+        operands.back() = exp;
+        if ((exp == nullptr) && (BinOpNode::Precedence(op) == precedence)) {
+            return false;
         }
     }
-    return exp;
+    return true;
 }
 
 //
-// build constant factors and sub-expressions
+// Precedence climbing with explicit stacks, the parser does not recurse - Prepare limits the tree depth, see EXP_SOLVER_MAX_DEPTH
+// Parenthesis, function arguments and '?:' branches are parsed in frames of their own, a finished frame
+// hands its result to the frame below. Empty expressions are nullptr, which fails the operation using them
 //
-BaseNode *ExpSolver::BuildSubExpr() {
-    BaseNode *exp = nullptr;
-    if (!tokenizer->HasMore()) {
+BaseNode *ExpSolver::BuildTree() {
+    typedef enum {
+        kParseState_Operand,
+        kParseState_Operator,
+        kParseState_Finish,
+    } kParseState;
+
+    // Typical expressions never grow the stacks past the first allocation
+    if (frames.capacity() == 0) {
+        frames.reserve(kParseStackReserve);
+        operands.reserve(kParseStackReserve);
+        operators.reserve(kParseStackReserve);
+    }
+    frames.clear();
+    operands.clear();
+    operators.clear();
+    arguments.clear();
+    PushFrame(kParseContext_Tree);
+
+    kParseState state = kParseState_Operand;
+    BaseNode *exp = nullptr;        // result of the finished frame
+    while (true) {
+        switch (state) {
+            case kParseState_Operand : {
+                state = kParseState_Operator;
+                if (!tokenizer->HasMore()) {
+                    operands.push_back(nullptr);
+                    break;
+                }
+                std::string_view token = tokenizer->PeekView();
+                kTokenClass tc = kTokenClass_Unknown;
+                if (token == "(") {
+                    // Start of new expression
+                    tokenizer->NextView();
+                    PushFrame(kParseContext_Parenthesis);
+                    state = kParseState_Operand;
+                } else if ((token == ")") || (token == ",") || (token == ";")) {
+                    // empty expression
+                    operands.push_back(nullptr);
+                } else if (token == "=") {
+                    SetError(kExpError_UnexpectedAssignment, token);
+                    operands.push_back(nullptr);
+                } else if ((token == "-") && IsNegatable(tokenizer->PeekView(1))) {
+                    // Negated name or parenthesis, -1 * operand - pushed without reducing so it binds tighter than the operator before it
+                    tokenizer->NextView();
+                    operands.push_back(new (*pArena) ConstNode(-1.0));
+                    operators.push_back(kOpCode_Mul);
+                    state = kParseState_Operand;
+                } else if ((tc = ClassifyToken(token)) == kTokenClass_Numeric) {
+                    operands.push_back(BuildConstant());
+                } else if (tc == kTokenClass_Variable) {
+                    tokenizer->NextView();
+                    if (tokenizer->PeekView() == "(") {
+                        tokenizer->NextView();
+                        if (tokenizer->PeekView() == ")") {
+                            // Call without arguments
+                            tokenizer->NextView();
+                            operands.push_back(BuildCall(token, nullptr, 0));
+                            break;
+                        }
+                        // Arguments are parsed in frames of their own, the call is built when all are done
+                        ParseFrame &frame = frames.back();
+                        frame.function = token;
+                        frame.argumentBase = arguments.size();
+                        PushFrame(kParseContext_Argument);
+                        state = kParseState_Operand;
+                    } else {
+                        operands.push_back(BuildVariable(token));
+                    }
+                } else {
+                    SetError(kExpError_UnexpectedToken, token);
+                    operands.push_back(nullptr);
+                }
+                break;
+            }
+            case kParseState_Operator : {
+                kOpCode op = BinOpNode::ClassifyOperator(tokenizer->PeekView());
+                if (op != kOpCode_Invalid) {
+                    if (!ReduceOperators(BinOpNode::Precedence(op))) {
+                        exp = nullptr;
+                        state = kParseState_Finish;
+                        break;
+                    }
+                    tokenizer->NextView();
+                    operators.push_back(op);
+                    state = kParseState_Operand;
+                    break;
+                }
+                // Binary operators bind tighter than '?:'
+                ReduceOperators(0);
+                exp = operands.back();
+                state = kParseState_Finish;
+                if (tokenizer->PeekView() == "?") {
+                    tokenizer->NextView();
+                    frames.back().condition = exp;
+                    PushFrame(kParseContext_IfTrue);
+                    state = kParseState_Operand;
+                }
+                break;
+            }
+            case kParseState_Finish : {
+                ParseFrame finished = frames.back();
+                frames.pop_back();
+                operands.resize(finished.operandBase);
+                operators.resize(finished.operatorBase);
+
+                std::string_view token;
+                switch (finished.context) {
+                    case kParseContext_Tree :
+                        return exp;
+                    case kParseContext_Parenthesis :
+                        // Check if expression was properly terminated
+                        if (tokenizer->PeekView() != ")") {
+                            SetError(kExpError_MissingParenthesis, tokenizer->PeekView());
+                            exp = nullptr;
+                        } else {
+                            tokenizer->NextView();
+                        }
+                        operands.push_back(exp);
+                        state = kParseState_Operator;
+                        break;
+                    case kParseContext_Argument : {
+                        ParseFrame &frame = frames.back();
+                        state = kParseState_Operator;
+                        if (exp == nullptr) {
+                            SetError(kExpError_MissingArgument, frame.function);
+                            arguments.resize(frame.argumentBase);
+                            operands.push_back(nullptr);
+                            break;
+                        }
+                        arguments.push_back(exp);
+                        token = tokenizer->PeekView();
+                        if (token == ",") {
+                            tokenizer->NextView();
+                            PushFrame(kParseContext_Argument);
+                            state = kParseState_Operand;
+                            break;
+                        }
+                        exp = nullptr;
+                        if (token == ")") {
+                            tokenizer->NextView();
+                            exp = BuildCall(frame.function, arguments.data() + frame.argumentBase, arguments.size() - frame.argumentBase);
+                        } else {
+                            SetError(kExpError_UnterminatedCall, frame.function);
+                        }
+                        arguments.resize(frame.argumentBase);
+                        operands.push_back(exp);
+                        break;
+                    }
+                    case kParseContext_IfTrue :
+                        // On errors the frame waiting for the branches fails
+                        if (exp == nullptr) {
+                            SetError(kExpError_IfMismatch, tokenizer->PeekView());
+                            break;
+                        }
+                        token = tokenizer->PeekView();
+                        if (token != ":") {
+                            SetError(kExpError_MissingColon, token);
+                            exp = nullptr;
+                            break;
+                        }
+                        tokenizer->NextView();
+                        frames.back().pTrue = exp;
+                        PushFrame(kParseContext_IfFalse);
+                        state = kParseState_Operand;
+                        break;
+                    case kParseContext_IfFalse : {
+                        // The '?:' is the result of the frame waiting for it
+                        const ParseFrame &frame = frames.back();
+                        if ((frame.condition == nullptr) || (exp == nullptr)) {
+                            SetError(kExpError_IfMismatch, tokenizer->PeekView());
+                            exp = nullptr;
+                        } else {
+                            exp = new (*pArena) IfOperatorNode(frame.condition, frame.pTrue, exp);
+                        }
+                        break;
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+//
+// Assignment ('name = <exp>') or a plain expression
+// The assigned expression is evaluated once by the first reference reached in an evaluation,
+// references in later statements reuse the value - statements run in dependency order
+//
+BaseNode *ExpSolver::BuildStatement() {
+    if (tokenizer->PeekView(1) != "=") {
+        return BuildTree();
+    }
+    std::string_view name = tokenizer->NextView();
+    if ((ClassifyToken(name) != kTokenClass_Variable) || !(isalpha((unsigned char) name[0]) || (name[0] == '_'))) {
+        SetError(kExpError_InvalidAssignment, name);
+        return nullptr;
+    }
+    tokenizer->NextView();
+    BaseNode *exp = BuildTree();
+    if (exp == nullptr) {
+        SetError(kExpError_MissingAssignmentValue, name);
         return nullptr;
     }
 
-    kTokenClass tc = kTokenClass_Unknown;
-    const char *token = tokenizer->Peek();
+    // Constants are cheaper to repeat than to share
+    BaseNode *value = exp;
+    if (exp->Type() != kNodeType_Const) {
+        auto expression = new (*pArena) SharedExpression();
+        expression->node = exp;
+        shared.push_back(expression);
+        value = new (*pArena) SharedNode(expression, &generation);
+    }
+    // A new assignment to the same name is used by the statements after it
+    for (auto &local: locals) {
+        if (local.first == name) {
+            local.second = value;
+            return value;
+        }
+    }
+    locals.push_back(std::make_pair(name, value));
+    return value;
+}
 
-    // classify next
-    if (token[0] == '(')    // Start of new expression, ok, build tree..
-    {
-        // Swallow peek...
-        tokenizer->Next();
+BaseNode *ExpSolver::FindLocal(std::string_view name) const {
+    for (auto &local: locals) {
+        if (local.first == name) {
+            return local.second;
+        }
+    }
+    return nullptr;
+}
 
-        exp = BuildTree();
+// boolean stuff here
+//
+// Releases the tree and everything compiled from it
+//
+void ExpSolver::Clear() {
+    // A previous tree is released in one go, a shared arena keeps it until the owner resets it
+    tree = nullptr;
+    nodes.clear();
+    shared.clear();
+    if (pArena == &arena) {
+        arena.Reset();
+    }
+    delete program;
+    program = nullptr;
+    delete jit;
+    jit = nullptr;
+    delete pool;
+    pool = nullptr;
+    delete incremental;
+    incremental = nullptr;
+    delete batchProgram;
+    batchProgram = nullptr;
+    slots.Clear();
+}
 
-        token = tokenizer->Peek();
-        // Check if expression was properly terminated
-        if (strcmp(token, ")")) {
-            // error
-            printf("[!] Error: Missing right parenthesis\n");
-            return nullptr;
-        }
-        tokenizer->Next();
-    } else if (token[0] == ')') {
-        // empty expression
-        return nullptr;
-    } else if ((tc = ClassifyToken(token)) != kTokenClass_Unknown) {
-        // Token was not a sub-expression, check if a number or something user-defined
-        switch (tc) {
-            case kTokenClass_Numeric : {
-                bool negative = false;
-                token = tokenizer->Next();
-                //printf("Numeric, next: %s\n", token);
-                // Ugly - but I want to avoid string concat
-                // will not handle multiple '--'
-                if (token[0] == '-') {
-                    // negative numeric token
-                    token = tokenizer->Next();
-                    negative = true;
+void ExpSolver::SetExpression(std::string_view expression) {
+    Clear();
+    this->expression.assign(expression.data(), expression.size());
+}
 
-                }
-                // build constant node, this is a leaf
-                exp = new ConstNode(token, negative);
-            }
+//
+// Prepare the expression = build the expression tree
+//
+bool ExpSolver::Prepare(kNumericMode mode) {
+    numericMode = mode;
+    stats = ExpSolverStats();
+    error = ExpSolverError();
+#ifdef EXP_SOLVER_STATS
+    uint64_t startNs = NowNs();
+#endif
+    Clear();
+
+    // Tokens are spans over our own copy of the expression, the span storage is kept for the next Prepare
+    // no tree or program refers to the tokens once Prepare returns
+    parser.Reset(expression.c_str());
+    tokenizer = &parser;
+
+    // Statements are separated by ';', the value of the program is the value of the last statement
+    // only the last one can be a plain expression, the others can't be referenced
+    bool result = true;
+    std::string_view unused;
+    while (result && tokenizer->HasMore()) {
+        // Empty statement
+        if (tokenizer->PeekView() == ";") {
+            tokenizer->NextView();
+            continue;
+        }
+        if (!unused.empty()) {
+            SetError(kExpError_UnusedStatement, unused);
+            result = false;
             break;
-            case kTokenClass_Variable :
-                exp = BuildUserCall();
+        }
+        if (tokenizer->PeekView(1) != "=") {
+            unused = tokenizer->PeekView();
+        }
+        BaseNode *exp = BuildStatement();
+        // However, let's fail if there is some kind of error
+        if (exp == nullptr) {
+            result = false;
+            break;
+        }
+        nodes.push_back(exp);
+        // Expressions following the first one in a statement are built but not used
+        while (tokenizer->HasMore() && (tokenizer->PeekView() != ";")) {
+            if (BuildTree() == nullptr) {
+                result = false;
                 break;
-            default:
-                printf("[!] Error: Unknown token class: '%s'\n", token);
-                return nullptr;
+            }
         }
-    } else {
-        printf("[!] Error: Unexpected token: %s\n", token);
     }
-    return exp;
+    // Empty parenthesis and statements fail without an error of their own
+    if (!result) {
+        SetError(kExpError_EmptyExpression, tokenizer->PeekView());
+    }
+    tokenizer = nullptr;
+    locals.clear();
+    if (result && nodes.empty()) {
+        SetError(kExpError_EmptyExpression, std::string_view());
+        result = false;
+    }
+    if (!result) {
+        nodes.clear();
+        shared.clear();
+        return false;
+    }
+    // Evaluation and the compilers recurse once per tree level
+    for (auto node: nodes) {
+        if (TreeHeight(node, false) > EXP_SOLVER_MAX_DEPTH) {
+            SetError(kExpError_TooDeep, std::string_view());
+            nodes.clear();
+            shared.clear();
+            return false;
+        }
+    }
+    // Earlier statements are evaluated through the references from the last one
+    tree = nodes.back();
+#ifdef EXP_SOLVER_STATS
+    stats.prepareNs = NowNs() - startNs;
+    UpdateNodeStats();
+#endif
+    return true;
 }
 
 //
-// Builds * and /
+// Immutable copy of the prepared expression, shareable between threads
 //
-BaseNode *ExpSolver::BuildMulDiv() {
-    BaseNode *exp;
-
-    exp = BuildSubExpr();    // build
+std::shared_ptr<const CompiledExpression> ExpSolver::GetCompiledExpression() const {
+    if ((tree == nullptr) || (numericMode != kNumericMode_Double)) {
+        return nullptr;
+    }
+    auto compiled = std::make_shared<CompiledExpression>();
+    if (!compiled->Compile(expression.c_str(), tree, slots)) {
+        return nullptr;
+    }
+    return compiled;
+}
 
-    if (tokenizer->HasMore()) {
-        const char *token = tokenizer->Peek();
-        //while(Tokenizer::Case(token,"* /") >= 0)
-        while ((token != nullptr) && ((token[0] == '*') || (token[0] == '/'))) {
-            //printf("term\n");
-            token = tokenizer->Next();
-            BaseNode *next = BuildSubExpr();
-            exp = new BinOpNode(token, exp, next);
-            token = tokenizer->Peek();
-        }
+//
+// Fold constants and remove no-op operations, invalidates compiled programs
+//
+bool ExpSolver::Optimize() {
+    if ((tree == nullptr) || (numericMode != kNumericMode_Double)) {
+        return false;
+    }
+    for (auto expression: shared) {
+        expression->node = Optimizer::Optimize(expression->node, *pArena);
     }
-    return exp;
+    for (auto &node: nodes) {
+        node = Optimizer::Optimize(node, *pArena);
+        node = Optimizer::ShareSubExpressions(node, *pArena, shared, &generation);
+    }
+    tree = nodes.back();
+    UpdateNodeStats();
+
+    delete program;
+    program = nullptr;
+    delete jit;
+    jit = nullptr;
+    delete pool;
+    pool = nullptr;
+    delete incremental;
+    incremental = nullptr;
+    delete batchProgram;
+    batchProgram = nullptr;
+    return true;
 }
 
 //
-// Builds +/- nodes
+// Callbacks for the byte code interpreter
 //
-BaseNode *ExpSolver::BuildAddSub() {
-    BaseNode *exp;
-    exp = BuildMulDiv();
-    if (tokenizer->HasMore()) {
-        const char *token = tokenizer->Peek();
-        while ((token != nullptr) && ((token[0] == '+') || (token[0] == '-'))) {
-            token = tokenizer->Next();
-            BaseNode *nextTerm = BuildMulDiv();
-            exp = new BinOpNode(token, exp, nextTerm);
-            token = tokenizer->Peek();
-        }
+void ExpSolver::InitContext(EvalContext &context) const {
+    context.pSlots = slots.bindings.data();
+    context.pVariableCallback = VariableCallback();
+    context.pVariableContext = VariableContext();
+    context.pFuncCallback = FunctionCallback();
+    context.pFunctionContext = FunctionContext();
+    // Not checked, a failed batch call falls back to the checked function callback
+#ifdef EXP_SOLVER_STATS
+    context.pFuncBatchCallback = (pFuncBatchCallback != nullptr) ? CountedFunctionBatchCallback : nullptr;
+    context.pFunctionBatchContext = (void *) this;
+#else
+    context.pFuncBatchCallback = pFuncBatchCallback;
+    context.pFunctionBatchContext = pFunctionBatchContext;
+#endif
+}
+
+//
+// Statistics, the callback trampolines below count the calls when built with EXP_SOLVER_STATS
+//
+bool ExpSolver::HasStats() {
+#ifdef EXP_SOLVER_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+PFNEVALUATE ExpSolver::VariableCallback() const {
+    return CheckedVariableCallback;
+}
+
+void *ExpSolver::VariableContext() const {
+    return (void *) this;
+}
+
+PFNEVALUATEFUNC ExpSolver::FunctionCallback() const {
+    return CheckedFunctionCallback;
+}
+
+void *ExpSolver::FunctionContext() const {
+    return (void *) this;
+}
+
+//
+// Every callback goes through here, from the tree and all compiled forms - a failed callback is an evaluation error
+// the trampolines are there for the error, they are used with and without statistics
+//
+double ExpSolver::CheckedVariableCallback(void *pUser, const char *name, int *bOk_out) {
+    auto solver = (ExpSolver *) pUser;
+#ifdef EXP_SOLVER_STATS
+    solver->stats.numVariableCallbacks++;
+#endif
+    double result = 0.0;
+    *bOk_out = 0;
+    if (solver->pVariableCallback != nullptr) {
+        result = solver->pVariableCallback(solver->pVariableContext, name, bOk_out);
+    }
+    if (!*bOk_out) {
+        solver->SetEvaluationError(kExpError_UnknownVariable, name);
     }
-    return exp;
+    return result;
 }
 
+double ExpSolver::CheckedFunctionCallback(void *pUser, const char *name, int args, double *arg, int *bOk_out) {
+    auto solver = (ExpSolver *) pUser;
+#ifdef EXP_SOLVER_STATS
+    solver->stats.numFunctionCallbacks++;
+#endif
+    double result = 0.0;
+    *bOk_out = 0;
+    if (solver->pFuncCallback != nullptr) {
+        result = solver->pFuncCallback(solver->pFunctionContext, name, args, arg, bOk_out);
+    }
+    if (!*bOk_out) {
+        solver->SetEvaluationError(kExpError_UnknownFunction, name);
+    }
+    return result;
+}
+
+#ifdef EXP_SOLVER_STATS
+// One count per column call, rows the batch callback declines are counted again by the per row calls
+void ExpSolver::CountedFunctionBatchCallback(void *pUser, const char *name, int args, const double * const *arg, size_t nRows, double *out, int *bOk_out) {
+    auto solver = (ExpSolver *) pUser;
+    solver->stats.numFunctionCallbacks++;
+    solver->pFuncBatchCallback(solver->pFunctionBatchContext, name, args, arg, nRows, out, bOk_out);
+}
+#endif
 
 //
-// Build shift ('<<' or '>>') nodes
+// Errors
 //
-BaseNode *ExpSolver::BuildShift() {
-    BaseNode *exp;
-    exp = BuildAddSub();
-    if (tokenizer->HasMore()) {
-        const char *token = tokenizer->Peek();
-        while ((token != nullptr) && (Tokenizer::Case(token, "<< >>") != -1)) {
-            token = tokenizer->Next();
-            BaseNode *nextAddSub = BuildAddSub();
-            exp = new BinOpNode(token, exp, nextAddSub);
-            token = tokenizer->Peek();
-        }
+static const char *errorStrings[kExpError_NumErrors] = {
+    "No error",                                         // kExpError_None
+    "Empty expression",                                 // kExpError_EmptyExpression
+    "Unexpected token",                                 // kExpError_UnexpectedToken
+    "Unexpected assignment",                            // kExpError_UnexpectedAssignment
+    "Can't assign to",                                  // kExpError_InvalidAssignment
+    "Missing expression in assignment to",              // kExpError_MissingAssignmentValue
+    "Missing operand",                                  // kExpError_MissingOperand
+    "Missing right parenthesis",                        // kExpError_MissingParenthesis
+    "Missing function argument",                        // kExpError_MissingArgument
+    "Unterminated function call",                       // kExpError_UnterminatedCall
+    "Wrong number of arguments to function",            // kExpError_ArgumentCount
+    "No functional callback assigned",                  // kExpError_NoFunctionCallback
+    "Expected ':'",                                     // kExpError_MissingColon
+    "Operator mismatch, use <exp>?<true>:<false>",      // kExpError_IfMismatch
+    "Result of statement is not used",                  // kExpError_UnusedStatement
+    "Expression nested too deep",                       // kExpError_TooDeep
+    "No variable callback defined",                     // kExpError_NoVariableCallback
+    "Expression not prepared",                          // kExpError_NotPrepared
+    "Expression can't be compiled",                     // kExpError_NotCompiled
+    "Unknown variable",                                 // kExpError_UnknownVariable
+    "Unknown function",                                 // kExpError_UnknownFunction
+};
+
+const char *ExpSolver::ErrorString(kExpError code) {
+    if ((code < 0) || (code >= kExpError_NumErrors)) {
+        return "Invalid error code";
     }
-    return exp;
+    return errorStrings[code];
 }
 
+void ExpSolver::SetError(kExpError code, std::string_view token) {
+    if (error.code != kExpError_None) {
+        return;
+    }
+    error.code = code;
+    error.token.assign(token.data(), token.length());
+    // Tokens are spans over our copy of the expression, errors without a token are at the end
+    auto base = (uintptr_t) expression.data();
+    auto ptr = (uintptr_t) token.data();
+    error.position = ((ptr >= base) && (ptr <= base + expression.length())) ? (size_t) (ptr - base) : expression.length();
+}
 
-BaseNode *ExpSolver::BuildBool() {
-    BaseNode *exp;
-    exp = BuildShift();
-    if (tokenizer->HasMore()) {
-        const char *token = tokenizer->Peek();
-        //printf("BuildBool, token=%s",token);
-        while ((token != nullptr) && ((token[0] == '>') || (token[0] == '<'))) {
-            token = tokenizer->Next();
-            //printf("BuildBool, Next as BuildBase\n");
-            BaseNode *nextBase = BuildShift();
-            exp = new BoolOpNode(token, exp, nextBase);
-            token = tokenizer->Peek();
-            //printf("BuildBool, done, next token=%s\n",token);
-        }
-    } else {
-        //printf("BuildBool, no more data\n");
-    }
-    return exp;
-}
-
-BaseNode *ExpSolver::BuildIf() {
-    BaseNode *exp;
-    exp = BuildBool();
-    if (tokenizer->HasMore()) {
-        const char *token = tokenizer->Peek();
-        //printf("BuildIf, HasMore, token=%s\n",token);
-        while ((token != nullptr) && (token[0] == '?')) {
-            token = tokenizer->Next();
-            //printf("BuildIf, build true\n");
-            BaseNode *pTrue = BuildTree();
-            if (pTrue == nullptr) {
-                printf("[!] Error: Operator mismatch, use <exp>?<true>:<false>\n");
-                return nullptr;
-            }
+void ExpSolver::SetEvaluationError(kExpError code, const char *name) {
+    if (error.code != kExpError_None) {
+        return;
+    }
+    error.code = code;
+    error.token.assign((name != nullptr) ? name : "");
+    error.position = ExpSolverError::kNoPosition;
+}
 
-            token = tokenizer->Peek();
-            if ((token == nullptr) || (token[0] != ':')) {
-                printf("[!] Error: token error, expected ':' got '%s'\n", token);
-                return nullptr;
+#ifdef EXP_SOLVER_STATS
+void ExpSolver::RecordEvaluation(uint64_t startNs) {
+    uint64_t elapsed = NowNs() - startNs;
+    stats.numEvaluations++;
+    stats.totalEvaluationNs += elapsed;
+    if (elapsed > stats.maxEvaluationNs) {
+        stats.maxEvaluationNs = elapsed;
+    }
+}
+#endif
+
+//
+// Height of a tree, shared expressions are walked by their first reference and counted once
+// node counts per type are added to the statistics when 'count' is set
+//
+size_t ExpSolver::TreeHeight(const BaseNode *root, bool count) {
+    walk.clear();
+    walk.push_back({ root, 0, 0 });
+    while (true) {
+        TreeWalk &top = walk.back();
+        const BaseNode *child = nullptr;
+        if (top.node->Type() == kNodeType_Shared) {
+            auto expression = static_cast<const SharedNode *>(top.node)->Expression();
+            if (top.next++ == 0) {
+                if (expression->height == 0) {
+                    child = expression->node;
+                } else {
+                    top.height = expression->height;
+                }
+            } else {
+                expression->height = top.height;
             }
-            token = tokenizer->Next();
-            BaseNode *pFalse = BuildTree();
-            exp = new IfOperatorNode(exp, pTrue, pFalse);
+        } else if (top.next < top.node->NumChildren()) {
+            child = top.node->Child(top.next++);
+        }
+        if (child != nullptr) {
+            walk.push_back({ child, 0, 0 });
+            continue;
+        }
 
-            token = tokenizer->Peek();
+        if (count) {
+            stats.nodesByType[top.node->Type()]++;
+            stats.numNodes++;
+        }
+        size_t height = top.height + 1;
+        walk.pop_back();
+        if (walk.empty()) {
+            return height;
+        }
+        if (height > walk.back().height) {
+            walk.back().height = height;
         }
-    } else {
-        //printf("BuildIf, no more data\n");
     }
-    //printf("BuildIf, done, exp=%p\n", exp);
-    return exp;
 }
 
-BaseNode *ExpSolver::BuildTree() {
-    BaseNode *exp = BuildIf();
-    return exp;
+void ExpSolver::UpdateNodeStats() {
+#ifdef EXP_SOLVER_STATS
+    stats.numNodes = 0;
+    for (auto &count: stats.nodesByType) {
+        count = 0;
+    }
+    stats.treeDepth = 0;
+    for (auto expression: shared) {
+        expression->height = 0;
+    }
+    for (auto node: nodes) {
+        size_t depth = TreeHeight(node, true);
+        if (node == tree) {
+            stats.treeDepth = depth;
+        }
+    }
+#endif
 }
 
-// boolean stuff here
 //
-// Prepare the expression = build the expression tree
+// Compile the prepared expression to byte code
 //
-bool ExpSolver::Prepare() {
-    if (tree != nullptr) {
-        delete tree;
-        tree = nullptr;
+bool ExpSolver::Compile() {
+    if ((tree == nullptr) || (numericMode != kNumericMode_Double)) {
+        return false;
     }
-    // This allows for multi-expression and is the basis for a proper interpreter
-    while (tokenizer->HasMore()) {
-        BaseNode *exp = BuildTree();
-        // However, let's fail if there is some kind of error
-        if (exp == nullptr) {
-            return false;
-        }
-        nodes.push_back(exp);
+    auto compiled = new Program();
+    if (!compiled->Compile(tree)) {
+        delete compiled;
+        return false;
     }
-    // Store tree for first node..
-    tree = nodes[0];
+    delete program;
+    program = compiled;
     return true;
 }
 
+//
+// Compile the prepared expression to native code, byte code if that is not possible
+//
+bool ExpSolver::CompileJit() {
+    if ((tree == nullptr) || (numericMode != kNumericMode_Double)) {
+        return false;
+    }
+    auto compiled = new JitProgram();
+    if (!compiled->Compile(tree)) {
+        delete compiled;
+        delete jit;
+        jit = nullptr;
+        return Compile();
+    }
+    delete jit;
+    jit = compiled;
+    return true;
+}
+
+//
+// Flatten the prepared expression to a node pool
+//
+bool ExpSolver::Flatten() {
+    if ((tree == nullptr) || (numericMode != kNumericMode_Double)) {
+        return false;
+    }
+    auto flattened = new NodePool();
+    if (!flattened->Build(tree)) {
+        delete flattened;
+        return false;
+    }
+    delete pool;
+    pool = flattened;
+    return true;
+}
+
+//
+// Binary record of the flattened expression, loaded with NodePool::Deserialize
+//
+bool ExpSolver::Serialize(std::vector<uint8_t> &out) const {
+    if ((tree == nullptr) || (numericMode != kNumericMode_Double)) {
+        return false;
+    }
+    NodePool flattened;
+    if (!flattened.Build(tree)) {
+        return false;
+    }
+    flattened.Serialize(out);
+    return true;
+}
+
+//
+// Incremental evaluation, the pool keeps the value of every node between evaluations
+//
+bool ExpSolver::EnableIncremental() {
+    if ((tree == nullptr) || (numericMode != kNumericMode_Double)) {
+        return false;
+    }
+    auto built = new IncrementalPool();
+    if (!built->Build(tree)) {
+        delete built;
+        return false;
+    }
+    delete incremental;
+    incremental = built;
+    return true;
+}
+
+bool ExpSolver::MarkVariableChanged(size_t slot) {
+    if (slot >= slots.names.size()) {
+        return false;
+    }
+    if (incremental != nullptr) {
+        incremental->MarkChanged(slot);
+    }
+    return true;
+}
+
+bool ExpSolver::MarkVariableChanged(const char *name) {
+    int slot = slots.Find(name);
+    if (slot < 0) {
+        return false;
+    }
+    return MarkVariableChanged((size_t) slot);
+}
+
+void ExpSolver::MarkAllVariablesChanged() {
+    if (incremental != nullptr) {
+        incremental->MarkAllChanged();
+    }
+}
+
+size_t ExpSolver::GetNumRecomputed() const {
+    return (incremental != nullptr) ? incremental->NumRecomputed() : 0;
+}
+
 //
 // Evaluate a prepared expression
 //
 double ExpSolver::Evaluate() {
+    if (numericMode != kNumericMode_Double) {
+        return intops::ToDouble(EvaluateInt(), numericMode);
+    }
+    error.code = kExpError_None;
+#ifdef EXP_SOLVER_STATS
+    uint64_t startNs = NowNs();
+#endif
     double result = 0.0;
     //printf("Nodes: %d\n", nodes.size());
-    if (tree != nullptr) {
+    if (incremental != nullptr) {
+        EvalContext context;
+        InitContext(context);
+        result = incremental->Evaluate(context);
+    } else if (jit != nullptr) {
+        EvalContext context;
+        InitContext(context);
+        result = jit->Run(context);
+    } else if (program != nullptr) {
+        EvalContext context;
+        InitContext(context);
+        result = program->Run(context);
+    } else if (pool != nullptr) {
+        EvalContext context;
+        InitContext(context);
+        result = pool->Evaluate(context);
+    } else if (tree != nullptr) {
+        // New generation, shared sub-expressions are evaluated again
+        generation++;
         result = tree->Evaluate();
+    } else {
+        SetEvaluationError(kExpError_NotPrepared, nullptr);
     }
+#ifdef EXP_SOLVER_STATS
+    RecordEvaluation(startNs);
+#endif
+    return result;
+}
+
+//
+// Evaluate a prepared expression in the integer mode it was prepared with, always the tree
+//
+int64_t ExpSolver::EvaluateInt() {
+    if (numericMode == kNumericMode_Double) {
+        return intops::FromDouble(Evaluate(), kNumericMode_Int64);
+    }
+    error.code = kExpError_None;
+    if (tree == nullptr) {
+        SetEvaluationError(kExpError_NotPrepared, nullptr);
+        return 0;
+    }
+#ifdef EXP_SOLVER_STATS
+    uint64_t startNs = NowNs();
+#endif
+    generation++;
+    int64_t result = tree->EvaluateInt(numericMode);
+#ifdef EXP_SOLVER_STATS
+    RecordEvaluation(startNs);
+#endif
     return result;
 }
 
+//
+// Variable slots
+//
+size_t VariableSlots::Add(std::string_view name) {
+    int idx = Find(name);
+    if (idx >= 0) {
+        return (size_t) idx;
+    }
+    names.push_back(std::string(name));
+    bindings.push_back(nullptr);
+    return names.size() - 1;
+}
+
+int VariableSlots::Find(std::string_view name) const {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+const char *ExpSolver::GetVariableName(size_t slot) const {
+    if (slot >= slots.names.size()) {
+        return nullptr;
+    }
+    return slots.names[slot].c_str();
+}
+
+int ExpSolver::GetVariableSlot(const char *name) const {
+    return slots.Find(name);
+}
+
+bool ExpSolver::BindVariable(size_t slot, const double *value) {
+    if (slot >= slots.bindings.size()) {
+        return false;
+    }
+    slots.bindings[slot] = value;
+    MarkVariableChanged(slot);
+    return true;
+}
+
+void ExpSolver::BindVariables(const double *values) {
+    for (size_t i = 0; i < slots.bindings.size(); i++) {
+        slots.bindings[i] = (values == nullptr) ? nullptr : &values[i];
+    }
+    MarkAllVariablesChanged();
+}
+
+//
+// Evaluate a prepared expression over columns of variable values
+// The batch program evaluates both sides of '?:' for all rows and selects the result
+//
+bool ExpSolver::EvaluateBatch(double *out, size_t nRows, const BatchColumn *columns, size_t nColumns) {
+    if ((tree == nullptr) || (numericMode != kNumericMode_Double)) {
+        return false;
+    }
+    if (batchProgram == nullptr) {
+        batchProgram = new Program();
+        if (!batchProgram->Compile(tree, Program::kCompileMode_Select)) {
+            delete batchProgram;
+            batchProgram = nullptr;
+            return false;
+        }
+    }
+
+    // Map the named columns to the program variables, once per call
+    auto &variables = batchProgram->Variables();
+    std::vector<const double *> varColumns(variables.size(), nullptr);
+    for (size_t i = 0; i < variables.size(); i++) {
+        for (size_t c = 0; c < nColumns; c++) {
+            if (variables[i] == columns[c].name) {
+                varColumns[i] = columns[c].data;
+                break;
+            }
+        }
+    }
+
+    error.code = kExpError_None;
+    EvalContext context;
+    InitContext(context);
+    return batchProgram->RunBatch(context, varColumns.data(), nRows, out);
+}
+
 //
 // Node types...
 //
 
-ConstNode::ConstNode(const char *input, bool negative) {
-    if ((input[0] == '$') || (input[0] == 'x')) {
+ConstNode::ConstNode(std::string_view input, bool negative) {
+    if (input.empty()) {
+        numeric = 0.0;
+        integer = 0;
+    } else if ((input[0] == '$') || (input[0] == 'x')) {
         // HEX input
-        numeric = (float) hex2dec_c(&input[1]);
+        integer = (int64_t) hex2dec_c(input.substr(1));
+        numeric = (double) (uint64_t) integer;
     } else if (input[0] == '%') {
         // Binary input
-        numeric = (float) bin2dec(&input[1]);
+        integer = (int64_t) bin2dec(input.substr(1));
+        numeric = (double) (uint64_t) integer;
     } else {
-        // Decimale input
-        numeric = atof(input);
+        // Decimale input, plain integers are exact without atof
+        uint64_t value = 0;
+        if (dec2uint(input, value)) {
+            integer = (int64_t) value;
+            numeric = (value <= (1ULL << 53)) ? (double) value : dec2double(input);
+        } else {
+            numeric = dec2double(input);
+            integer = dec2int(input);
+        }
     }
     if (negative) {
         numeric *= -1;
+        integer = intops::Sub(0, integer);
     }
 }
 
+ConstNode::ConstNode(double value) {
+    numeric = value;
+    integer = intops::FromDouble(value, kNumericMode_Int64);
+}
+
 double ConstNode::Evaluate() {
     return numeric;
 }
 
+int64_t ConstNode::EvaluateInt(kNumericMode) {
+    return integer;
+}
+
 
-ConstUserNode::ConstUserNode(PFNEVALUATE func, void *pUser, const char *input) {
+ConstUserNode::ConstUserNode(Arena &arena, PFNEVALUATE func, void *pUser, std::string_view input, const VariableSlots *pSlots, size_t slot) {
     this->pUser = pUser;
     pCallback = func;
-    sData = strdup(input);
-}
-
-ConstUserNode::~ConstUserNode() {
-    free((void *) sData);
+    sData = arena.StrDup(input);
+    this->pSlots = pSlots;
+    this->slot = slot;
 }
 
 double ConstUserNode::Evaluate() {
+    const double *pValue = pSlots->bindings[slot];
+    if (pValue != nullptr) {
+        return *pValue;
+    }
+    if (pCallback == nullptr) {
+        return 0.0;
+    }
     int bOk = 0;
     return pCallback(pUser, sData, &bOk);
 }
 
+// Variables are doubles, truncated towards zero
+int64_t ConstUserNode::EvaluateInt(kNumericMode mode) {
+    return intops::FromDouble(Evaluate(), mode);
+}
+
 //
 // Function node, implements user function callbacks.
 // A function accepts only one argument, which is a tree
 //
-FuncNode::FuncNode(PFNEVALUATEFUNC func, void *pUser, const char *name, BaseNode *pArg) {
-    this->pUser = pUser;
-    pCallback = func;
-    args = 0;
-    sFuncName = strdup(name);
-    pArgument[args++] = pArg;
+FuncNode::FuncNode(Arena &arena, PFNEVALUATEFUNC func, void *pUser, std::string_view name, BaseNode *pArg) :
+        FuncNode(arena, func, pUser, name, 1, &pArg) {
 }
 
-FuncNode::FuncNode(PFNEVALUATEFUNC func, void *pUser, const char *name, int args, BaseNode **pArg) {
+FuncNode::FuncNode(Arena &arena, PFNEVALUATEFUNC func, void *pUser, std::string_view name, int args, BaseNode **pArg) {
     this->pUser = pUser;
     pCallback = func;
-    sFuncName = strdup(name);
-    this->args = 0;
+    sFuncName = arena.StrDup(name);
+    arguments = arena.AllocArray<BaseNode *>(args);
+    numArguments = args;
     for (int i = 0; i < args; i++) {
-        pArgument[this->args++] = pArg[i];
+        arguments[i] = pArg[i];
     }
 }
 
-
-FuncNode::~FuncNode() {
-    free((void *) sFuncName);
-    for (int i = 0; i < args; i++)
-        delete (pArgument[i]);
-    args = 0;
-}
+// Argument values are kept on the stack up to this count
+static const int kLocalArguments = 8;
 
 double FuncNode::Evaluate() {
     int ok = 0;
+    int args = numArguments;
 
     //printf("Calling '%s' with %d arguments\n", sFuncName, args);
-    double values[EXP_SOLVER_MAX_ARGS];
+    double localValues[kLocalArguments];
+    std::vector<double> heapValues;
+    double *values = localValues;
+    if (args > kLocalArguments) {
+        heapValues.resize(args);
+        values = heapValues.data();
+    }
     for (int i = 0; i < args; i++) {
-        values[i] = pArgument[i]->Evaluate();
+        values[i] = arguments[i]->Evaluate();
     }
     return pCallback(pUser, sFuncName, args, values, &ok);
 }
 
+// Callbacks take and return doubles, arguments above 2^53 lose precision
+int64_t FuncNode::EvaluateInt(kNumericMode mode) {
+    int ok = 0;
+    int args = numArguments;
+
+    double localValues[kLocalArguments];
+    std::vector<double> heapValues;
+    double *values = localValues;
+    if (args > kLocalArguments) {
+        heapValues.resize(args);
+        values = heapValues.data();
+    }
+    for (int i = 0; i < args; i++) {
+        values[i] = intops::ToDouble(arguments[i]->EvaluateInt(mode), mode);
+    }
+    return intops::FromDouble(pCallback(pUser, sFuncName, args, values, &ok), mode);
+}
+
 //
-// Binary operation (left/right) node
+// Native function node, the arity specialized paths call the function without an argument array
 //
-BinOpNode::BinOpNode(const char *op, BaseNode *pLeft, BaseNode *pRight) {
-    this->op = strdup(op);
-    this->pLeft = pLeft;
-    this->pRight = pRight;
+NativeFuncNode::NativeFuncNode(Arena &arena, const NativeFunction &function, std::string_view name, int args, BaseNode **pArg) {
+    this->function = function;
+    sFuncName = arena.StrDup(name);
+    arguments = arena.AllocArray<BaseNode *>(args);
+    numArguments = args;
+    for (int i = 0; i < args; i++) {
+        arguments[i] = pArg[i];
+    }
 }
 
-BinOpNode::~BinOpNode() {
-    free((void *) op);
-    delete pLeft;
-    delete pRight;
+double NativeFuncNode::Evaluate() {
+    switch (function.arity) {
+        case 0 :
+            return function.f0(function.pUser);
+        case 1 :
+            return function.f1(function.pUser, arguments[0]->Evaluate());
+        case 2 : {
+            double a = arguments[0]->Evaluate();
+            double b = arguments[1]->Evaluate();
+            return function.f2(function.pUser, a, b);
+        }
+        case 3 : {
+            double a = arguments[0]->Evaluate();
+            double b = arguments[1]->Evaluate();
+            double c = arguments[2]->Evaluate();
+            return function.f3(function.pUser, a, b, c);
+        }
+        case 4 : {
+            double a = arguments[0]->Evaluate();
+            double b = arguments[1]->Evaluate();
+            double c = arguments[2]->Evaluate();
+            double d = arguments[3]->Evaluate();
+            return function.f4(function.pUser, a, b, c, d);
+        }
+        default:
+            break;
+    }
+
+    // variadic
+    int args = numArguments;
+    double localValues[kLocalArguments];
+    std::vector<double> heapValues;
+    double *values = localValues;
+    if (args > kLocalArguments) {
+        heapValues.resize(args);
+        values = heapValues.data();
+    }
+    for (int i = 0; i < args; i++) {
+        values[i] = arguments[i]->Evaluate();
+    }
+    return function.fn(function.pUser, args, values);
 }
 
-double BinOpNode::Evaluate() {
-    // 'Case' returns zero-based index from input or -1 if not found
-    switch (Tokenizer::Case(op, "<< >> + - * /")) {
-        case 0 : // <<
-            return (int) pLeft->Evaluate() << (int) pRight->Evaluate();
-        case 1 : // >>
-            return (int) pLeft->Evaluate() >> (int) pRight->Evaluate();
-        case 2 : // +
-            return pLeft->Evaluate() + pRight->Evaluate();
-        case 3 : // -
-            return pLeft->Evaluate() - pRight->Evaluate();
-        case 4 : // *
-            return pLeft->Evaluate() * pRight->Evaluate();
-        case 5 : // /
-            return pLeft->Evaluate() / pRight->Evaluate();
+// Same as the callbacks, converted to and from double
+int64_t NativeFuncNode::EvaluateInt(kNumericMode mode) {
+    int args = numArguments;
+    double localValues[kLocalArguments];
+    std::vector<double> heapValues;
+    double *values = localValues;
+    if (args > kLocalArguments) {
+        heapValues.resize(args);
+        values = heapValues.data();
+    }
+    for (int i = 0; i < args; i++) {
+        values[i] = intops::ToDouble(arguments[i]->EvaluateInt(mode), mode);
     }
+    double result = 0.0;
+    switch (function.arity) {
+        case 0 :
+            result = function.f0(function.pUser);
+            break;
+        case 1 :
+            result = function.f1(function.pUser, values[0]);
+            break;
+        case 2 :
+            result = function.f2(function.pUser, values[0], values[1]);
+            break;
+        case 3 :
+            result = function.f3(function.pUser, values[0], values[1], values[2]);
+            break;
+        case 4 :
+            result = function.f4(function.pUser, values[0], values[1], values[2], values[3]);
+            break;
+        default:
+            result = function.fn(function.pUser, args, values);
+            break;
+    }
+    return intops::FromDouble(result, mode);
+}
+
+//
+// Operator table, indexed by opcode
+// A new binary operator needs an opcode, a row here and its token in kOperators - the parser is driven by this table
+//
+static const struct {
+    const char *token;
+    PFNBINOP pFunc;
+    PFNINTOP pIntFunc;
+    PFNINTOP pUIntFunc;
+    int precedence;
+    bool isBool;
+} binOperators[kOpCode_NumOpCodes] = {
+    { "<<", ops::ShiftLeft, intops::ShiftLeft, intops::ShiftLeft, 2, false },             // kOpCode_ShiftLeft
+    { ">>", ops::ShiftRight, intops::ShiftRight, intops::ShiftRightUnsigned, 2, false },  // kOpCode_ShiftRight
+    { "+", ops::Add, intops::Add, intops::Add, 3, false },                                // kOpCode_Add
+    { "-", ops::Sub, intops::Sub, intops::Sub, 3, false },                                // kOpCode_Sub
+    { "*", ops::Mul, intops::Mul, intops::Mul, 4, false },                                // kOpCode_Mul
+    { "/", ops::Div, intops::Div, intops::DivUnsigned, 4, false },                        // kOpCode_Div
+    { ">", ops::Greater, intops::Greater, intops::GreaterUnsigned, 1, true },             // kOpCode_Greater
+    { "<", ops::Less, intops::Less, intops::LessUnsigned, 1, true },                      // kOpCode_Less
+};
+
+//
+// Returns the opcode for an operator token or kOpCode_Invalid
+//
+kOpCode BinOpNode::ClassifyOperator(std::string_view token) {
+    for (int i = 0; i < kOpCode_NumOpCodes; i++) {
+        if (token == binOperators[i].token) {
+            return (kOpCode) i;
+        }
+    }
+    return kOpCode_Invalid;
+}
+
+PFNBINOP BinOpNode::OperatorFunc(kOpCode op) {
+    return binOperators[op].pFunc;
+}
 
-    printf("[!] Illegal operator: %s\n", op);
-    return 0.0;
+PFNINTOP BinOpNode::IntOperatorFunc(kOpCode op, kNumericMode mode) {
+    return (mode == kNumericMode_UInt64) ? binOperators[op].pUIntFunc : binOperators[op].pIntFunc;
+}
+
+int BinOpNode::Precedence(kOpCode op) {
+    return binOperators[op].precedence;
+}
+
+bool BinOpNode::IsBoolOperator(kOpCode op) {
+    return binOperators[op].isBool;
 }
 
 //
-// Boolean operation
+// Binary operation (left/right) node
 //
-BoolOpNode::BoolOpNode(const char *op, BaseNode *pLeft, BaseNode *pRight) :
-        BinOpNode(op, pLeft, pRight) {
+BinOpNode::BinOpNode(kOpCode op, BaseNode *pLeft, BaseNode *pRight) {
+    this->op = op;
+    this->pOperator = OperatorFunc(op);
+    this->pLeft = pLeft;
+    this->pRight = pRight;
 }
 
-BoolOpNode::~BoolOpNode() {
+double BinOpNode::Evaluate() {
+    // Left before right, callbacks are evaluated in expression order
+    double left = pLeft->Evaluate();
+    double right = pRight->Evaluate();
+    return pOperator(left, right);
 }
 
-double BoolOpNode::Evaluate() {
-    //printf("BoolOpNode: %c\n",op[0]);
+int64_t BinOpNode::EvaluateInt(kNumericMode mode) {
+    int64_t left = pLeft->EvaluateInt(mode);
+    int64_t right = pRight->EvaluateInt(mode);
+    return IntOperatorFunc(op, mode)(left, right);
+}
 
-    // FIXME: replace with Tokenizer::Case and replace '=' with '=='
-    switch (op[0]) {
-        case '>' :
-            return pLeft->Evaluate() > (int) pRight->Evaluate();
-        case '<' :
-            return pLeft->Evaluate() < (int) pRight->Evaluate();
-            // not sure about this...
-        case '=' :
-            return (int) pLeft->Evaluate() == (int) pRight->Evaluate();
-        case '!' :
-            return (int) pLeft->Evaluate() != (int) pRight->Evaluate();
-    }
-    printf("[!] Illegal operator: %s\n", op);
-    return 0.0;
+//
+// Boolean operation
+//
+BoolOpNode::BoolOpNode(kOpCode op, BaseNode *pLeft, BaseNode *pRight) :
+        BinOpNode(op, pLeft, pRight) {
 }
 
 IfOperatorNode::IfOperatorNode(BaseNode *exp, BaseNode *pTrue, BaseNode *pFalse) {
@@ -533,26 +1563,74 @@ IfOperatorNode::IfOperatorNode(BaseNode *exp, BaseNode *pTrue, BaseNode *pFalse)
     this->pFalse = pFalse;
 }
 
-IfOperatorNode::~IfOperatorNode() {
-    delete exp;
-    delete pTrue;
-    delete pFalse;
-}
-
 double IfOperatorNode::Evaluate() {
 //	printf("IfOperatorNode, evaluate\n");
     double res = exp->Evaluate();
-    if (res > 0) {
+    if (ops::IsTrue(res)) {
         return pTrue->Evaluate();
     }
     return pFalse->Evaluate();
 }
 
+int64_t IfOperatorNode::EvaluateInt(kNumericMode mode) {
+    if (intops::IsTrue(exp->EvaluateInt(mode), mode)) {
+        return pTrue->EvaluateInt(mode);
+    }
+    return pFalse->EvaluateInt(mode);
+}
+
+
+//
+// Shared sub-expressions, evaluated by the first reference in each evaluation
+//
+SharedNode::SharedNode(SharedExpression *expression, const uint64_t *pGeneration) {
+    this->expression = expression;
+    this->pGeneration = pGeneration;
+}
+
+double SharedNode::Evaluate() {
+    if (expression->generation != *pGeneration) {
+        expression->value = expression->node->Evaluate();
+        expression->generation = *pGeneration;
+    }
+    return expression->value;
+}
+
+int64_t SharedNode::EvaluateInt(kNumericMode mode) {
+    if (expression->generation != *pGeneration) {
+        expression->integer = expression->node->EvaluateInt(mode);
+        expression->generation = *pGeneration;
+    }
+    return expression->integer;
+}
+
+//
+// Saturating conversion, unsigned mode keeps values up to 2^64 and negative values wrap like the signed ones
+//
+int64_t intops::FromDouble(double value, kNumericMode mode) {
+    if (isnan(value)) {
+        return 0;
+    }
+    if ((mode == kNumericMode_UInt64) && (value >= 9223372036854775808.0)) {
+        if (value >= 18446744073709551616.0) {
+            return (int64_t) UINT64_MAX;
+        }
+        return (int64_t) (uint64_t) value;
+    }
+    if (value >= 9223372036854775808.0) {
+        return INT64_MAX;
+    }
+    if (value < -9223372036854775808.0) {
+        return INT64_MIN;
+    }
+    return (int64_t) value;
+}
+
 
-static unsigned long long hex2dec_c(const char *s) {
+static unsigned long long hex2dec_c(std::string_view s) {
     unsigned long long n = 0;
-    int length = strlen(s);
-    for (int i = 0; i < length && s[i] != '\0'; i++) {
+    size_t length = s.length();
+    for (size_t i = 0; i < length && s[i] != '\0'; i++) {
         int v = 0;
         if ('a' <= s[i] && s[i] <= 'f') { v = s[i] - 97 + 10; }
         else if ('A' <= s[i] && s[i] <= 'F') { v = s[i] - 65 + 10; }
@@ -564,15 +1642,58 @@ static unsigned long long hex2dec_c(const char *s) {
     return n;
 }
 
-static unsigned long bin2dec(const char *binary) {
-    int len, i, exp;
-    unsigned long dec = 0;
+static unsigned long long bin2dec(std::string_view binary) {
+    unsigned long long dec = 0;
+    for (size_t i = 0; i < binary.length(); i++) {
+        dec = (dec << 1) | (binary[i] == '1' ? 1 : 0);
+    }
+    return dec;
+}
 
-    len = strlen(binary);
-    exp = len - 1;
+//
+// atof on a span, the span is not zero terminated so copy it to a local buffer first
+//
+static double dec2double(std::string_view s) {
+    char tmp[64];
+    if (s.length() < sizeof(tmp)) {
+        memcpy(tmp, s.data(), s.length());
+        tmp[s.length()] = '\0';
+        return atof(tmp);
+    }
+    // Unusually long number, fall back to a heap copy
+    std::string str(s);
+    return atof(str.c_str());
+}
 
-    for (i = 0; i < len; i++, exp--)
-        dec += binary[i] == '1' ? pow(2, exp) : 0;
-    return dec;
+//
+// Exact value of an integer literal, '0x' is hex like atof - anything else is truncated from the double
+//
+static int64_t dec2int(std::string_view s) {
+    if ((s.length() > 2) && (s[0] == '0') && ((s[1] == 'x') || (s[1] == 'X'))) {
+        return (int64_t) hex2dec_c(s.substr(2));
+    }
+    uint64_t value = 0;
+    if (dec2uint(s, value)) {
+        return (int64_t) value;
+    }
+    // Fractions, exponents and values above 64 bits
+    return intops::FromDouble(dec2double(s), kNumericMode_Int64);
 }
 
+//
+// Only digits and at most 64 bits
+//
+static bool dec2uint(std::string_view s, uint64_t &out) {
+    if (s.empty()) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < s.length(); i++) {
+        if (!isdigit((unsigned char) s[i]) || (value > (UINT64_MAX - (uint64_t) (s[i] - '0')) / 10)) {
+            return false;
+        }
+        value = value * 10 + (uint64_t) (s[i] - '0');
+    }
+    out = value;
+    return true;
+}
@@ -1,6 +1,13 @@
 #pragma once
 
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 #include "tokenizer.h"
+#include "arena.h"
+#include "functions.h"
 
 namespace gnilk
 {
@@ -11,102 +18,442 @@ namespace gnilk
 	#define CALLCONV
 	#endif
 
-	#define EXP_SOLVER_MAX_ARGS 32
-
 
 	extern "C"
 	{
 		typedef double (CALLCONV *PFNEVALUATE)(void *pUser, const char *data, int *bOk_out);
 		typedef double (CALLCONV *PFNEVALUATEFUNC)(void *pUser, const char *data, int args, double *arg, int *bOk_out);
+		// Column version for batches, 'nRows' values per argument column - '*bOk_out = 0' falls back to PFNEVALUATEFUNC per row
+		typedef void (CALLCONV *PFNEVALUATEFUNCBATCH)(void *pUser, const char *data, int args, const double * const *arg, size_t nRows, double *out, int *bOk_out);
+	}
+
+	// Operators are resolved to an opcode when the tree is built
+	typedef enum {
+		kOpCode_Invalid = -1,
+		kOpCode_ShiftLeft,
+		kOpCode_ShiftRight,
+		kOpCode_Add,
+		kOpCode_Sub,
+		kOpCode_Mul,
+		kOpCode_Div,
+		kOpCode_Greater,
+		kOpCode_Less,
+		kOpCode_NumOpCodes,
+	} kOpCode;
+
+	typedef double (*PFNBINOP)(double left, double right);
+
+	// Operator kernels, shared by all evaluators so they produce identical results
+	// the (int) casts are part of the expression semantics
+	namespace ops {
+		inline double ShiftLeft(double left, double right) { return (int) ((unsigned int) (int) left << (int) right); }
+		inline double ShiftRight(double left, double right) { return (int) left >> (int) right; }
+		inline double Add(double left, double right) { return left + right; }
+		inline double Sub(double left, double right) { return left - right; }
+		inline double Mul(double left, double right) { return left * right; }
+		inline double Div(double left, double right) { return left / right; }
+		inline double Greater(double left, double right) { return left > (int) right; }
+		inline double Less(double left, double right) { return left < (int) right; }
+		// The '?' operator takes the true branch for values above zero
+		inline bool IsTrue(double value) { return value > 0; }
 	}
 
-	class BaseNode {
+	// Value type used when evaluating, selected when the expression is prepared
+	typedef enum {
+		kNumericMode_Double,
+		kNumericMode_Int64,
+		kNumericMode_UInt64,        // same 64 bits as Int64, unsigned division, right shift and compares
+	} kNumericMode;
+
+	typedef int64_t (*PFNINTOP)(int64_t left, int64_t right);
+
+	// Integer kernels, arithmetic wraps around and shift counts are masked to 0..63 - nothing is undefined
+	namespace intops {
+		inline int64_t ShiftLeft(int64_t left, int64_t right) { return (int64_t) ((uint64_t) left << (right & 63)); }
+		inline int64_t ShiftRight(int64_t left, int64_t right) { return (left < 0) ? ~(~left >> (right & 63)) : (left >> (right & 63)); }
+		inline int64_t ShiftRightUnsigned(int64_t left, int64_t right) { return (int64_t) ((uint64_t) left >> (right & 63)); }
+		inline int64_t Add(int64_t left, int64_t right) { return (int64_t) ((uint64_t) left + (uint64_t) right); }
+		inline int64_t Sub(int64_t left, int64_t right) { return (int64_t) ((uint64_t) left - (uint64_t) right); }
+		inline int64_t Mul(int64_t left, int64_t right) { return (int64_t) ((uint64_t) left * (uint64_t) right); }
+		// Division by zero gives zero
+		inline int64_t Div(int64_t left, int64_t right) { return (right == 0) ? 0 : (right == -1) ? Sub(0, left) : (left / right); }
+		inline int64_t DivUnsigned(int64_t left, int64_t right) { return (right == 0) ? 0 : (int64_t) ((uint64_t) left / (uint64_t) right); }
+		inline int64_t Greater(int64_t left, int64_t right) { return left > right; }
+		inline int64_t GreaterUnsigned(int64_t left, int64_t right) { return (uint64_t) left > (uint64_t) right; }
+		inline int64_t Less(int64_t left, int64_t right) { return left < right; }
+		inline int64_t LessUnsigned(int64_t left, int64_t right) { return (uint64_t) left < (uint64_t) right; }
+		inline bool IsTrue(int64_t value, kNumericMode mode) { return (mode == kNumericMode_UInt64) ? (value != 0) : (value > 0); }
+		// Variables and function results, truncated and saturated - NaN is zero
+		int64_t FromDouble(double value, kNumericMode mode);
+		inline double ToDouble(int64_t value, kNumericMode mode) { return (mode == kNumericMode_UInt64) ? (double) (uint64_t) value : (double) value; }
+	}
+
+	typedef enum {
+		kNodeType_Const,
+		kNodeType_ConstUser,
+		kNodeType_Func,
+		kNodeType_NativeFunc,
+		kNodeType_BinOp,
+		kNodeType_BoolOp,
+		kNodeType_If,
+		kNodeType_Shared,
+		kNodeType_NumTypes,
+	} kNodeType;
+
+	// Nodes are allocated from the solver arena with 'new (arena) Node(...)' and freed with the arena
+	class BaseNode : public ArenaObject {
 	public:
 		virtual ~BaseNode() = default;
 		virtual double Evaluate() = 0;
+		// Integer modes, see kNumericMode
+		virtual int64_t EvaluateInt(kNumericMode mode) = 0;
+		virtual kNodeType Type() const = 0;
+		// Generic access to child nodes, used by the optimizer and other passes
+		virtual int NumChildren() const { return 0; }
+		virtual BaseNode *Child(int /*idx*/) const { return nullptr; }
+		virtual void SetChild(int /*idx*/, BaseNode * /*node*/) { }
 	};
 
 	class ConstNode : public BaseNode {
 	public:
-		ConstNode(const char *input, bool negative);
+		ConstNode(std::string_view input, bool negative);
+		explicit ConstNode(double value);
 		virtual ~ConstNode() = default;
 		double Evaluate();
+		int64_t EvaluateInt(kNumericMode mode);
+		kNodeType Type() const { return kNodeType_Const; }
+		double Value() const { return numeric; }
+		int64_t IntValue() const { return integer; }
     protected:
         double numeric;
+        int64_t integer;        // exact value of integer literals, hex and binary use all 64 bits
+	};
+
+	// Variable slots, one per distinct variable name - assigned when the expression is prepared
+	struct VariableSlots {
+		std::vector<std::string> names;
+		std::vector<const double *> bindings;   // nullptr = use the variable callback
+
+		size_t Add(std::string_view name);
+		int Find(std::string_view name) const;
+		void Clear() { names.clear(); bindings.clear(); }
 	};
 
 	class ConstUserNode :public BaseNode {
 	public:
-		ConstUserNode(PFNEVALUATE func, void *pUser, const char *input);
-		virtual ~ConstUserNode();
+		ConstUserNode(Arena &arena, PFNEVALUATE func, void *pUser, std::string_view input, const VariableSlots *pSlots, size_t slot);
+		virtual ~ConstUserNode() = default;
 		double Evaluate();
+		int64_t EvaluateInt(kNumericMode mode);
+		kNodeType Type() const { return kNodeType_ConstUser; }
+		const char *Name() const { return sData; }
+		size_t Slot() const { return slot; }
     protected:
         void *pUser;
         const char *sData;
         PFNEVALUATE pCallback;
+        const VariableSlots *pSlots;
+        size_t slot;
 	};
 
+	// Function call through the user function callback
 	class FuncNode : public BaseNode {
 	public:
-		FuncNode(PFNEVALUATEFUNC func, void *pUser, const char *name, BaseNode *pArg);
-		FuncNode(PFNEVALUATEFUNC func, void *pUser, const char *name, int args, BaseNode **pArg);
-		virtual ~FuncNode();
+		FuncNode(Arena &arena, PFNEVALUATEFUNC func, void *pUser, std::string_view name, BaseNode *pArg);
+		FuncNode(Arena &arena, PFNEVALUATEFUNC func, void *pUser, std::string_view name, int args, BaseNode **pArg);
+		virtual ~FuncNode() = default;
 		double Evaluate();
+		int64_t EvaluateInt(kNumericMode mode);
+		kNodeType Type() const { return kNodeType_Func; }
+		const char *Name() const { return sFuncName; }
+		int NumArguments() const { return numArguments; }
+		BaseNode *Argument(int idx) const { return arguments[idx]; }
+		int NumChildren() const { return numArguments; }
+		BaseNode *Child(int idx) const { return arguments[idx]; }
+		void SetChild(int idx, BaseNode *node) { arguments[idx] = node; }
+		// Pure calls may be shared with identical calls, see ExpSolver::SetUserFunctionPure
+		bool IsPure() const { return pure; }
+		void SetPure(bool pure) { this->pure = pure; }
     protected:
         void *pUser;
         const char *sFuncName;
         PFNEVALUATEFUNC pCallback;
-        int args;
-        BaseNode *pArgument[EXP_SOLVER_MAX_ARGS];
+        BaseNode **arguments;
+        int numArguments;
+        bool pure = false;
+	};
+
+	// Function call to a native function, resolved when the tree was built
+	class NativeFuncNode : public BaseNode {
+	public:
+		NativeFuncNode(Arena &arena, const NativeFunction &function, std::string_view name, int args, BaseNode **pArg);
+		virtual ~NativeFuncNode() = default;
+		double Evaluate();
+		int64_t EvaluateInt(kNumericMode mode);
+		kNodeType Type() const { return kNodeType_NativeFunc; }
+		const char *Name() const { return sFuncName; }
+		const NativeFunction &Function() const { return function; }
+		int NumArguments() const { return numArguments; }
+		BaseNode *Argument(int idx) const { return arguments[idx]; }
+		int NumChildren() const { return numArguments; }
+		BaseNode *Child(int idx) const { return arguments[idx]; }
+		void SetChild(int idx, BaseNode *node) { arguments[idx] = node; }
+    protected:
+        NativeFunction function;
+        const char *sFuncName;
+        BaseNode **arguments;
+        int numArguments;
 	};
 
 	class BinOpNode : public BaseNode {
 	public:
-		BinOpNode(const char *op, BaseNode *pLeft, BaseNode *pRight);
-		virtual ~BinOpNode();
+		BinOpNode(kOpCode op, BaseNode *pLeft, BaseNode *pRight);
+		virtual ~BinOpNode() = default;
 		double Evaluate();
+		int64_t EvaluateInt(kNumericMode mode);
+		kNodeType Type() const { return kNodeType_BinOp; }
+		kOpCode Op() const { return op; }
+		BaseNode *Left() const { return pLeft; }
+		BaseNode *Right() const { return pRight; }
+		int NumChildren() const { return 2; }
+		BaseNode *Child(int idx) const { return (idx == 0) ? pLeft : pRight; }
+		void SetChild(int idx, BaseNode *node) { if (idx == 0) pLeft = node; else pRight = node; }
+
+		static kOpCode ClassifyOperator(std::string_view token);
+		static PFNBINOP OperatorFunc(kOpCode op);
+		static PFNINTOP IntOperatorFunc(kOpCode op, kNumericMode mode);
+		// Binding strength when parsing, higher binds tighter - all binary operators are left associative
+		static int Precedence(kOpCode op);
+		static bool IsBoolOperator(kOpCode op);
     protected:
-        const char *op;
+        kOpCode op;
+        PFNBINOP pOperator;
         BaseNode *pLeft;
         BaseNode *pRight;
 	};
 
 	class BoolOpNode : public BinOpNode {
 	public:
-		BoolOpNode(const char *op, BaseNode *pLeft, BaseNode *pRight);
-		virtual ~BoolOpNode();
-		double Evaluate();
+		BoolOpNode(kOpCode op, BaseNode *pLeft, BaseNode *pRight);
+		virtual ~BoolOpNode() = default;
+		kNodeType Type() const { return kNodeType_BoolOp; }
 	};
 
 	class IfOperatorNode : public BaseNode {
 	public:
 		IfOperatorNode(BaseNode *exp, BaseNode *pTrue, BaseNode *pFalse);
-		virtual ~IfOperatorNode();
+		virtual ~IfOperatorNode() = default;
 		double Evaluate();
+		int64_t EvaluateInt(kNumericMode mode);
+		kNodeType Type() const { return kNodeType_If; }
+		BaseNode *Condition() const { return exp; }
+		BaseNode *TrueBranch() const { return pTrue; }
+		BaseNode *FalseBranch() const { return pFalse; }
+		int NumChildren() const { return 3; }
+		BaseNode *Child(int idx) const { return (idx == 0) ? exp : (idx == 1) ? pTrue : pFalse; }
+		void SetChild(int idx, BaseNode *node) { if (idx == 0) exp = node; else if (idx == 1) pTrue = node; else pFalse = node; }
     protected:
         BaseNode *exp;
         BaseNode *pTrue;
         BaseNode *pFalse;
 	};
 
+	// Sub-expression referenced from several places in the tree, allocated from the solver arena
+	struct SharedExpression : public ArenaObject {
+		BaseNode *node = nullptr;
+		double value = 0.0;
+		int64_t integer = 0;            // value in the integer modes
+		uint64_t generation = 0;        // evaluation 'value' belongs to
+		size_t height = 0;              // tree height, set by ExpSolver::TreeHeight
+	};
+
+	// Reference to a shared sub-expression, the expression is evaluated once per evaluation
+	class SharedNode : public BaseNode {
+	public:
+		SharedNode(SharedExpression *expression, const uint64_t *pGeneration);
+		virtual ~SharedNode() = default;
+		double Evaluate();
+		int64_t EvaluateInt(kNumericMode mode);
+		kNodeType Type() const { return kNodeType_Shared; }
+		SharedExpression *Expression() const { return expression; }
+    protected:
+        SharedExpression *expression;
+        const uint64_t *pGeneration;
+	};
+
+	// Named column of variable values, used for batch evaluation
+	struct BatchColumn {
+		const char *name;
+		const double *data;
+	};
+
+	class Program;
+	class JitProgram;
+	class NodePool;
+	class IncrementalPool;
+	class CompiledExpression;
+	struct EvalContext;
+
+	// Deepest tree Prepare accepts, evaluation and the compilers recurse once per tree level
+	#define EXP_SOLVER_MAX_DEPTH 4096
+
+	// Errors reported by Prepare and the evaluations, see ExpSolver::ErrorString
+	typedef enum {
+		kExpError_None,
+		kExpError_EmptyExpression,
+		kExpError_UnexpectedToken,
+		kExpError_UnexpectedAssignment,
+		kExpError_InvalidAssignment,
+		kExpError_MissingAssignmentValue,
+		kExpError_MissingOperand,
+		kExpError_MissingParenthesis,
+		kExpError_MissingArgument,
+		kExpError_UnterminatedCall,
+		kExpError_ArgumentCount,
+		kExpError_NoFunctionCallback,
+		kExpError_MissingColon,
+		kExpError_IfMismatch,
+		kExpError_UnusedStatement,                      // a statement before the last one is not an assignment
+		kExpError_TooDeep,                              // the tree is deeper than EXP_SOLVER_MAX_DEPTH
+		kExpError_NoVariableCallback,
+		kExpError_NotPrepared,
+		kExpError_NotCompiled,                          // Solve, the prepared expression has no byte code form
+		kExpError_UnknownVariable,                      // evaluation, the variable callback failed or is missing
+		kExpError_UnknownFunction,                      // evaluation, the function callback failed
+		kExpError_NumErrors,
+	} kExpError;
+
+	// First error of a Prepare or an evaluation
+	struct ExpSolverError {
+		static const size_t kNoPosition = (size_t) -1;
+		kExpError code = kExpError_None;
+		size_t position = kNoPosition;                  // byte offset in the expression, parse errors only
+		std::string token;                              // offending token, variable or function name
+	};
+
+	// Runtime statistics, only collected when built with EXP_SOLVER_STATS - all zero otherwise
+	struct ExpSolverStats {
+		uint64_t prepareNs = 0;
+		size_t numNodes = 0;                            // shared sub-expressions are counted once
+		size_t nodesByType[kNodeType_NumTypes] = {};
+		size_t treeDepth = 0;                           // longest path from the result to a leaf
+		uint64_t numEvaluations = 0;                    // Evaluate and EvaluateInt calls
+		uint64_t totalEvaluationNs = 0;
+		uint64_t maxEvaluationNs = 0;
+		uint64_t numVariableCallbacks = 0;
+		uint64_t numFunctionCallbacks = 0;              // a column call for a batch counts once
+	};
+
 	class ExpSolver {
 	public:
-		explicit ExpSolver(const char *expression);
+		// Nodes are allocated from 'pArena' when given, otherwise from an arena owned by the solver
+		// a shared arena must outlive the solver, it is never reset by the solver
+		explicit ExpSolver(const char *expression, Arena *pArena = nullptr);
 		virtual ~ExpSolver();
 		void RegisterUserVariableCallback(PFNEVALUATE pFunc, void *pUser);
 		void RegisterUserFunctionCallback(PFNEVALUATEFUNC pFunc, void *pUser);
-		bool Prepare();
+		// Optional, used by EvaluateBatch for the functions it handles - the function callback is still required
+		void RegisterUserFunctionBatchCallback(PFNEVALUATEFUNCBATCH pFunc, void *pUser);
+		// Native functions are resolved when preparing, before the built-ins and the function callback
+		FunctionRegistry &Functions() { return functions; }
+		// Built-in math functions are off unless enabled, the function callback gets every name otherwise - call before Prepare
+		void EnableBuiltInFunctions(bool enable = true) { useBuiltIns = enable; }
+		// Pure callback functions have no side effects, identical calls may be evaluated once - call before Prepare
+		void SetUserFunctionPure(const char *name, bool pure = true);
+		// Integer modes evaluate exactly with 64 bit integers, the compiled forms, Optimize and batches are double only
+		bool Prepare(kNumericMode mode = kNumericMode_Double);
+		// Replaces the expression, Prepare must be called again - the arena and parser storage are reused
+		void SetExpression(std::string_view expression);
+		kNumericMode GetNumericMode() const { return numericMode; }
+		// Immutable compiled copy of the prepared (and optionally optimized) expression, holds no parse-time
+		// state or callbacks and can be evaluated from any number of threads - see CompiledExpression
+		std::shared_ptr<const CompiledExpression> GetCompiledExpression() const;
+		// Optional, flattens the prepared tree to byte code - Evaluate will run the byte code
+		bool Compile();
+		bool IsCompiled() const { return (program != nullptr); }
+		// Optional, compiles the prepared tree to native code - falls back to byte code when the
+		// platform or a construct in the expression is not supported, Evaluate runs whichever succeeded
+		bool CompileJit();
+		bool IsJitCompiled() const { return (jit != nullptr); }
+		// Optional, copies the prepared tree to a compact node array - Evaluate walks the array unless compiled
+		bool Flatten();
+		bool IsFlattened() const { return (pool != nullptr); }
+		// Appends the prepared expression as a node pool record, see ExpressionFile - double mode only
+		bool Serialize(std::vector<uint8_t> &out) const;
+		// Optional, every node keeps its last value - Evaluate only recomputes nodes depending on variables
+		// marked as changed since the previous evaluation, user functions are assumed to depend on their arguments only
+		bool EnableIncremental();
+		bool IsIncremental() const { return (incremental != nullptr); }
+		bool MarkVariableChanged(size_t slot);
+		bool MarkVariableChanged(const char *name);
+		void MarkAllVariablesChanged();
+		// Nodes recomputed by the last incremental evaluation
+		size_t GetNumRecomputed() const;
+		// Optional, folds constant sub-expressions, removes no-op operations and shares
+		// identical pure sub-expressions so they are evaluated once - results are unchanged
+		bool Optimize();
 		double Evaluate();
-        static bool Solve(double *out, const char *expression);
+		// Result in the integer modes, UInt64 results are the same 64 bits
+		int64_t EvaluateInt();
+		// Evaluates nRows rows into 'out', variables are read from the named columns
+		// variables without a column use the slot binding or the variable callback
+		bool EvaluateBatch(double *out, size_t nRows, const BatchColumn *columns, size_t nColumns);
+
+		// Variable slots are assigned by Prepare in order of first appearance
+		size_t GetNumVariables() const { return slots.names.size(); }
+		const char *GetVariableName(size_t slot) const;
+		int GetVariableSlot(const char *name) const;
+		// Bound variables are read directly, the variable callback is only used for unbound slots
+		// binding a slot marks it as changed in incremental mode
+		bool BindVariable(size_t slot, const double *value);
+		// Binds slot 'n' to values[n] for all slots, nullptr removes all bindings
+		void BindVariables(const double *values);
+        static bool Solve(double *out, const char *expression, ExpSolverError *pError = nullptr);
+        static bool SolveInt(int64_t *out, const char *expression, kNumericMode mode = kNumericMode_Int64, ExpSolverError *pError = nullptr);
+
+		// Nothing is printed, errors are kept here - Prepare and every evaluation start without an error
+		// variable and function callbacks fail by setting 'bOk_out' to zero, the evaluation goes on with their result
+		const ExpSolverError &GetError() const { return error; }
+		static const char *ErrorString(kExpError code);
+
+		// See ExpSolverStats, Prepare restarts the statistics
+		const ExpSolverStats &GetStats() const { return stats; }
+		void ResetStats() { stats = ExpSolverStats(); }
+		static bool HasStats();
     protected:
-        BaseNode *BuildUserCall();
-        BaseNode *BuildSubExpr();
-        BaseNode *BuildMulDiv();
-        BaseNode *BuildAddSub();
-        BaseNode *BuildShift();
-        BaseNode *BuildBool();
-        BaseNode *BuildIf();
+        // How the result of a parse frame is used
+        typedef enum {
+            kParseContext_Tree,             // returned by BuildTree
+            kParseContext_Parenthesis,
+            kParseContext_Argument,
+            kParseContext_IfTrue,
+            kParseContext_IfFalse,
+        } kParseContext;
+        // One expression being parsed - nested expressions push a frame instead of recursing
+        struct ParseFrame {
+            kParseContext context;
+            size_t operandBase;             // first entries of the frame on the operand and operator stacks
+            size_t operatorBase;
+            std::string_view function;      // call waiting for its arguments
+            size_t argumentBase;            // first parsed argument on the argument stack
+            BaseNode *condition;            // '?:' waiting for its branches
+            BaseNode *pTrue;
+        };
+        // One node of a tree walk, the walk keeps its own stack like the parser
+        struct TreeWalk {
+            const BaseNode *node;
+            int next;                       // next child to visit
+            size_t height;                  // highest child so far
+        };
+        BaseNode *BuildConstant();
+        BaseNode *BuildVariable(std::string_view name);
+        BaseNode *BuildCall(std::string_view name, BaseNode **args, size_t numArgs);
+        void PushFrame(kParseContext context);
+        bool ReduceOperators(int precedence);
         BaseNode *BuildTree();
+        BaseNode *BuildStatement();
+        BaseNode *FindLocal(std::string_view name) const;
+        void Clear();
     protected:
         typedef enum
         {
@@ -114,19 +461,63 @@ namespace gnilk
             kTokenClass_Numeric,
             kTokenClass_Variable,
         } kTokenClass;
-        kTokenClass ClassifyToken(const char *token);
+        kTokenClass ClassifyToken(std::string_view token);
+        bool IsUserFunctionPure(std::string_view name) const;
+        void InitContext(EvalContext &context) const;
+        // Callbacks as handed to the nodes and programs, trampolines checking the result and counting the calls
+        PFNEVALUATE VariableCallback() const;
+        void *VariableContext() const;
+        PFNEVALUATEFUNC FunctionCallback() const;
+        void *FunctionContext() const;
+        static double CALLCONV CheckedVariableCallback(void *pUser, const char *name, int *bOk_out);
+        static double CALLCONV CheckedFunctionCallback(void *pUser, const char *name, int args, double *arg, int *bOk_out);
+        // Only the first error is kept, later ones are usually caused by it
+        void SetError(kExpError code, std::string_view token);
+        void SetEvaluationError(kExpError code, const char *name);
+        size_t TreeHeight(const BaseNode *root, bool count);
+        void UpdateNodeStats();
+#ifdef EXP_SOLVER_STATS
+        void RecordEvaluation(uint64_t startNs);
+        static void CALLCONV CountedFunctionBatchCallback(void *pUser, const char *name, int args, const double * const *arg, size_t nRows, double *out, int *bOk_out);
+#endif
 
         PFNEVALUATE pVariableCallback;
         PFNEVALUATEFUNC pFuncCallback;
+        PFNEVALUATEFUNCBATCH pFuncBatchCallback;
 
         void *pVariableContext;
         void *pFunctionContext;
+        void *pFunctionBatchContext;
 
-        Tokenizer *tokenizer;
+        std::string expression;
+        Arena arena;
+        Arena *pArena;
+        Tokenizer parser;           // token storage, reused by every Prepare
+        Tokenizer *tokenizer;       // only valid during Prepare
         BaseNode *tree;
+        Program *program;
+        JitProgram *jit;
+        NodePool *pool;
+        IncrementalPool *incremental;
+        Program *batchProgram;
+        VariableSlots slots;
+        FunctionRegistry functions;
+        bool useBuiltIns;
+        std::vector<std::string> pureUserFunctions;
+        std::vector<SharedExpression *> shared;
+        uint64_t generation;
+        kNumericMode numericMode;
+        ExpSolverStats stats;
+        ExpSolverError error;
 
 
-        std::vector<BaseNode *> nodes;
+        std::vector<BaseNode *> nodes;                                      // one per statement, the last is the result
+        std::vector<std::pair<std::string_view, BaseNode *> > locals;       // assigned names, only valid during Prepare
+        std::vector<ParseFrame> frames;                                     // parser stacks, storage is kept between Prepare calls
+        std::vector<BaseNode *> operands;
+        std::vector<kOpCode> operators;
+        std::vector<BaseNode *> arguments;
+        std::vector<TreeWalk> walk;
 
 	};
 
@@ -0,0 +1,197 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: functions.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-18, 16:05
+Descr   : Native function registry and the built-in math library.
+          Functions are resolved by name when the expression is prepared,
+          evaluation calls the native function directly.
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 19.10.26, FKling, Column versions of functions for batch evaluation
+- 18.10.26, FKling, Registered functions can be marked pure
+- 18.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include <math.h>
+
+#include "functions.h"
+
+using namespace gnilk;
+
+void FunctionRegistry::Register(const char *name, PFNNATIVE0 func, void *pUser) {
+    NativeFunction native;
+    native.pure = false;
+    native.batch = nullptr;
+    native.arity = 0;
+    native.pUser = pUser;
+    native.f0 = func;
+    Add(name, native);
+}
+
+void FunctionRegistry::Register(const char *name, PFNNATIVE1 func, void *pUser) {
+    NativeFunction native;
+    native.pure = false;
+    native.batch = nullptr;
+    native.arity = 1;
+    native.pUser = pUser;
+    native.f1 = func;
+    Add(name, native);
+}
+
+void FunctionRegistry::Register(const char *name, PFNNATIVE2 func, void *pUser) {
+    NativeFunction native;
+    native.pure = false;
+    native.batch = nullptr;
+    native.arity = 2;
+    native.pUser = pUser;
+    native.f2 = func;
+    Add(name, native);
+}
+
+void FunctionRegistry::Register(const char *name, PFNNATIVE3 func, void *pUser) {
+    NativeFunction native;
+    native.pure = false;
+    native.batch = nullptr;
+    native.arity = 3;
+    native.pUser = pUser;
+    native.f3 = func;
+    Add(name, native);
+}
+
+void FunctionRegistry::Register(const char *name, PFNNATIVE4 func, void *pUser) {
+    NativeFunction native;
+    native.pure = false;
+    native.batch = nullptr;
+    native.arity = 4;
+    native.pUser = pUser;
+    native.f4 = func;
+    Add(name, native);
+}
+
+void FunctionRegistry::Register(const char *name, PFNNATIVEN func, void *pUser) {
+    NativeFunction native;
+    native.pure = false;
+    native.batch = nullptr;
+    native.arity = EXP_SOLVER_ARITY_VARIADIC;
+    native.pUser = pUser;
+    native.fn = func;
+    Add(name, native);
+}
+
+//
+// Registering an existing name replaces the previous function
+//
+void FunctionRegistry::Add(const char *name, const NativeFunction &func) {
+    for (auto &entry: functions) {
+        if (entry.first == name) {
+            entry.second = func;
+            return;
+        }
+    }
+    functions.push_back(std::make_pair(std::string(name), func));
+}
+
+const NativeFunction *FunctionRegistry::Find(std::string_view name) const {
+    for (auto &entry: functions) {
+        if (entry.first == name) {
+            return &entry.second;
+        }
+    }
+    return nullptr;
+}
+
+bool FunctionRegistry::SetPure(const char *name, bool pure) {
+    for (auto &entry: functions) {
+        if (entry.first == name) {
+            entry.second.pure = pure;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FunctionRegistry::SetBatch(const char *name, PFNNATIVEBATCH batch) {
+    for (auto &entry: functions) {
+        if (entry.first == name) {
+            entry.second.batch = batch;
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// Built-in math library
+//
+static double BuiltInSin(void *, double a) { return sin(a); }
+static double BuiltInCos(void *, double a) { return cos(a); }
+static double BuiltInSqrt(void *, double a) { return sqrt(a); }
+static double BuiltInAbs(void *, double a) { return fabs(a); }
+static double BuiltInFloor(void *, double a) { return floor(a); }
+static double BuiltInPow(void *, double a, double b) { return pow(a, b); }
+
+// Column versions, simple loops the compiler can vectorize
+static void BuiltInSqrtBatch(void *, int, const double * const *arg, size_t nRows, double *out) {
+    for (size_t i = 0; i < nRows; i++) out[i] = sqrt(arg[0][i]);
+}
+static void BuiltInAbsBatch(void *, int, const double * const *arg, size_t nRows, double *out) {
+    for (size_t i = 0; i < nRows; i++) out[i] = fabs(arg[0][i]);
+}
+static void BuiltInFloorBatch(void *, int, const double * const *arg, size_t nRows, double *out) {
+    for (size_t i = 0; i < nRows; i++) out[i] = floor(arg[0][i]);
+}
+
+static double BuiltInMin(void *, int args, const double *arg) {
+    if (args == 0) {
+        return 0.0;
+    }
+    double result = arg[0];
+    for (int i = 1; i < args; i++) {
+        if (arg[i] < result) result = arg[i];
+    }
+    return result;
+}
+
+static double BuiltInMax(void *, int args, const double *arg) {
+    if (args == 0) {
+        return 0.0;
+    }
+    double result = arg[0];
+    for (int i = 1; i < args; i++) {
+        if (arg[i] > result) result = arg[i];
+    }
+    return result;
+}
+
+//
+// Built-ins are pure, calls with constant arguments can be folded
+//
+void FunctionRegistry::MarkBuiltInsPure() {
+    for (auto &entry: functions) {
+        entry.second.pure = true;
+    }
+}
+
+const FunctionRegistry &FunctionRegistry::BuiltIns() {
+    static const FunctionRegistry builtIns = []() {
+        FunctionRegistry registry;
+        registry.Register("sin", BuiltInSin);
+        registry.Register("cos", BuiltInCos);
+        registry.Register("sqrt", BuiltInSqrt);
+        registry.Register("abs", BuiltInAbs);
+        registry.Register("floor", BuiltInFloor);
+        registry.Register("pow", BuiltInPow);
+        registry.Register("min", BuiltInMin);
+        registry.Register("max", BuiltInMax);
+        registry.SetBatch("sqrt", BuiltInSqrtBatch);
+        registry.SetBatch("abs", BuiltInAbsBatch);
+        registry.SetBatch("floor", BuiltInFloorBatch);
+        registry.MarkBuiltInsPure();
+        return registry;
+    }();
+    return builtIns;
+}
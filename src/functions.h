@@ -0,0 +1,82 @@
+// See functions.cpp for more details
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gnilk
+{
+    // Native function signatures, arity specialized - no argument marshalling for up to 4 arguments
+    typedef double (*PFNNATIVE0)(void *pUser);
+    typedef double (*PFNNATIVE1)(void *pUser, double a);
+    typedef double (*PFNNATIVE2)(void *pUser, double a, double b);
+    typedef double (*PFNNATIVE3)(void *pUser, double a, double b, double c);
+    typedef double (*PFNNATIVE4)(void *pUser, double a, double b, double c, double d);
+    // Any number of arguments
+    typedef double (*PFNNATIVEN)(void *pUser, int args, const double *arg);
+    // Column version for batches, 'nRows' values per argument column, 'out' never aliases an argument column
+    typedef void (*PFNNATIVEBATCH)(void *pUser, int args, const double * const *arg, size_t nRows, double *out);
+
+    #define EXP_SOLVER_ARITY_VARIADIC -1
+
+    struct NativeFunction {
+        int arity;          // 0..4 or EXP_SOLVER_ARITY_VARIADIC
+        bool pure;          // same arguments gives same result and no side effects, calls may be folded
+        void *pUser;
+        union {
+            PFNNATIVE0 f0;
+            PFNNATIVE1 f1;
+            PFNNATIVE2 f2;
+            PFNNATIVE3 f3;
+            PFNNATIVE4 f4;
+            PFNNATIVEN fn;
+        };
+        PFNNATIVEBATCH batch;   // optional, used instead of per row calls when evaluating batches
+
+        bool AcceptsArguments(int args) const { return (arity == EXP_SOLVER_ARITY_VARIADIC) || (arity == args); }
+        // Arguments in an array, calls the arity specialized function directly
+        inline double Call(int args, const double *arg) const {
+            switch (arity) {
+                case 0 : return f0(pUser);
+                case 1 : return f1(pUser, arg[0]);
+                case 2 : return f2(pUser, arg[0], arg[1]);
+                case 3 : return f3(pUser, arg[0], arg[1], arg[2]);
+                case 4 : return f4(pUser, arg[0], arg[1], arg[2], arg[3]);
+                default: return fn(pUser, args, arg);
+            }
+        }
+    };
+
+    //
+    // Maps function names to native functions
+    //
+    class FunctionRegistry {
+    public:
+        FunctionRegistry() = default;
+        virtual ~FunctionRegistry() = default;
+
+        void Register(const char *name, PFNNATIVE0 func, void *pUser = nullptr);
+        void Register(const char *name, PFNNATIVE1 func, void *pUser = nullptr);
+        void Register(const char *name, PFNNATIVE2 func, void *pUser = nullptr);
+        void Register(const char *name, PFNNATIVE3 func, void *pUser = nullptr);
+        void Register(const char *name, PFNNATIVE4 func, void *pUser = nullptr);
+        void Register(const char *name, PFNNATIVEN func, void *pUser = nullptr);
+
+        const NativeFunction *Find(std::string_view name) const;
+        // Registered functions are not pure unless marked, returns false for unknown names
+        bool SetPure(const char *name, bool pure = true);
+        // Adds a column version to a registered function, must give the same results as the scalar one
+        bool SetBatch(const char *name, PFNNATIVEBATCH batch);
+        size_t Size() const { return functions.size(); }
+
+        // sin, cos, sqrt, min, max, abs, pow, floor
+        static const FunctionRegistry &BuiltIns();
+    protected:
+        void Add(const char *name, const NativeFunction &func);
+        void MarkBuiltInsPure();
+    protected:
+        std::vector<std::pair<std::string, NativeFunction> > functions;
+    };
+}
@@ -0,0 +1,203 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: incremental.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-19, 09:30
+Descr   : Incremental evaluation on top of the node pool. Every node
+          keeps its last value and a dirty flag, marking a variable as
+          changed flags its nodes and all parents up to the root. An
+          evaluation only recomputes flagged nodes that are reached,
+          '?:' still only evaluates the taken branch - a node in a
+          branch that was not taken stays dirty until it is needed.
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 19.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include <string.h>
+#include <algorithm>
+
+#include "expsolver.h"
+#include "bytecode.h"
+#include "incremental.h"
+
+using namespace gnilk;
+
+// Function arguments are kept on the stack up to this count
+static const size_t kLocalValues = 16;
+
+//
+// Build the pool and the parent links, all nodes start out dirty
+//
+bool IncrementalPool::Build(const BaseNode *root) {
+    values.clear();
+    dirty.clear();
+    parentStart.clear();
+    parents.clear();
+    slotNodes.clear();
+    numRecomputed = 0;
+    if (!NodePool::Build(root)) {
+        return false;
+    }
+
+    // (child, parent) for every link, a shared expression has one parent per reference
+    std::vector<std::pair<uint32_t, uint32_t> > links;
+    for (uint32_t i = 0; i < (uint32_t) nodes.size(); i++) {
+        const PoolNode &node = nodes[i];
+        switch (node.type) {
+            case kNodeType_ConstUser :
+                if (node.a >= slotNodes.size()) {
+                    slotNodes.resize(node.a + 1);
+                }
+                slotNodes[node.a].push_back(i);
+                break;
+            case kNodeType_BinOp :
+            case kNodeType_BoolOp :
+                links.push_back(std::make_pair(node.a, i));
+                links.push_back(std::make_pair(node.b, i));
+                break;
+            case kNodeType_If :
+                links.push_back(std::make_pair(node.a, i));
+                links.push_back(std::make_pair(node.b, i));
+                links.push_back(std::make_pair(node.c, i));
+                break;
+            case kNodeType_Shared :
+                links.push_back(std::make_pair(node.c, i));
+                break;
+            case kNodeType_Func :
+            case kNodeType_NativeFunc :
+                for (uint32_t arg = 0; arg < node.args; arg++) {
+                    links.push_back(std::make_pair(argIndices[node.a + arg], i));
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Grouped per child
+    parentStart.assign(nodes.size() + 1, 0);
+    for (auto &link: links) {
+        parentStart[link.first + 1]++;
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+        parentStart[i + 1] += parentStart[i];
+    }
+    parents.resize(links.size());
+    std::vector<uint32_t> fill(parentStart.begin(), parentStart.end() - 1);
+    for (auto &link: links) {
+        parents[fill[link.first]++] = link.second;
+    }
+
+    values.assign(nodes.size(), 0.0);
+    dirty.assign(nodes.size(), 1);
+    return true;
+}
+
+void IncrementalPool::MarkChanged(size_t slot) {
+    if (slot >= slotNodes.size()) {
+        return;
+    }
+    for (auto idx: slotNodes[slot]) {
+        MarkDirty(idx);
+    }
+}
+
+void IncrementalPool::MarkAllChanged() {
+    std::fill(dirty.begin(), dirty.end(), 1);
+}
+
+//
+// A dirty node already has dirty parents - or a parent that did not use its value, the propagation stops there
+//
+void IncrementalPool::MarkDirty(uint32_t idx) {
+    markStack.clear();
+    markStack.push_back(idx);
+    while (!markStack.empty()) {
+        uint32_t current = markStack.back();
+        markStack.pop_back();
+        if (dirty[current]) {
+            continue;
+        }
+        dirty[current] = 1;
+        for (uint32_t i = parentStart[current]; i < parentStart[current + 1]; i++) {
+            markStack.push_back(parents[i]);
+        }
+    }
+}
+
+double IncrementalPool::Evaluate(const EvalContext &context) {
+    numRecomputed = 0;
+    if (nodes.empty()) {
+        return 0.0;
+    }
+    return Eval(context, root);
+}
+
+//
+// Same order and results as NodePool::Eval, clean nodes return their last value
+//
+double IncrementalPool::Eval(const EvalContext &context, uint32_t idx) {
+    if (!dirty[idx]) {
+        return values[idx];
+    }
+    numRecomputed++;
+
+    const PoolNode &node = nodes[idx];
+    double result = 0.0;
+    switch (node.type) {
+        case kNodeType_Const :
+            result = constants[node.a];
+            break;
+        case kNodeType_ConstUser : {
+            if ((context.pSlots != nullptr) && (context.pSlots[node.a] != nullptr)) {
+                result = *context.pSlots[node.a];
+            } else if (context.pVariableCallback != nullptr) {
+                int bOk = 0;
+                result = context.pVariableCallback(context.pVariableContext, variables[node.a].c_str(), &bOk);
+            }
+            break;
+        }
+        case kNodeType_BinOp :
+        case kNodeType_BoolOp : {
+            double left = Eval(context, node.a);
+            double right = Eval(context, node.b);
+            result = BinOpNode::OperatorFunc((kOpCode) node.op)(left, right);
+            break;
+        }
+        case kNodeType_If :
+            result = ops::IsTrue(Eval(context, node.a)) ? Eval(context, node.b) : Eval(context, node.c);
+            break;
+        case kNodeType_Shared :
+            result = Eval(context, node.c);
+            break;
+        case kNodeType_Func :
+        case kNodeType_NativeFunc : {
+            double localValues[kLocalValues];
+            std::vector<double> heapValues;
+            double *args = localValues;
+            if (node.args > kLocalValues) {
+                heapValues.resize(node.args);
+                args = heapValues.data();
+            }
+            for (uint32_t i = 0; i < node.args; i++) {
+                args[i] = Eval(context, argIndices[node.a + i]);
+            }
+            if (node.type == kNodeType_NativeFunc) {
+                result = natives[node.b].Call(node.args, args);
+            } else if (context.pFuncCallback != nullptr) {
+                int bOk = 0;
+                result = context.pFuncCallback(context.pFunctionContext, functions[node.b].c_str(), node.args, args, &bOk);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    values[idx] = result;
+    dirty[idx] = 0;
+    return result;
+}
@@ -0,0 +1,42 @@
+// See incremental.cpp for more details
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "expsolver.h"
+#include "nodepool.h"
+
+namespace gnilk
+{
+    struct EvalContext;
+
+    //
+    // Node pool which keeps the last value of every node, only nodes depending on changed variables are recomputed
+    // Function calls are assumed to depend on their arguments only
+    //
+    class IncrementalPool : public NodePool {
+    public:
+        IncrementalPool() = default;
+        virtual ~IncrementalPool() = default;
+
+        bool Build(const BaseNode *root);
+        // Recomputes dirty nodes on the way to the root, everything on the first call
+        double Evaluate(const EvalContext &context);
+        // The variable in 'slot' has a new value, all nodes on the path to the root are recomputed by the next evaluation
+        void MarkChanged(size_t slot);
+        void MarkAllChanged();
+        // Nodes recomputed by the last evaluation
+        size_t NumRecomputed() const { return numRecomputed; }
+    protected:
+        double Eval(const EvalContext &context, uint32_t idx);
+        void MarkDirty(uint32_t idx);
+    protected:
+        std::vector<double> values;
+        std::vector<char> dirty;
+        std::vector<uint32_t> parentStart;      // parents of node i are parents[parentStart[i]..parentStart[i+1]]
+        std::vector<uint32_t> parents;
+        std::vector<std::vector<uint32_t> > slotNodes;      // variable nodes per slot
+        std::vector<uint32_t> markStack;
+        size_t numRecomputed = 0;
+    };
+}
@@ -0,0 +1,556 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: jit.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-18, 23:40
+Descr   : Lowers a prepared expression tree to x86-64 SSE2 machine code.
+          Every node leaves its value in xmm0, pending operands are kept
+          in temporaries in the stack frame. Variables are loaded from
+          the bound slot array, unbound variables and user functions go
+          through the regular callbacks. The operations match the kernels
+          in 'ops' instruction by instruction - results are identical to
+          the tree evaluator. System V calling convention only.
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 19.10.26, FKling, Shared sub-expressions are compiled once and called, code no longer grows with every reference
+- 19.10.26, FKling, Trees deeper than EXP_SOLVER_JIT_MAX_NESTING are left to the interpreter
+- 18.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include <stddef.h>
+#include <string.h>
+
+#include "expsolver.h"
+#include "bytecode.h"
+#include "jit.h"
+
+#ifdef EXP_SOLVER_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace gnilk;
+
+// Shared values are kept on the stack up to this count
+static const size_t kLocalSharedSize = 16;
+// Frame layout, 'bOk' for the callbacks followed by the temporaries
+static const uint32_t kFrameOk = 0;
+static const uint32_t kFrameTemps = 8;
+
+JitProgram::~JitProgram() {
+    Release();
+}
+
+bool JitProgram::IsAvailable() {
+#ifdef EXP_SOLVER_JIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+void JitProgram::Release() {
+#ifdef EXP_SOLVER_JIT
+    if (pExec != nullptr) {
+        munmap(pExec, execSize);
+    }
+#endif
+    pExec = nullptr;
+    execSize = 0;
+    pEntry = nullptr;
+    codeSize = 0;
+}
+
+//
+// Compile a tree, can be called multiple times - the previous code is discarded
+//
+bool JitProgram::Compile(const BaseNode *root) {
+    Release();
+    code.clear();
+    shared.clear();
+    sharedCode.clear();
+    names.Reset();
+    numShared = 0;
+    maxTemps = 0;
+    nesting = 0;
+
+    if ((root == nullptr) || !IsAvailable()) {
+        return false;
+    }
+
+    // push rbp; mov rbp, rsp; push rbx; sub rsp, <frame>; mov rbx, rdi
+    Bytes({ 0x55, 0x48, 0x89, 0xe5, 0x53, 0x48, 0x81, 0xec });
+    size_t idxFrameSize = code.size();
+    Imm32(0);
+    Bytes({ 0x48, 0x89, 0xfb });
+
+    bool result = EmitNode(root, 0);
+    numShared = shared.size();
+    shared.clear();
+    sharedCode.clear();
+    if (!result) {
+        code.clear();
+        return false;
+    }
+
+    // The frame keeps rsp 16 byte aligned for calls, return address + rbp + rbx = 24 bytes
+    uint32_t frameSize = FrameSize(maxTemps);
+    Patch32(idxFrameSize, frameSize);
+
+    // add rsp, <frame>; pop rbx; pop rbp; ret
+    Bytes({ 0x48, 0x81, 0xc4 });
+    Imm32(frameSize);
+    Bytes({ 0x5b, 0x5d, 0xc3 });
+
+    result = MakeExecutable();
+    code.clear();
+    code.shrink_to_fit();
+    return result;
+}
+
+//
+// Value of 'node' in xmm0, temporaries from 'depth' and up are free
+//
+bool JitProgram::EmitNode(const BaseNode *node, size_t depth) {
+    if (nesting >= EXP_SOLVER_JIT_MAX_NESTING) {
+        return false;
+    }
+    nesting++;
+    bool result = EmitValue(node, depth);
+    nesting--;
+    return result;
+}
+
+bool JitProgram::EmitValue(const BaseNode *node, size_t depth) {
+    if (node == nullptr) {
+        return false;
+    }
+    switch (node->Type()) {
+        case kNodeType_Const : {
+            // mov rax, imm64; movq xmm0, rax
+            double value = static_cast<const ConstNode *>(node)->Value();
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            Bytes({ 0x48, 0xb8 });
+            Imm64(bits);
+            Bytes({ 0x66, 0x48, 0x0f, 0x6e, 0xc0 });
+            return true;
+        }
+        case kNodeType_ConstUser : {
+            auto var = static_cast<const ConstUserNode *>(node);
+            return EmitVariable(var->Slot(), var->Name());
+        }
+        case kNodeType_Func :
+            return EmitCall(static_cast<const FuncNode *>(node), depth);
+        case kNodeType_NativeFunc :
+            return EmitNativeCall(static_cast<const NativeFuncNode *>(node), depth);
+        case kNodeType_BinOp :
+        case kNodeType_BoolOp : {
+            // Left before right, the left value waits in a temporary
+            auto binop = static_cast<const BinOpNode *>(node);
+            if ((depth >= EXP_SOLVER_JIT_MAX_TEMPS) || !EmitNode(binop->Left(), depth)) {
+                return false;
+            }
+            StoreTemp(depth);
+            if (!EmitNode(binop->Right(), depth + 1)) {
+                return false;
+            }
+            // movapd xmm1, xmm0
+            Bytes({ 0x66, 0x0f, 0x28, 0xc8 });
+            LoadTemp(0, depth);
+            EmitBinOp(binop->Op());
+            return true;
+        }
+        case kNodeType_If : {
+            auto ifop = static_cast<const IfOperatorNode *>(node);
+            if (!EmitNode(ifop->Condition(), depth)) {
+                return false;
+            }
+            // ops::IsTrue, NaN is false - xorpd xmm1, xmm1; ucomisd xmm0, xmm1; jbe <false>
+            Bytes({ 0x66, 0x0f, 0x57, 0xc9, 0x66, 0x0f, 0x2e, 0xc1 });
+            size_t idxJumpFalse = EmitJump({ 0x0f, 0x86 });
+            if (!EmitNode(ifop->TrueBranch(), depth)) {
+                return false;
+            }
+            size_t idxJumpEnd = EmitJump({ 0xe9 });
+            PatchJump(idxJumpFalse);
+            if (!EmitNode(ifop->FalseBranch(), depth)) {
+                return false;
+            }
+            PatchJump(idxJumpEnd);
+            return true;
+        }
+        case kNodeType_Shared :
+            return EmitShared(static_cast<const SharedNode *>(node)->Expression());
+        default:
+            break;
+    }
+    // Unknown construct, left to the interpreter
+    return false;
+}
+
+//
+// Bound slot or the variable callback, 0 without either - same as Program::Run
+//
+bool JitProgram::EmitVariable(size_t slot, const char *name) {
+    if (slot > (UINT32_MAX / sizeof(double))) {
+        return false;
+    }
+    // mov rax, [rbx + context]; mov rax, [rax + pSlots]; test rax, rax; jz <callback>
+    Bytes({ 0x48, 0x8b, 0x83 });
+    Imm32(offsetof(JitFrame, context));
+    Bytes({ 0x48, 0x8b, 0x80 });
+    Imm32(offsetof(EvalContext, pSlots));
+    Bytes({ 0x48, 0x85, 0xc0 });
+    size_t idxNoSlots = EmitJump({ 0x0f, 0x84 });
+    // mov rax, [rax + slot * 8]; test rax, rax; jz <callback>
+    Bytes({ 0x48, 0x8b, 0x80 });
+    Imm32((uint32_t) (slot * sizeof(double)));
+    Bytes({ 0x48, 0x85, 0xc0 });
+    size_t idxUnbound = EmitJump({ 0x0f, 0x84 });
+    // movsd xmm0, [rax]; jmp <done>
+    Bytes({ 0xf2, 0x0f, 0x10, 0x00 });
+    size_t idxBound = EmitJump({ 0xe9 });
+
+    PatchJump(idxNoSlots);
+    PatchJump(idxUnbound);
+    // mov rax, [rbx + context]; mov r10, [rax + pVariableCallback]; test r10, r10; jz <zero>
+    Bytes({ 0x48, 0x8b, 0x83 });
+    Imm32(offsetof(JitFrame, context));
+    Bytes({ 0x4c, 0x8b, 0x90 });
+    Imm32(offsetof(EvalContext, pVariableCallback));
+    Bytes({ 0x4d, 0x85, 0xd2 });
+    size_t idxNoCallback = EmitJump({ 0x0f, 0x84 });
+    // mov rdi, [rax + pVariableContext]; mov rsi, name; lea rdx, [rsp + ok]; call r10; jmp <done>
+    Bytes({ 0x48, 0x8b, 0xb8 });
+    Imm32(offsetof(EvalContext, pVariableContext));
+    Bytes({ 0x48, 0xbe });
+    Imm64((uint64_t) (uintptr_t) names.StrDup(name));
+    Bytes({ 0x48, 0x8d, 0x94, 0x24 });
+    Imm32(kFrameOk);
+    Bytes({ 0x41, 0xff, 0xd2 });
+    size_t idxCalled = EmitJump({ 0xe9 });
+
+    PatchJump(idxNoCallback);
+    // xorpd xmm0, xmm0
+    Bytes({ 0x66, 0x0f, 0x57, 0xc0 });
+    PatchJump(idxBound);
+    PatchJump(idxCalled);
+    return true;
+}
+
+//
+// Arguments are evaluated in order to consecutive temporaries starting at 'depth'
+//
+bool JitProgram::EmitArguments(const BaseNode *node, int args, size_t depth) {
+    if ((depth + args) > EXP_SOLVER_JIT_MAX_TEMPS) {
+        return false;
+    }
+    for (int i = 0; i < args; i++) {
+        if (!EmitNode(node->Child(i), depth + i)) {
+            return false;
+        }
+        StoreTemp(depth + i);
+    }
+    return true;
+}
+
+//
+// User function through the PFNEVALUATEFUNC callback, arguments are passed straight from the temporaries
+//
+bool JitProgram::EmitCall(const FuncNode *func, size_t depth) {
+    if (!EmitArguments(func, func->NumArguments(), depth)) {
+        return false;
+    }
+    // mov rax, [rbx + context]; mov r10, [rax + pFuncCallback]; test r10, r10; jz <zero>
+    Bytes({ 0x48, 0x8b, 0x83 });
+    Imm32(offsetof(JitFrame, context));
+    Bytes({ 0x4c, 0x8b, 0x90 });
+    Imm32(offsetof(EvalContext, pFuncCallback));
+    Bytes({ 0x4d, 0x85, 0xd2 });
+    size_t idxNoCallback = EmitJump({ 0x0f, 0x84 });
+    // mov rdi, [rax + pFunctionContext]; mov rsi, name; mov edx, args; lea rcx, [rsp + temp]; lea r8, [rsp + ok]; call r10
+    Bytes({ 0x48, 0x8b, 0xb8 });
+    Imm32(offsetof(EvalContext, pFunctionContext));
+    Bytes({ 0x48, 0xbe });
+    Imm64((uint64_t) (uintptr_t) names.StrDup(func->Name()));
+    Bytes({ 0xba });
+    Imm32((uint32_t) func->NumArguments());
+    Bytes({ 0x48, 0x8d, 0x8c, 0x24 });
+    Imm32(kFrameTemps + (uint32_t) (depth * sizeof(double)));
+    Bytes({ 0x4c, 0x8d, 0x84, 0x24 });
+    Imm32(kFrameOk);
+    Bytes({ 0x41, 0xff, 0xd2 });
+    size_t idxCalled = EmitJump({ 0xe9 });
+
+    PatchJump(idxNoCallback);
+    // xorpd xmm0, xmm0
+    Bytes({ 0x66, 0x0f, 0x57, 0xc0 });
+    PatchJump(idxCalled);
+    return true;
+}
+
+//
+// Native functions are called directly, up to 4 arguments in xmm0-xmm3
+//
+bool JitProgram::EmitNativeCall(const NativeFuncNode *func, size_t depth) {
+    auto &function = func->Function();
+    int args = func->NumArguments();
+    if (!EmitArguments(func, args, depth)) {
+        return false;
+    }
+    uint64_t target;
+    switch (function.arity) {
+        case 0 : target = (uint64_t) (uintptr_t) function.f0; break;
+        case 1 : target = (uint64_t) (uintptr_t) function.f1; break;
+        case 2 : target = (uint64_t) (uintptr_t) function.f2; break;
+        case 3 : target = (uint64_t) (uintptr_t) function.f3; break;
+        case 4 : target = (uint64_t) (uintptr_t) function.f4; break;
+        default: target = (uint64_t) (uintptr_t) function.fn; break;
+    }
+    if ((function.arity >= 0) && (function.arity <= 4)) {
+        for (int i = 0; i < function.arity; i++) {
+            LoadTemp(i, depth + i);
+        }
+    } else {
+        // mov esi, args; lea rdx, [rsp + temp]
+        Bytes({ 0xbe });
+        Imm32((uint32_t) args);
+        Bytes({ 0x48, 0x8d, 0x94, 0x24 });
+        Imm32(kFrameTemps + (uint32_t) (depth * sizeof(double)));
+    }
+    // mov rdi, pUser; mov rax, function; call rax
+    Bytes({ 0x48, 0xbf });
+    Imm64((uint64_t) (uintptr_t) function.pUser);
+    Bytes({ 0x48, 0xb8 });
+    Imm64(target);
+    Bytes({ 0xff, 0xd0 });
+    return true;
+}
+
+//
+// xmm0 = xmm0 <op> xmm1, see the kernels in 'ops'
+//
+void JitProgram::EmitBinOp(kOpCode op) {
+    switch (op) {
+        case kOpCode_ShiftLeft :
+            // cvttsd2si eax, xmm0; cvttsd2si ecx, xmm1; shl eax, cl; cvtsi2sd xmm0, eax
+            Bytes({ 0xf2, 0x0f, 0x2c, 0xc0, 0xf2, 0x0f, 0x2c, 0xc9, 0xd3, 0xe0, 0xf2, 0x0f, 0x2a, 0xc0 });
+            break;
+        case kOpCode_ShiftRight :
+            // cvttsd2si eax, xmm0; cvttsd2si ecx, xmm1; sar eax, cl; cvtsi2sd xmm0, eax
+            Bytes({ 0xf2, 0x0f, 0x2c, 0xc0, 0xf2, 0x0f, 0x2c, 0xc9, 0xd3, 0xf8, 0xf2, 0x0f, 0x2a, 0xc0 });
+            break;
+        case kOpCode_Add :
+            Bytes({ 0xf2, 0x0f, 0x58, 0xc1 });
+            break;
+        case kOpCode_Sub :
+            Bytes({ 0xf2, 0x0f, 0x5c, 0xc1 });
+            break;
+        case kOpCode_Mul :
+            Bytes({ 0xf2, 0x0f, 0x59, 0xc1 });
+            break;
+        case kOpCode_Div :
+            Bytes({ 0xf2, 0x0f, 0x5e, 0xc1 });
+            break;
+        case kOpCode_Greater :
+            // right = (int) right; ucomisd xmm0, xmm1; seta al; movzx eax, al; cvtsi2sd xmm0, eax
+            Bytes({ 0xf2, 0x0f, 0x2c, 0xc1, 0xf2, 0x0f, 0x2a, 0xc8 });
+            Bytes({ 0x66, 0x0f, 0x2e, 0xc1, 0x0f, 0x97, 0xc0, 0x0f, 0xb6, 0xc0, 0xf2, 0x0f, 0x2a, 0xc0 });
+            break;
+        case kOpCode_Less :
+            // right = (int) right; ucomisd xmm1, xmm0; seta al; movzx eax, al; cvtsi2sd xmm0, eax
+            Bytes({ 0xf2, 0x0f, 0x2c, 0xc1, 0xf2, 0x0f, 0x2a, 0xc8 });
+            Bytes({ 0x66, 0x0f, 0x2e, 0xc8, 0x0f, 0x97, 0xc0, 0x0f, 0xb6, 0xc0, 0xf2, 0x0f, 0x2a, 0xc0 });
+            break;
+        default:
+            break;
+    }
+}
+
+//
+// The expression is compiled once, where it is first referenced, as a function with a frame of its own
+// every reference calls it - the cached value is returned when it has already been evaluated in this run
+//
+bool JitProgram::EmitShared(const SharedExpression *expression) {
+    size_t idxShared = SharedIndex(expression);
+    if (idxShared > (UINT32_MAX / sizeof(double))) {
+        return false;
+    }
+    if (idxShared == sharedCode.size()) {
+        size_t idxSkip = EmitJump({ 0xe9 });
+        sharedCode.push_back(code.size());
+        // mov rax, [rbx + sharedValid]; cmp byte [rax + idx], 0; je <evaluate>
+        Bytes({ 0x48, 0x8b, 0x83 });
+        Imm32(offsetof(JitFrame, sharedValid));
+        Bytes({ 0x80, 0xb8 });
+        Imm32((uint32_t) idxShared);
+        Bytes({ 0x00 });
+        size_t idxEvaluate = EmitJump({ 0x0f, 0x84 });
+        // mov rax, [rbx + sharedValues]; movsd xmm0, [rax + idx * 8]; ret
+        Bytes({ 0x48, 0x8b, 0x83 });
+        Imm32(offsetof(JitFrame, sharedValues));
+        Bytes({ 0xf2, 0x0f, 0x10, 0x80 });
+        Imm32((uint32_t) (idxShared * sizeof(double)));
+        Bytes({ 0xc3 });
+
+        // sub rsp, <frame> - the return address takes the place of rbp and rbx, same alignment as the entry
+        PatchJump(idxEvaluate);
+        Bytes({ 0x48, 0x81, 0xec });
+        size_t idxFrameSize = code.size();
+        Imm32(0);
+        size_t callerTemps = maxTemps;
+        maxTemps = 0;
+        if (!EmitNode(expression->node, 0)) {
+            return false;
+        }
+        uint32_t frameSize = FrameSize(maxTemps);
+        Patch32(idxFrameSize, frameSize);
+        maxTemps = callerTemps;
+        // mov rax, [rbx + sharedValues]; movsd [rax + idx * 8], xmm0; mov rax, [rbx + sharedValid]; mov byte [rax + idx], 1
+        Bytes({ 0x48, 0x8b, 0x83 });
+        Imm32(offsetof(JitFrame, sharedValues));
+        Bytes({ 0xf2, 0x0f, 0x11, 0x80 });
+        Imm32((uint32_t) (idxShared * sizeof(double)));
+        Bytes({ 0x48, 0x8b, 0x83 });
+        Imm32(offsetof(JitFrame, sharedValid));
+        Bytes({ 0xc6, 0x80 });
+        Imm32((uint32_t) idxShared);
+        Bytes({ 0x01 });
+        // add rsp, <frame>; ret
+        Bytes({ 0x48, 0x81, 0xc4 });
+        Imm32(frameSize);
+        Bytes({ 0xc3 });
+        PatchJump(idxSkip);
+    }
+    // call <expression>
+    Bytes({ 0xe8 });
+    Imm32((uint32_t) (sharedCode[idxShared] - (code.size() + 4)));
+    return true;
+}
+
+size_t JitProgram::SharedIndex(const SharedExpression *expression) {
+    for (size_t i = 0; i < shared.size(); i++) {
+        if (shared[i] == expression) {
+            return i;
+        }
+    }
+    shared.push_back(expression);
+    return shared.size() - 1;
+}
+
+//
+// Encoding helpers
+//
+void JitProgram::Bytes(std::initializer_list<uint8_t> bytes) {
+    code.insert(code.end(), bytes);
+}
+
+void JitProgram::Imm32(uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        code.push_back((uint8_t) (value >> (i * 8)));
+    }
+}
+
+void JitProgram::Imm64(uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        code.push_back((uint8_t) (value >> (i * 8)));
+    }
+}
+
+void JitProgram::Patch32(size_t offset, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        code[offset + i] = (uint8_t) (value >> (i * 8));
+    }
+}
+
+// Frame for 'temps' temporaries, keeps rsp 16 byte aligned when entered with rsp 8 bytes off
+uint32_t JitProgram::FrameSize(size_t temps) {
+    uint32_t frameSize = kFrameTemps + (uint32_t) (temps * sizeof(double));
+    if ((frameSize % 16) == 0) {
+        frameSize += 8;
+    }
+    return frameSize;
+}
+
+// movsd xmm<n>, [rsp + temp]
+void JitProgram::LoadTemp(int xmm, size_t idx) {
+    Bytes({ 0xf2, 0x0f, 0x10, (uint8_t) (0x84 | (xmm << 3)), 0x24 });
+    Imm32(kFrameTemps + (uint32_t) (idx * sizeof(double)));
+}
+
+// movsd [rsp + temp], xmm0
+void JitProgram::StoreTemp(size_t idx) {
+    if (idx >= maxTemps) {
+        maxTemps = idx + 1;
+    }
+    Bytes({ 0xf2, 0x0f, 0x11, 0x84, 0x24 });
+    Imm32(kFrameTemps + (uint32_t) (idx * sizeof(double)));
+}
+
+// Jumps are always rel32, returns the offset to patch
+size_t JitProgram::EmitJump(std::initializer_list<uint8_t> opcode) {
+    Bytes(opcode);
+    size_t idxRel = code.size();
+    Imm32(0);
+    return idxRel;
+}
+
+// Jump to the current position
+void JitProgram::PatchJump(size_t idxRel) {
+    Patch32(idxRel, (uint32_t) (code.size() - (idxRel + 4)));
+}
+
+//
+// Copy the code to its own pages, never writable and executable at the same time
+//
+bool JitProgram::MakeExecutable() {
+#ifdef EXP_SOLVER_JIT
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    size_t size = ((code.size() + pageSize - 1) / pageSize) * pageSize;
+    void *pMem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pMem == MAP_FAILED) {
+        return false;
+    }
+    memcpy(pMem, code.data(), code.size());
+    if (mprotect(pMem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(pMem, size);
+        return false;
+    }
+    pExec = pMem;
+    execSize = size;
+    codeSize = code.size();
+    pEntry = reinterpret_cast<PFNJITCODE>(pMem);
+    return true;
+#else
+    return false;
+#endif
+}
+
+//
+// Run the generated code, the program is not modified - shared values live on the local stack
+//
+double JitProgram::Run(const EvalContext &context) const {
+    if (pEntry == nullptr) {
+        return 0.0;
+    }
+    double localShared[kLocalSharedSize];
+    char localValid[kLocalSharedSize];
+    std::vector<double> heapShared;
+    std::vector<char> heapValid;
+    JitFrame frame;
+    frame.context = &context;
+    frame.sharedValues = localShared;
+    frame.sharedValid = localValid;
+    if (numShared > kLocalSharedSize) {
+        heapShared.resize(numShared);
+        heapValid.resize(numShared);
+        frame.sharedValues = heapShared.data();
+        frame.sharedValid = heapValid.data();
+    }
+    memset(frame.sharedValid, 0, numShared);
+    return pEntry(&frame);
+}
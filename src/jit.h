@@ -0,0 +1,86 @@
+// See jit.cpp for more details
+#pragma once
+
+#include <stdint.h>
+#include <initializer_list>
+#include <vector>
+#include "expsolver.h"
+#include "arena.h"
+
+namespace gnilk
+{
+    // Native code is only generated for x86-64 Linux, define EXP_SOLVER_NO_JIT to disable it
+    #if defined(__x86_64__) && defined(__linux__) && !defined(EXP_SOLVER_NO_JIT)
+    #define EXP_SOLVER_JIT
+    #endif
+
+    // Temporaries in the native stack frame, deeper expressions are left to the interpreter
+    #define EXP_SOLVER_JIT_MAX_TEMPS 1024
+    // Code generation recurses once per tree level, deeper trees are left to the interpreter
+    #define EXP_SOLVER_JIT_MAX_NESTING 1024
+
+    struct EvalContext;
+
+    // Per call state for the generated code
+    struct JitFrame {
+        const EvalContext *context;
+        double *sharedValues;
+        char *sharedValid;
+    };
+
+    //
+    // Expression tree compiled to straight-line SSE2 code in executable pages
+    // Compile fails for unsupported platforms and constructs, the caller keeps using the interpreter
+    //
+    class JitProgram {
+    public:
+        JitProgram() = default;
+        virtual ~JitProgram();
+        JitProgram(const JitProgram &) = delete;
+        JitProgram &operator=(const JitProgram &) = delete;
+
+        static bool IsAvailable();
+        bool Compile(const BaseNode *root);
+        bool IsCompiled() const { return (pEntry != nullptr); }
+        // Same context as Program::Run, variables are read from the slot array or the variable callback
+        double Run(const EvalContext &context) const;
+        size_t CodeSize() const { return codeSize; }
+    protected:
+        typedef double (*PFNJITCODE)(JitFrame *frame);
+
+        bool EmitNode(const BaseNode *node, size_t depth);
+        bool EmitValue(const BaseNode *node, size_t depth);
+        bool EmitVariable(size_t slot, const char *name);
+        bool EmitCall(const FuncNode *func, size_t depth);
+        bool EmitNativeCall(const NativeFuncNode *func, size_t depth);
+        bool EmitArguments(const BaseNode *node, int args, size_t depth);
+        void EmitBinOp(kOpCode op);
+        bool EmitShared(const SharedExpression *expression);
+
+        void Bytes(std::initializer_list<uint8_t> bytes);
+        void Imm32(uint32_t value);
+        void Imm64(uint64_t value);
+        static uint32_t FrameSize(size_t temps);
+        void LoadTemp(int xmm, size_t idx);
+        void StoreTemp(size_t idx);
+        size_t EmitJump(std::initializer_list<uint8_t> opcode);
+        void PatchJump(size_t idxRel);
+        void Patch32(size_t offset, uint32_t value);
+        size_t SharedIndex(const SharedExpression *expression);
+
+        bool MakeExecutable();
+        void Release();
+    protected:
+        std::vector<uint8_t> code;                      // compile time only
+        std::vector<const SharedExpression *> shared;   // compile time only, index is the runtime cache slot
+        std::vector<size_t> sharedCode;                 // compile time only, code offset of each expression
+        Arena names;                                    // names referenced by the generated code
+        size_t numShared = 0;
+        size_t maxTemps = 0;
+        size_t nesting = 0;                             // compile time only, current tree level
+        size_t codeSize = 0;
+        void *pExec = nullptr;
+        size_t execSize = 0;
+        PFNJITCODE pEntry = nullptr;
+    };
+}
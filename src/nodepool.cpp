@@ -0,0 +1,469 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: nodepool.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-18, 21:10
+Descr   : Compact representation of a prepared expression tree. All nodes
+          are 16 byte entries in one array, children are 32-bit indices
+          and come before their parent. Evaluation is a switch over the
+          node type instead of virtual calls, '?:' only evaluates the
+          taken branch - same results and callback order as the tree.
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 19.10.26, FKling, Loaded records deeper than EXP_SOLVER_MAX_DEPTH are rejected
+- 19.10.26, FKling, Binary serialization of pools
+- 18.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include <string.h>
+#include <algorithm>
+
+#include "expsolver.h"
+#include "bytecode.h"
+#include "nodepool.h"
+
+using namespace gnilk;
+
+// Function arguments and shared values are kept on the stack up to this count
+static const size_t kLocalValues = 16;
+
+//
+// Build the pool from a tree, can be called multiple times - the previous pool is discarded
+//
+bool NodePool::Build(const BaseNode *root) {
+    nodes.clear();
+    constants.clear();
+    argIndices.clear();
+    variables.clear();
+    functions.clear();
+    natives.clear();
+    nativeNames.clear();
+    shared.clear();
+
+    if (root == nullptr) {
+        return false;
+    }
+    int32_t idx = Add(root);
+    if (idx < 0) {
+        return false;
+    }
+    this->root = (uint32_t) idx;
+    return true;
+}
+
+//
+// Post order, returns the node index or -1 on failure
+//
+int32_t NodePool::Add(const BaseNode *node) {
+    PoolNode poolNode;
+    memset(&poolNode, 0, sizeof(poolNode));
+    poolNode.type = (uint8_t) node->Type();
+
+    switch (node->Type()) {
+        case kNodeType_Const :
+            constants.push_back(static_cast<const ConstNode *>(node)->Value());
+            poolNode.a = (uint32_t) (constants.size() - 1);
+            break;
+        case kNodeType_ConstUser : {
+            auto var = static_cast<const ConstUserNode *>(node);
+            if (var->Slot() >= variables.size()) {
+                variables.resize(var->Slot() + 1);
+            }
+            variables[var->Slot()] = var->Name();
+            poolNode.a = (uint32_t) var->Slot();
+            break;
+        }
+        case kNodeType_Func :
+        case kNodeType_NativeFunc : {
+            // Arguments first, their indices are stored as one consecutive list
+            std::vector<uint32_t> args;
+            for (int i = 0; i < node->NumChildren(); i++) {
+                int32_t idxArg = Add(node->Child(i));
+                if (idxArg < 0) {
+                    return -1;
+                }
+                args.push_back((uint32_t) idxArg);
+            }
+            if (args.size() > UINT16_MAX) {
+                return -1;
+            }
+            poolNode.a = (uint32_t) argIndices.size();
+            poolNode.args = (uint16_t) args.size();
+            argIndices.insert(argIndices.end(), args.begin(), args.end());
+            if (node->Type() == kNodeType_Func) {
+                functions.push_back(static_cast<const FuncNode *>(node)->Name());
+                poolNode.b = (uint32_t) (functions.size() - 1);
+            } else {
+                natives.push_back(static_cast<const NativeFuncNode *>(node)->Function());
+                nativeNames.push_back(static_cast<const NativeFuncNode *>(node)->Name());
+                poolNode.b = (uint32_t) (natives.size() - 1);
+            }
+            break;
+        }
+        case kNodeType_BinOp :
+        case kNodeType_BoolOp : {
+            auto binop = static_cast<const BinOpNode *>(node);
+            int32_t left = Add(binop->Left());
+            int32_t right = (left < 0) ? -1 : Add(binop->Right());
+            if (right < 0) {
+                return -1;
+            }
+            poolNode.op = (uint8_t) binop->Op();
+            poolNode.a = (uint32_t) left;
+            poolNode.b = (uint32_t) right;
+            break;
+        }
+        case kNodeType_If : {
+            auto ifop = static_cast<const IfOperatorNode *>(node);
+            int32_t cond = Add(ifop->Condition());
+            int32_t valueTrue = (cond < 0) ? -1 : Add(ifop->TrueBranch());
+            int32_t valueFalse = (valueTrue < 0) ? -1 : Add(ifop->FalseBranch());
+            if (valueFalse < 0) {
+                return -1;
+            }
+            poolNode.a = (uint32_t) cond;
+            poolNode.b = (uint32_t) valueTrue;
+            poolNode.c = (uint32_t) valueFalse;
+            break;
+        }
+        case kNodeType_Shared : {
+            // The shared expression is added once, all references point to it
+            auto expression = static_cast<const SharedNode *>(node)->Expression();
+            size_t idxShared = 0;
+            while ((idxShared < shared.size()) && (shared[idxShared].first != expression)) {
+                idxShared++;
+            }
+            if (idxShared == shared.size()) {
+                int32_t idxNode = Add(expression->node);
+                if (idxNode < 0) {
+                    return -1;
+                }
+                // The expression may reference other shared expressions, they were added first
+                idxShared = shared.size();
+                shared.push_back(std::make_pair(expression, (uint32_t) idxNode));
+            }
+            poolNode.b = (uint32_t) idxShared;
+            poolNode.c = shared[idxShared].second;
+            break;
+        }
+        default:
+            return -1;
+    }
+
+    nodes.push_back(poolNode);
+    return (int32_t) (nodes.size() - 1);
+}
+
+size_t NodePool::MemoryUsage() const {
+    size_t bytes = nodes.size() * sizeof(PoolNode) + constants.size() * sizeof(double);
+    bytes += argIndices.size() * sizeof(uint32_t);
+    bytes += natives.size() * sizeof(NativeFunction);
+    for (auto &name: variables) {
+        bytes += name.length() + 1;
+    }
+    for (auto &name: functions) {
+        bytes += name.length() + 1;
+    }
+    return bytes;
+}
+
+//
+// Serialized record, host byte order - the header is followed by the sections below, each 8 byte aligned
+//   double constants[numConstants]
+//   PoolNode nodes[numNodes]
+//   uint32_t argIndices[numArgIndices]
+//   uint32_t nameOffsets[numVariables + numFunctions + numNatives]     // into the string table
+//   char strings[stringBytes]                                          // zero terminated names
+//
+struct PoolRecordHeader {
+    uint32_t root;
+    uint32_t numNodes;
+    uint32_t numConstants;
+    uint32_t numArgIndices;
+    uint32_t numVariables;
+    uint32_t numFunctions;
+    uint32_t numNatives;
+    uint32_t numShared;
+    uint32_t stringBytes;
+    uint32_t reserved;
+};
+
+static size_t Align8(size_t value) {
+    return (value + 7) & ~(size_t) 7;
+}
+
+static void AppendBytes(std::vector<uint8_t> &out, const void *data, size_t size) {
+    auto bytes = (const uint8_t *) data;
+    out.insert(out.end(), bytes, bytes + size);
+    out.resize(Align8(out.size()), 0);
+}
+
+void NodePool::Serialize(std::vector<uint8_t> &out) const {
+    std::vector<uint32_t> nameOffsets;
+    std::string strings;
+    for (auto names: { &variables, &functions, &nativeNames }) {
+        for (auto &name: *names) {
+            nameOffsets.push_back((uint32_t) strings.size());
+            strings.append(name.c_str(), name.length() + 1);
+        }
+    }
+
+    PoolRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.root = root;
+    header.numNodes = (uint32_t) nodes.size();
+    header.numConstants = (uint32_t) constants.size();
+    header.numArgIndices = (uint32_t) argIndices.size();
+    header.numVariables = (uint32_t) variables.size();
+    header.numFunctions = (uint32_t) functions.size();
+    header.numNatives = (uint32_t) natives.size();
+    header.numShared = (uint32_t) shared.size();
+    header.stringBytes = (uint32_t) strings.size();
+
+    // Records start 8 byte aligned
+    out.resize(Align8(out.size()), 0);
+    AppendBytes(out, &header, sizeof(header));
+    AppendBytes(out, constants.data(), constants.size() * sizeof(double));
+    AppendBytes(out, nodes.data(), nodes.size() * sizeof(PoolNode));
+    AppendBytes(out, argIndices.data(), argIndices.size() * sizeof(uint32_t));
+    AppendBytes(out, nameOffsets.data(), nameOffsets.size() * sizeof(uint32_t));
+    AppendBytes(out, strings.data(), strings.size());
+}
+
+template<typename T>
+static void CopySection(std::vector<T> &dst, const uint8_t *src, size_t count) {
+    dst.resize(count);
+    if (count > 0) {
+        memcpy(dst.data(), src, count * sizeof(T));
+    }
+}
+
+//
+// Sections are copied, the data does not have to be aligned or stay alive
+//
+bool NodePool::Deserialize(const void *data, size_t size, const FunctionRegistry *pFunctions) {
+    nodes.clear();
+    constants.clear();
+    argIndices.clear();
+    variables.clear();
+    functions.clear();
+    natives.clear();
+    nativeNames.clear();
+    shared.clear();
+
+    PoolRecordHeader header;
+    if ((data == nullptr) || (size < sizeof(header))) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    // Every shared expression has a node of its own
+    if ((header.numNodes == 0) || (header.root >= header.numNodes) || (header.numShared > header.numNodes)) {
+        return false;
+    }
+    size_t numNames = (size_t) header.numVariables + header.numFunctions + header.numNatives;
+    uint64_t offsets[6];
+    offsets[0] = sizeof(header);
+    offsets[1] = offsets[0] + Align8((size_t) header.numConstants * sizeof(double));
+    offsets[2] = offsets[1] + Align8((size_t) header.numNodes * sizeof(PoolNode));
+    offsets[3] = offsets[2] + Align8((size_t) header.numArgIndices * sizeof(uint32_t));
+    offsets[4] = offsets[3] + Align8(numNames * sizeof(uint32_t));
+    offsets[5] = offsets[4] + header.stringBytes;
+    if (offsets[5] > size) {
+        return false;
+    }
+    auto bytes = (const uint8_t *) data;
+    const char *strings = (const char *) (bytes + offsets[4]);
+    if ((header.stringBytes > 0) && (strings[header.stringBytes - 1] != '\0')) {
+        return false;
+    }
+
+    CopySection(constants, bytes + offsets[0], header.numConstants);
+    CopySection(nodes, bytes + offsets[1], header.numNodes);
+    CopySection(argIndices, bytes + offsets[2], header.numArgIndices);
+    std::vector<uint32_t> nameOffsets;
+    CopySection(nameOffsets, bytes + offsets[3], numNames);
+    for (size_t i = 0; i < numNames; i++) {
+        if (nameOffsets[i] >= header.stringBytes) {
+            return false;
+        }
+        auto &names = (i < header.numVariables) ? variables : (i < (size_t) header.numVariables + header.numFunctions) ? functions : nativeNames;
+        names.push_back(strings + nameOffsets[i]);
+    }
+
+    // Native functions are not stored, only their names
+    for (auto &name: nativeNames) {
+        const NativeFunction *native = (pFunctions != nullptr) ? pFunctions->Find(name) : nullptr;
+        if (native == nullptr) {
+            native = FunctionRegistry::BuiltIns().Find(name);
+        }
+        if (native == nullptr) {
+            nodes.clear();
+            return false;
+        }
+        natives.push_back(*native);
+    }
+    shared.resize(header.numShared, std::make_pair((const SharedExpression *) nullptr, (uint32_t) 0));
+    root = header.root;
+
+    // Children come before their parent, this also rules out cycles
+    // the height of a node follows from its children - evaluation recurses, the depth limit is the one of Prepare
+    std::vector<uint32_t> heights(nodes.size());
+    for (uint32_t i = 0; i < (uint32_t) nodes.size(); i++) {
+        const PoolNode &node = nodes[i];
+        bool valid = false;
+        uint32_t height = 0;
+        switch (node.type) {
+            case kNodeType_Const :
+                valid = (node.a < constants.size());
+                break;
+            case kNodeType_ConstUser :
+                valid = (node.a < variables.size());
+                break;
+            case kNodeType_BinOp :
+            case kNodeType_BoolOp :
+                valid = (node.op < kOpCode_NumOpCodes) && (node.a < i) && (node.b < i);
+                if (valid) {
+                    height = std::max(heights[node.a], heights[node.b]);
+                }
+                break;
+            case kNodeType_If :
+                valid = (node.a < i) && (node.b < i) && (node.c < i);
+                if (valid) {
+                    height = std::max(heights[node.a], std::max(heights[node.b], heights[node.c]));
+                }
+                break;
+            case kNodeType_Shared :
+                valid = (node.b < shared.size()) && (node.c < i);
+                if (valid) {
+                    height = heights[node.c];
+                }
+                break;
+            case kNodeType_Func :
+            case kNodeType_NativeFunc :
+                valid = ((uint64_t) node.a + node.args <= argIndices.size());
+                for (uint32_t arg = 0; valid && (arg < node.args); arg++) {
+                    valid = (argIndices[node.a + arg] < i);
+                    if (valid) {
+                        height = std::max(height, heights[argIndices[node.a + arg]]);
+                    }
+                }
+                if (node.type == kNodeType_Func) {
+                    valid = valid && (node.b < functions.size());
+                } else {
+                    valid = valid && (node.b < natives.size()) && natives[node.b].AcceptsArguments(node.args);
+                }
+                break;
+            default:
+                break;
+        }
+        heights[i] = height + 1;
+        if (!valid || (heights[i] > EXP_SOLVER_MAX_DEPTH)) {
+            nodes.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// Evaluation
+//
+struct NodePool::EvalState {
+    const EvalContext *pContext;
+    double *sharedValues;
+    char *sharedValid;
+};
+
+double NodePool::Evaluate(const EvalContext &context) const {
+    if (nodes.empty()) {
+        return 0.0;
+    }
+
+    double localShared[kLocalValues];
+    char localValid[kLocalValues];
+    std::vector<double> heapShared;
+    std::vector<char> heapValid;
+
+    EvalState state;
+    state.pContext = &context;
+    state.sharedValues = localShared;
+    state.sharedValid = localValid;
+    if (shared.size() > kLocalValues) {
+        heapShared.resize(shared.size());
+        heapValid.resize(shared.size());
+        state.sharedValues = heapShared.data();
+        state.sharedValid = heapValid.data();
+    }
+    memset(state.sharedValid, 0, shared.size());
+
+    return Eval(state, root);
+}
+
+double NodePool::Eval(EvalState &state, uint32_t idx) const {
+    const PoolNode &node = nodes[idx];
+    switch (node.type) {
+        case kNodeType_Const :
+            return constants[node.a];
+        case kNodeType_ConstUser : {
+            auto &context = *state.pContext;
+            if ((context.pSlots != nullptr) && (context.pSlots[node.a] != nullptr)) {
+                return *context.pSlots[node.a];
+            }
+            int bOk = 0;
+            return (context.pVariableCallback == nullptr) ? 0.0 :
+                   context.pVariableCallback(context.pVariableContext, variables[node.a].c_str(), &bOk);
+        }
+        case kNodeType_BinOp :
+        case kNodeType_BoolOp : {
+            // Left before right, callbacks are evaluated in expression order
+            double left = Eval(state, node.a);
+            double right = Eval(state, node.b);
+            switch (node.op) {
+                case kOpCode_ShiftLeft : return ops::ShiftLeft(left, right);
+                case kOpCode_ShiftRight : return ops::ShiftRight(left, right);
+                case kOpCode_Add : return ops::Add(left, right);
+                case kOpCode_Sub : return ops::Sub(left, right);
+                case kOpCode_Mul : return ops::Mul(left, right);
+                case kOpCode_Div : return ops::Div(left, right);
+                case kOpCode_Greater : return ops::Greater(left, right);
+                case kOpCode_Less : return ops::Less(left, right);
+                default: return 0.0;
+            }
+        }
+        case kNodeType_If :
+            return ops::IsTrue(Eval(state, node.a)) ? Eval(state, node.b) : Eval(state, node.c);
+        case kNodeType_Shared :
+            if (!state.sharedValid[node.b]) {
+                state.sharedValues[node.b] = Eval(state, node.c);
+                state.sharedValid[node.b] = 1;
+            }
+            return state.sharedValues[node.b];
+        case kNodeType_Func :
+        case kNodeType_NativeFunc : {
+            double localValues[kLocalValues];
+            std::vector<double> heapValues;
+            double *values = localValues;
+            if (node.args > kLocalValues) {
+                heapValues.resize(node.args);
+                values = heapValues.data();
+            }
+            const uint32_t *args = argIndices.data() + node.a;
+            for (int i = 0; i < node.args; i++) {
+                values[i] = Eval(state, args[i]);
+            }
+            if (node.type == kNodeType_NativeFunc) {
+                return natives[node.b].Call(node.args, values);
+            }
+            auto &context = *state.pContext;
+            int bOk = 0;
+            return (context.pFuncCallback == nullptr) ? 0.0 :
+                   context.pFuncCallback(context.pFunctionContext, functions[node.b].c_str(), node.args, values, &bOk);
+        }
+        default:
+            break;
+    }
+    return 0.0;
+}
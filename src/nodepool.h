@@ -0,0 +1,63 @@
+// See nodepool.cpp for more details
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include "expsolver.h"
+#include "functions.h"
+
+namespace gnilk
+{
+    struct EvalContext;
+
+    // 16 bytes, children are referenced by index and always come before their parent
+    struct PoolNode {
+        uint8_t type;           // kNodeType
+        uint8_t op;             // kOpCode for operators
+        uint16_t args;          // number of arguments for function calls
+        uint32_t a;             // left, condition, constant index, variable slot or first entry in the argument index list
+        uint32_t b;             // right, true branch, function index or shared cache index
+        uint32_t c;             // false branch or shared child
+    };
+
+    //
+    // Flattened tree, one contiguous array of nodes in evaluation order - no virtual dispatch
+    //
+    class NodePool {
+    public:
+        NodePool() = default;
+        virtual ~NodePool() = default;
+
+        bool Build(const BaseNode *root);
+        double Evaluate(const EvalContext &context) const;
+
+        const std::vector<PoolNode> &Nodes() const { return nodes; }
+        // Bytes used by nodes, argument lists and names
+        size_t MemoryUsage() const;
+
+        // Variables referenced by the pool, indexed by slot - names are empty for slots not used
+        size_t GetNumVariables() const { return variables.size(); }
+        const char *GetVariableName(size_t slot) const { return (slot < variables.size()) ? variables[slot].c_str() : nullptr; }
+
+        // Binary record of the pool, appended to 'out' - see ExpressionFile for the layout
+        void Serialize(std::vector<uint8_t> &out) const;
+        // Loads a record written by Serialize, every index is validated - native functions are looked up
+        // by name in 'functions' and then in the built-ins. Returns false for invalid or truncated data
+        bool Deserialize(const void *data, size_t size, const FunctionRegistry *functions = nullptr);
+    protected:
+        struct EvalState;
+        int32_t Add(const BaseNode *node);
+        double Eval(EvalState &state, uint32_t idx) const;
+    protected:
+        std::vector<PoolNode> nodes;
+        std::vector<double> constants;
+        std::vector<uint32_t> argIndices;
+        std::vector<std::string> variables;         // indexed by slot, for the variable callback
+        std::vector<std::string> functions;
+        std::vector<NativeFunction> natives;
+        std::vector<std::string> nativeNames;
+        std::vector<std::pair<const SharedExpression *, uint32_t> > shared;   // expression, node index
+        uint32_t root = 0;
+    };
+}
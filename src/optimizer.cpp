@@ -0,0 +1,315 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: optimizer.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-18, 18:20
+Descr   : Constant folding and algebraic simplification of prepared
+          expression trees. Only rewrites which give bit-identical
+          results are done, for instance 'x+0' is kept unless 'x' can't
+          be -0.0 and 'x<<0' is kept unless 'x' is already an integer.
+          Identical pure sub-trees are found by structural hashing and
+          shared, the tree becomes a DAG.
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 18.10.26, FKling, Nodes are allocated from the solver arena, replaced nodes are left for the arena
+- 18.10.26, FKling, Common sub-expression sharing
+- 18.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include <math.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "expsolver.h"
+#include "optimizer.h"
+
+using namespace gnilk;
+
+BaseNode *Optimizer::Optimize(BaseNode *node, Arena &arena) {
+    if (node == nullptr) {
+        return nullptr;
+    }
+
+    // Bottom up, children are folded before their parents
+    for (int i = 0; i < node->NumChildren(); i++) {
+        node->SetChild(i, Optimize(node->Child(i), arena));
+    }
+
+    switch (node->Type()) {
+        case kNodeType_BinOp :
+        case kNodeType_BoolOp :
+            return OptimizeBinOp(static_cast<BinOpNode *>(node), arena);
+        case kNodeType_If :
+            return OptimizeIf(static_cast<IfOperatorNode *>(node));
+        case kNodeType_NativeFunc :
+            return OptimizeNativeFunc(static_cast<NativeFuncNode *>(node), arena);
+        case kNodeType_Shared : {
+            // Shared expressions are optimized first, a reference to one that folded to a constant becomes the constant
+            double value;
+            if (IsConst(static_cast<SharedNode *>(node)->Expression()->node, value)) {
+                return new (arena) ConstNode(value);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return node;
+}
+
+BaseNode *Optimizer::OptimizeBinOp(BinOpNode *node, Arena &arena) {
+    double left, right;
+    if (IsConst(node->Left(), left) && IsConst(node->Right(), right)) {
+        return new (arena) ConstNode(BinOpNode::OperatorFunc(node->Op())(left, right));
+    }
+
+    switch (node->Op()) {
+        case kOpCode_Mul :
+            // x*1 and 1*x
+            if (IsConstValue(node->Right(), 1.0)) return node->Left();
+            if (IsConstValue(node->Left(), 1.0)) return node->Right();
+            break;
+        case kOpCode_Div :
+            // x/1
+            if (IsConstValue(node->Right(), 1.0)) return node->Left();
+            break;
+        case kOpCode_Add :
+            // x+(-0) always, x+0 only if x can't be -0 (-0 + 0 = +0)
+            if (IsConstValue(node->Right(), -0.0)) return node->Left();
+            if (IsConstValue(node->Left(), -0.0)) return node->Right();
+            if (IsConstValue(node->Right(), 0.0) && IsIntegerValued(node->Left())) return node->Left();
+            if (IsConstValue(node->Left(), 0.0) && IsIntegerValued(node->Right())) return node->Right();
+            break;
+        case kOpCode_Sub :
+            // x-0
+            if (IsConstValue(node->Right(), 0.0)) return node->Left();
+            break;
+        case kOpCode_ShiftLeft :
+        case kOpCode_ShiftRight :
+            // shifting truncates to int, so 'x<<0' is only 'x' when x already is an int
+            if (IsConstValue(node->Right(), 0.0) && IsIntegerValued(node->Left())) return node->Left();
+            break;
+        default:
+            break;
+    }
+    return node;
+}
+
+//
+// A constant condition selects the branch, the other branch would never be evaluated
+//
+BaseNode *Optimizer::OptimizeIf(IfOperatorNode *node) {
+    double condition;
+    if (!IsConst(node->Condition(), condition)) {
+        return node;
+    }
+    return ops::IsTrue(condition) ? node->TrueBranch() : node->FalseBranch();
+}
+
+//
+// Pure functions with constant arguments are called once
+//
+BaseNode *Optimizer::OptimizeNativeFunc(NativeFuncNode *node, Arena &arena) {
+    if (!node->Function().pure) {
+        return node;
+    }
+    std::vector<double> args(node->NumArguments());
+    for (int i = 0; i < node->NumArguments(); i++) {
+        if (!IsConst(node->Argument(i), args[i])) {
+            return node;
+        }
+    }
+    return new (arena) ConstNode(node->Function().Call((int)args.size(), args.data()));
+}
+
+bool Optimizer::IsConst(const BaseNode *node, double &outValue) {
+    if (node->Type() != kNodeType_Const) {
+        return false;
+    }
+    outValue = static_cast<const ConstNode *>(node)->Value();
+    return true;
+}
+
+// Exact match, including the sign of zero
+bool Optimizer::IsConstValue(const BaseNode *node, double value) {
+    double constant;
+    if (!IsConst(node, constant)) {
+        return false;
+    }
+    return (constant == value) && (signbit(constant) == signbit(value));
+}
+
+//
+// True when the node always produces an int value, never -0.0 or a fraction
+//
+bool Optimizer::IsIntegerValued(const BaseNode *node) {
+    switch (node->Type()) {
+        case kNodeType_BoolOp :
+            return true;
+        case kNodeType_BinOp : {
+            auto op = static_cast<const BinOpNode *>(node)->Op();
+            return (op == kOpCode_ShiftLeft) || (op == kOpCode_ShiftRight);
+        }
+        default:
+            break;
+    }
+    return false;
+}
+
+//
+// Common sub-expressions
+//
+struct Optimizer::ShareState {
+    std::unordered_map<std::string, uint32_t> keys;         // structure -> id
+    std::unordered_map<const BaseNode *, uint32_t> ids;     // node -> id
+    std::vector<uint32_t> counts;                           // occurrences per id
+    std::vector<bool> pure;
+    std::vector<bool> seen;
+    std::vector<SharedExpression *> expressions;            // per id, created by the first occurrence
+    std::vector<SharedExpression *> *pShared;
+    Arena *pArena;
+    const uint64_t *pGeneration;
+
+    bool IsShareable(const BaseNode *node, uint32_t id) const {
+        // leaves are cheaper to evaluate than to share
+        return (node->NumChildren() > 0) && pure[id] && (counts[id] > 1);
+    }
+};
+
+BaseNode *Optimizer::ShareSubExpressions(BaseNode *root, Arena &arena, std::vector<SharedExpression *> &shared, const uint64_t *pGeneration) {
+    if (root == nullptr) {
+        return nullptr;
+    }
+    ShareState state;
+    state.pShared = &shared;
+    state.pArena = &arena;
+    state.pGeneration = pGeneration;
+
+    Identify(state, root);
+    CountDuplicates(state, root);
+    return Share(state, root);
+}
+
+//
+// Bottom up, nodes with the same structure and pure children get the same id
+// impure nodes always get a new id and are never shared
+//
+uint32_t Optimizer::Identify(ShareState &state, const BaseNode *node) {
+    std::string key;
+    bool pure = true;
+
+    key.push_back((char) node->Type());
+    switch (node->Type()) {
+        case kNodeType_Const : {
+            double value = static_cast<const ConstNode *>(node)->Value();
+            key.append((const char *) &value, sizeof(value));
+            break;
+        }
+        case kNodeType_ConstUser : {
+            size_t slot = static_cast<const ConstUserNode *>(node)->Slot();
+            key.append((const char *) &slot, sizeof(slot));
+            break;
+        }
+        case kNodeType_Func :
+            pure = static_cast<const FuncNode *>(node)->IsPure();
+            key.append(static_cast<const FuncNode *>(node)->Name());
+            key.push_back('\0');
+            break;
+        case kNodeType_NativeFunc :
+            pure = static_cast<const NativeFuncNode *>(node)->Function().pure;
+            key.append(static_cast<const NativeFuncNode *>(node)->Name());
+            key.push_back('\0');
+            break;
+        case kNodeType_BinOp :
+        case kNodeType_BoolOp :
+            key.push_back((char) static_cast<const BinOpNode *>(node)->Op());
+            break;
+        case kNodeType_Shared : {
+            const SharedExpression *expression = static_cast<const SharedNode *>(node)->Expression();
+            key.append((const char *) &expression, sizeof(expression));
+            break;
+        }
+        default:
+            break;
+    }
+
+    for (int i = 0; i < node->NumChildren(); i++) {
+        uint32_t childId = Identify(state, node->Child(i));
+        pure = pure && state.pure[childId];
+        key.append((const char *) &childId, sizeof(childId));
+    }
+
+    uint32_t id = (uint32_t) state.counts.size();
+    if (pure) {
+        auto it = state.keys.find(key);
+        if (it != state.keys.end()) {
+            id = it->second;
+        } else {
+            state.keys[key] = id;
+        }
+    }
+    if (id == state.counts.size()) {
+        state.counts.push_back(0);
+        state.pure.push_back(pure);
+        state.seen.push_back(false);
+        state.expressions.push_back(nullptr);
+    }
+    state.counts[id]++;
+    state.ids[node] = id;
+    return id;
+}
+
+//
+// Sub-trees inside a duplicate go away with the duplicate, they are not counted
+//
+void Optimizer::CountDuplicates(ShareState &state, const BaseNode *node) {
+    uint32_t id = state.ids[node];
+    if (state.IsShareable(node, id)) {
+        if (state.seen[id]) {
+            for (int i = 0; i < node->NumChildren(); i++) {
+                Uncount(state, node->Child(i));
+            }
+            return;
+        }
+        state.seen[id] = true;
+    }
+    for (int i = 0; i < node->NumChildren(); i++) {
+        CountDuplicates(state, node->Child(i));
+    }
+}
+
+void Optimizer::Uncount(ShareState &state, const BaseNode *node) {
+    state.counts[state.ids[node]]--;
+    for (int i = 0; i < node->NumChildren(); i++) {
+        Uncount(state, node->Child(i));
+    }
+}
+
+//
+// First occurrence becomes the shared expression, all occurrences are replaced by references
+//
+BaseNode *Optimizer::Share(ShareState &state, BaseNode *node) {
+    uint32_t id = state.ids[node];
+    bool shareable = state.IsShareable(node, id);
+    if (shareable && (state.expressions[id] != nullptr)) {
+        // duplicate, left for the arena
+        return new (*state.pArena) SharedNode(state.expressions[id], state.pGeneration);
+    }
+
+    for (int i = 0; i < node->NumChildren(); i++) {
+        node->SetChild(i, Share(state, node->Child(i)));
+    }
+    if (!shareable) {
+        return node;
+    }
+
+    auto expression = new (*state.pArena) SharedExpression();
+    expression->node = node;
+    state.expressions[id] = expression;
+    state.pShared->push_back(expression);
+    return new (*state.pArena) SharedNode(expression, state.pGeneration);
+}
@@ -0,0 +1,33 @@
+// See optimizer.cpp for more details
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "expsolver.h"
+
+namespace gnilk
+{
+    //
+    // Tree rewrites which keep the result bit-identical
+    //
+    class Optimizer {
+    public:
+        // Returns the optimized tree, new nodes are allocated from the arena the tree was built in
+        static BaseNode *Optimize(BaseNode *root, Arena &arena);
+        // Identical pure sub-trees are replaced by references to one shared expression, appended to 'shared'
+        static BaseNode *ShareSubExpressions(BaseNode *root, Arena &arena, std::vector<SharedExpression *> &shared, const uint64_t *pGeneration);
+    protected:
+        struct ShareState;
+        static BaseNode *OptimizeBinOp(BinOpNode *node, Arena &arena);
+        static BaseNode *OptimizeIf(IfOperatorNode *node);
+        static BaseNode *OptimizeNativeFunc(NativeFuncNode *node, Arena &arena);
+        static bool IsConst(const BaseNode *node, double &outValue);
+        static bool IsConstValue(const BaseNode *node, double value);
+        static bool IsIntegerValued(const BaseNode *node);
+
+        static uint32_t Identify(ShareState &state, const BaseNode *node);
+        static void CountDuplicates(ShareState &state, const BaseNode *node);
+        static void Uncount(ShareState &state, const BaseNode *node);
+        static BaseNode *Share(ShareState &state, BaseNode *node);
+    };
+}
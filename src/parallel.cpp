@@ -0,0 +1,157 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: parallel.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-18, 23:15
+Descr   : Work-stealing thread pool for evaluating large batches of
+          compiled expressions. The index range is split in chunks which
+          are dealt out as contiguous blocks, one block per thread. A
+          thread which runs out of work steals chunks from the back of
+          another thread's queue. Results are written by index, so the
+          output does not depend on the scheduling.
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 18.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include "compiledexpression.h"
+#include "parallel.h"
+
+using namespace gnilk;
+
+ParallelEvaluator::ParallelEvaluator(size_t numThreads, size_t chunkSize) : pending(0) {
+    if (numThreads == 0) {
+        numThreads = std::thread::hardware_concurrency();
+        if (numThreads == 0) {
+            numThreads = 1;
+        }
+    }
+    SetChunkSize(chunkSize);
+    for (size_t i = 0; i < numThreads; i++) {
+        queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    // The calling thread is worker 0
+    for (size_t i = 1; i < numThreads; i++) {
+        workers.push_back(std::thread(&ParallelEvaluator::WorkerMain, this, i));
+    }
+}
+
+ParallelEvaluator::~ParallelEvaluator() {
+    {
+        std::lock_guard<std::mutex> guard(jobLock);
+        stop = true;
+    }
+    jobStart.notify_all();
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+void ParallelEvaluator::Evaluate(const CompiledExpression * const *expressions, size_t count, const EvalContext &context, double *out) {
+    ForEach(count, [expressions, &context, out](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            out[i] = expressions[i]->Evaluate(context);
+        }
+    });
+}
+
+void ParallelEvaluator::Evaluate(const CompiledExpression &expression, const double *values, size_t stride, size_t nRows, double *out) {
+    ForEach(nRows, [&expression, values, stride, out](size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            out[row] = expression.Evaluate(&values[row * stride]);
+        }
+    });
+}
+
+void ParallelEvaluator::ForEach(size_t count, const std::function<void(size_t begin, size_t end)> &work) {
+    if (count == 0) {
+        return;
+    }
+    // Not worth waking anyone
+    if (workers.empty() || (count <= chunkSize)) {
+        work(0, count);
+        return;
+    }
+
+    size_t numChunks = (count + chunkSize - 1) / chunkSize;
+    size_t numQueues = queues.size();
+    {
+        std::lock_guard<std::mutex> guard(jobLock);
+        pWork = &work;
+        pending = numChunks;
+        // Contiguous blocks of chunks per queue, neighbouring items are evaluated by the same thread
+        for (size_t q = 0; q < numQueues; q++) {
+            size_t chunkBegin = (numChunks * q) / numQueues;
+            size_t chunkEnd = (numChunks * (q + 1)) / numQueues;
+            std::lock_guard<std::mutex> queueGuard(queues[q]->lock);
+            for (size_t c = chunkBegin; c < chunkEnd; c++) {
+                size_t end = (c + 1) * chunkSize;
+                queues[q]->ranges.push_back(Range { c * chunkSize, (end < count) ? end : count });
+            }
+        }
+        jobId++;
+    }
+    jobStart.notify_all();
+
+    WorkLoop(0);
+
+    std::unique_lock<std::mutex> lock(jobLock);
+    jobDone.wait(lock, [this]() { return pending == 0; });
+    pWork = nullptr;
+}
+
+void ParallelEvaluator::WorkerMain(size_t idxQueue) {
+    uint64_t lastJob = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(jobLock);
+            jobStart.wait(lock, [this, lastJob]() { return stop || (jobId != lastJob); });
+            if (stop) {
+                return;
+            }
+            lastJob = jobId;
+        }
+        WorkLoop(idxQueue);
+    }
+}
+
+void ParallelEvaluator::WorkLoop(size_t idxQueue) {
+    Range range;
+    while (Pop(idxQueue, range) || Steal(idxQueue, range)) {
+        (*pWork)(range.begin, range.end);
+        if (--pending == 0) {
+            std::lock_guard<std::mutex> guard(jobLock);
+            jobDone.notify_all();
+        }
+    }
+}
+
+bool ParallelEvaluator::Pop(size_t idxQueue, Range &range) {
+    Queue &queue = *queues[idxQueue];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.ranges.empty()) {
+        return false;
+    }
+    range = queue.ranges.front();
+    queue.ranges.pop_front();
+    return true;
+}
+
+//
+// Victims are tried in order starting with the next thread, the last chunk is taken - furthest away from the owner
+//
+bool ParallelEvaluator::Steal(size_t idxQueue, Range &range) {
+    for (size_t i = 1; i < queues.size(); i++) {
+        Queue &victim = *queues[(idxQueue + i) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.ranges.empty()) {
+            range = victim.ranges.back();
+            victim.ranges.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,73 @@
+// See parallel.cpp for more details
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bytecode.h"
+#include "compiledexpression.h"
+
+namespace gnilk
+{
+    // Default number of items per work unit
+    #define EXP_SOLVER_PARALLEL_CHUNK 256
+
+    //
+    // Evaluates many expressions, or one expression over many rows of bindings, on a work-stealing thread pool
+    // Results are written by index so the output order never depends on the scheduling
+    //
+    class ParallelEvaluator {
+    public:
+        // numThreads = 0 uses all hardware threads, the calling thread is one of them
+        explicit ParallelEvaluator(size_t numThreads = 0, size_t chunkSize = EXP_SOLVER_PARALLEL_CHUNK);
+        virtual ~ParallelEvaluator();
+        ParallelEvaluator(const ParallelEvaluator &) = delete;
+        ParallelEvaluator &operator=(const ParallelEvaluator &) = delete;
+
+        // out[i] = expressions[i]->Evaluate(context), the context is shared by all calls
+        void Evaluate(const CompiledExpression * const *expressions, size_t count, const EvalContext &context, double *out);
+        // out[row] = expression.Evaluate(&values[row * stride]), values are indexed by variable slot
+        void Evaluate(const CompiledExpression &expression, const double *values, size_t stride, size_t nRows, double *out);
+
+        // Runs work(begin, end) over [0, count) in chunks, returns when all chunks are done
+        // one call at a time, an evaluator is not shared between calling threads
+        void ForEach(size_t count, const std::function<void(size_t begin, size_t end)> &work);
+
+        size_t NumThreads() const { return workers.size() + 1; }
+        size_t ChunkSize() const { return chunkSize; }
+        void SetChunkSize(size_t chunkSize) { this->chunkSize = (chunkSize > 0) ? chunkSize : 1; }
+    protected:
+        struct Range {
+            size_t begin;
+            size_t end;
+        };
+        // One per thread, owner pops from the front and thieves take from the back
+        struct alignas(64) Queue {
+            std::mutex lock;
+            std::deque<Range> ranges;
+        };
+        void WorkerMain(size_t idxQueue);
+        void WorkLoop(size_t idxQueue);
+        bool Pop(size_t idxQueue, Range &range);
+        bool Steal(size_t idxQueue, Range &range);
+    protected:
+        size_t chunkSize;
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<Queue> > queues;   // [0] belongs to the calling thread
+
+        std::mutex jobLock;
+        std::condition_variable jobStart;
+        std::condition_variable jobDone;
+        uint64_t jobId = 0;
+        bool stop = false;
+        const std::function<void(size_t, size_t)> *pWork = nullptr;
+        std::atomic<size_t> pending;
+    };
+}
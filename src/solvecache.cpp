@@ -0,0 +1,112 @@
+/*-------------------------------------------------------------------------
+File    : $Archive: solvecache.cpp $
+Author  : $Author: FKling $
+Version : $Revision: 1 $
+Orginal : 2026-10-18, 22:00
+Descr   : Process wide cache of compiled expressions for ExpSolver::Solve.
+          Recurring expressions are tokenized, parsed and compiled once,
+          a compiled program is immutable and can be run by any number
+          of threads at the same time.
+
+Modified: $Date: $ by $Author: FKling $
+---------------------------------------------------------------------------
+
+\History
+- 18.10.26, FKling, Implementation
+
+---------------------------------------------------------------------------*/
+#include <functional>
+
+#include "bytecode.h"
+#include "solvecache.h"
+
+using namespace gnilk;
+
+SolveCache::SolveCache(size_t capacity, size_t numShards) : capacity(capacity) {
+    if (numShards == 0) {
+        numShards = 1;
+    }
+    // Capacity is split evenly, every shard holds at least one expression
+    size_t perShard = (capacity + numShards - 1) / numShards;
+    if (perShard == 0) {
+        perShard = 1;
+    }
+    for (size_t i = 0; i < numShards; i++) {
+        shards.push_back(std::unique_ptr<Shard>(new Shard()));
+        shards.back()->capacity = perShard;
+    }
+}
+
+SolveCache &SolveCache::Instance() {
+    static SolveCache cache;
+    return cache;
+}
+
+SolveCache::Shard &SolveCache::ShardFor(std::string_view expression) {
+    size_t hash = std::hash<std::string_view>()(expression);
+    return *shards[hash % shards.size()];
+}
+
+std::shared_ptr<const Program> SolveCache::Find(std::string_view expression) {
+    Shard &shard = ShardFor(expression);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.index.find(expression);
+    if (it == shard.index.end()) {
+        shard.misses++;
+        return nullptr;
+    }
+    shard.hits++;
+    // Move to front, list iterators and the key views stay valid
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return it->second->program;
+}
+
+//
+// Inserting an existing expression replaces the program, the least recently used expression is evicted when full
+//
+void SolveCache::Insert(std::string_view expression, std::shared_ptr<const Program> program) {
+    Shard &shard = ShardFor(expression);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto it = shard.index.find(expression);
+    if (it != shard.index.end()) {
+        it->second->program = program;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+    if (shard.lru.size() >= shard.capacity) {
+        shard.index.erase(shard.lru.back().expression);
+        shard.lru.pop_back();
+        shard.evictions++;
+    }
+    shard.lru.push_front(Entry { std::string(expression), program });
+    shard.index[shard.lru.front().expression] = shard.lru.begin();
+}
+
+void SolveCache::Clear() {
+    for (auto &shard: shards) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->index.clear();
+        shard->lru.clear();
+    }
+}
+
+SolveCache::Stats SolveCache::GetStats() const {
+    Stats stats;
+    for (auto &shard: shards) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        stats.hits += shard->hits;
+        stats.misses += shard->misses;
+        stats.evictions += shard->evictions;
+        stats.size += shard->lru.size();
+    }
+    return stats;
+}
+
+void SolveCache::ResetStats() {
+    for (auto &shard: shards) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->hits = 0;
+        shard->misses = 0;
+        shard->evictions = 0;
+    }
+}
@@ -0,0 +1,68 @@
+// See solvecache.cpp for more details
+#pragma once
+
+#include <stdint.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gnilk
+{
+    class Program;
+
+    // Default number of expressions kept by the process wide cache
+    #define EXP_SOLVER_SOLVE_CACHE_SIZE 1024
+    #define EXP_SOLVER_SOLVE_CACHE_SHARDS 16
+
+    //
+    // Bounded LRU cache of compiled expressions keyed by the expression text, thread safe
+    // Keys are spread over independently locked shards, each with its own LRU order
+    //
+    class SolveCache {
+    public:
+        struct Stats {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            size_t size = 0;
+        };
+    public:
+        SolveCache(size_t capacity = EXP_SOLVER_SOLVE_CACHE_SIZE, size_t numShards = EXP_SOLVER_SOLVE_CACHE_SHARDS);
+        virtual ~SolveCache() = default;
+
+        // Used by ExpSolver::Solve
+        static SolveCache &Instance();
+
+        // Returns nullptr on a miss, the program stays valid while the caller holds it
+        std::shared_ptr<const Program> Find(std::string_view expression);
+        void Insert(std::string_view expression, std::shared_ptr<const Program> program);
+        void Clear();
+
+        Stats GetStats() const;
+        void ResetStats();
+        size_t Capacity() const { return capacity; }
+    protected:
+        struct Entry {
+            std::string expression;
+            std::shared_ptr<const Program> program;
+        };
+        // Own cache line, shards don't share locks or counters
+        struct alignas(64) Shard {
+            mutable std::mutex lock;
+            std::list<Entry> lru;                                               // most recently used first
+            std::unordered_map<std::string_view, std::list<Entry>::iterator> index;  // views into the entries
+            size_t capacity = 0;
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+        };
+        Shard &ShardFor(std::string_view expression);
+    protected:
+        size_t capacity;
+        std::vector<std::unique_ptr<Shard> > shards;
+    };
+}
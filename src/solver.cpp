@@ -1,16 +1,38 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "expsolver.h"
 
 using namespace gnilk;
-static char *num2bin_grouped(unsigned int num, char *buffer, int maxlen) {
+static char *num2bin_grouped(uint64_t num, char *buffer, int maxlen) {
 	int idxStart = 0;
 
 	int i=0;
-	for (i=31;i>=0;i--) {
-		int bit = (num & (1<<i));
+	for (i=63;i>=0;i--) {
+		uint64_t bit = (num & (1ULL<<i));
 		if (bit != 0) break;
 	}
 
     int groups = 1 + (i+1)/4;
+    // No leading group when all 64 bits are used
+    if (groups > 16) groups = 16;
     memset(buffer,' ', maxlen);
 
     idxStart = (groups * 4 + groups-1);
@@ -19,7 +41,7 @@ static char *num2bin_grouped(unsigned int num, char *buffer, int maxlen) {
     int bit = 0;
     for(int i=0;i<groups;i++) {
         for(int i=0;i<4;i++) {
-            buffer[idxStart] = (num & (1 << bit)) ? '1' : '0';
+            buffer[idxStart] = (num & (1ULL << bit)) ? '1' : '0';
             idxStart--;
             bit++;
         }
@@ -31,12 +53,12 @@ static char *num2bin_grouped(unsigned int num, char *buffer, int maxlen) {
     return buffer;
 }
 
-static char *num2bin(unsigned int num, char *buffer, int maxlen) {
+static char *num2bin(uint64_t num, char *buffer, int maxlen) {
     int idxStart = 0;
 
     int i=0;
-    for (i=31;i>=0;i--) {
-        int bit = (num & (1<<i));
+    for (i=63;i>=0;i--) {
+        uint64_t bit = (num & (1ULL<<i));
         if (bit != 0) break;
     }
 
@@ -46,52 +68,469 @@ static char *num2bin(unsigned int num, char *buffer, int maxlen) {
     idxStart++;
 
     for(;i>=0;i--) {
-        buffer[idxStart] = (num & (1<<i))?'1':'0';
+        buffer[idxStart] = (num & (1ULL<<i))?'1':'0';
         idxStart++;
     }
     buffer[idxStart]='\0';
     return buffer;
 }
+static void PrintStats(const ExpSolverStats &stats) {
+    if (!ExpSolver::HasStats()) {
+        printf("stats: not available, build with EXP_SOLVER_STATS\n");
+        return;
+    }
+    static const char *typeNames[kNodeType_NumTypes] = {
+        "const", "variable", "function", "native", "binop", "boolop", "if", "shared"
+    };
+    printf("prepare: %.3f us\n", (double) stats.prepareNs / 1000.0);
+    printf("nodes: %zu (", stats.numNodes);
+    for (int i = 0; i < kNodeType_NumTypes; i++) {
+        printf("%s%s %zu", (i == 0) ? "" : ", ", typeNames[i], stats.nodesByType[i]);
+    }
+    printf(")\n");
+    printf("depth: %zu\n", stats.treeDepth);
+    printf("evaluations: %llu, total %.3f us, max %.3f us\n", (unsigned long long) stats.numEvaluations,
+           (double) stats.totalEvaluationNs / 1000.0, (double) stats.maxEvaluationNs / 1000.0);
+    printf("callbacks: %llu variable, %llu function\n", (unsigned long long) stats.numVariableCallbacks,
+           (unsigned long long) stats.numFunctionCallbacks);
+}
+
+static void FormatResult(std::string &out, int64_t value, bool printOld) {
+    char binary[96];
+    if (printOld) {
+        num2bin((uint64_t)value, binary, 80);
+    } else {
+        num2bin_grouped((uint64_t)value, binary, 96);
+    }
+    char line[160];
+    int length = snprintf(line, sizeof(line), "%lld, 0x%.llx, %%%s\n",(long long)value,(unsigned long long)value, binary);
+    out.append(line, (size_t) length);
+}
+
+static void PrintResult(int64_t value, bool printOld) {
+    std::string line;
+    FormatResult(line, value, printOld);
+    fputs(line.c_str(), stdout);
+}
+
+// "<message> '<token>' at <position>", without the parts the error does not have
+static void FormatError(std::string &out, const ExpSolverError &error) {
+    out += ExpSolver::ErrorString(error.code);
+    if (!error.token.empty()) {
+        out += " '";
+        out += error.token;
+        out += "'";
+    }
+    if (error.position != ExpSolverError::kNoPosition) {
+        out += " at ";
+        out += std::to_string(error.position);
+    }
+}
+
+static void PrintError(const ExpSolverError &error) {
+    std::string line = "[!] Error: ";
+    FormatError(line, error);
+    line += "\n";
+    fputs(line.c_str(), stdout);
+}
+
+//
+// Batch mode, one expression per line and one result line per expression
+// a solver is reused for all lines it solves so the arena and parser storage are allocated once
+//
+struct Batch {
+    ExpSolver solver { "" };
+    bool useInt = false;
+    bool printOld = false;
+    size_t numErrors = 0;
+    std::string output;         // results not yet written
+
+    // Same functions as Solve
+    Batch() { solver.EnableBuiltInFunctions(); }
+};
+
+// Input is split in chunks of about this size, at line boundaries
+static const size_t kBatchChunkSize = 1024 * 1024;
+// Size of the stdout buffer
+static const size_t kBatchOutputSize = 64 * 1024;
+
+static void BatchLine(Batch &batch, const char *line, size_t length) {
+    size_t start = 0;
+    while ((start < length) && isspace((unsigned char) line[start])) start++;
+    while ((length > start) && isspace((unsigned char) line[length - 1])) length--;
+
+    // Blank lines fail like any other empty expression, there is one result line per input line
+    std::string_view expression(line + start, length - start);
+    bool isInt = batch.useInt && (expression.find('.') == std::string_view::npos);
+    batch.solver.SetExpression(expression);
+    if (!batch.solver.Prepare(isInt ? kNumericMode_Int64 : kNumericMode_Double)) {
+        batch.output += "error: ";
+        FormatError(batch.output, batch.solver.GetError());
+        batch.output += "\n";
+        batch.numErrors++;
+    } else if (batch.solver.GetNumVariables() > 0) {
+        // Same as Solve, there is nothing to provide variables
+        ExpSolverError error;
+        error.code = kExpError_NoVariableCallback;
+        error.token = batch.solver.GetVariableName(0);
+        batch.output += "error: ";
+        FormatError(batch.output, error);
+        batch.output += "\n";
+        batch.numErrors++;
+    } else {
+        FormatResult(batch.output, batch.solver.EvaluateInt(), batch.printOld);
+    }
+}
+
+// All lines in a chunk, the last one may lack the new line
+static void BatchLines(Batch &batch, const char *data, size_t size) {
+    const char *ptr = data;
+    const char *end = data + size;
+    const char *newLine;
+    while ((newLine = (const char *) memchr(ptr, '\n', end - ptr)) != nullptr) {
+        BatchLine(batch, ptr, newLine - ptr);
+        ptr = newLine + 1;
+    }
+    // Nothing after the new line ending the chunk
+    if (ptr < end) {
+        BatchLine(batch, ptr, end - ptr);
+    }
+}
+
+//
+// Splits the input in chunks of whole lines, regular files are mapped - anything else is read
+//
+class BatchInput {
+public:
+    BatchInput() = default;
+    ~BatchInput() {
+#ifndef WIN32
+        if (mapped != nullptr) {
+            munmap(mapped, mappedSize);
+        }
+#endif
+        if ((file != nullptr) && (file != stdin)) {
+            fclose(file);
+        }
+    }
+
+    bool Open(const char *filename) {
+        if ((filename == nullptr) || !strcmp(filename, "-")) {
+            file = stdin;
+            return true;
+        }
+#ifndef WIN32
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0) {
+            printf("[!] Error: Unable to open '%s'\n", filename);
+            return false;
+        }
+        struct stat st;
+        if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode)) {
+            size_t size = (size_t) st.st_size;
+            void *data = (size > 0) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+            if ((size == 0) || (data != MAP_FAILED)) {
+                if (size > 0) {
+                    madvise(data, size, MADV_SEQUENTIAL);
+                    mapped = (char *) data;
+                    mappedSize = size;
+                }
+                close(fd);
+                return true;
+            }
+        }
+        close(fd);
+#endif
+        file = fopen(filename, "rb");
+        if (file == nullptr) {
+            printf("[!] Error: Unable to open '%s'\n", filename);
+            return false;
+        }
+        return true;
+    }
+
+    // Next chunk, points into the mapped file or 'storage' - false at the end of the input
+    bool Next(std::string &storage, const char **data, size_t *size) {
+        if (file == nullptr) {
+            if (offset >= mappedSize) {
+                return false;
+            }
+            size_t end = offset + kBatchChunkSize;
+            if (end >= mappedSize) {
+                end = mappedSize;
+            } else {
+                const char *newLine = (const char *) memchr(mapped + end, '\n', mappedSize - end);
+                end = (newLine != nullptr) ? (newLine - mapped) + 1 : mappedSize;
+            }
+            *data = mapped + offset;
+            *size = end - offset;
+            offset = end;
+            return true;
+        }
+
+        // Read until the chunk holds at least one complete line, the partial line goes to the next chunk
+        storage.swap(pending);
+        pending.clear();
+        size_t lastNewLine = std::string::npos;
+        while (!endOfFile) {
+            size_t used = storage.size();
+            storage.resize(used + kBatchChunkSize);
+            size_t nRead = fread(&storage[used], 1, kBatchChunkSize, file);
+            storage.resize(used + nRead);
+            if (nRead == 0) {
+                endOfFile = true;
+                break;
+            }
+            lastNewLine = storage.rfind('\n');
+            if (lastNewLine != std::string::npos) {
+                break;
+            }
+        }
+        if (!endOfFile && (lastNewLine != std::string::npos)) {
+            pending.assign(storage, lastNewLine + 1, std::string::npos);
+            storage.resize(lastNewLine + 1);
+        }
+        if (storage.empty()) {
+            return false;
+        }
+        *data = storage.data();
+        *size = storage.size();
+        return true;
+    }
+protected:
+    FILE *file = nullptr;
+    char *mapped = nullptr;
+    size_t mappedSize = 0;
+    size_t offset = 0;
+    std::string pending;
+    bool endOfFile = false;
+};
+
+//
+// Chunks are solved by the workers in any order, the writer puts them back in input order
+//
+struct BatchChunk {
+    size_t seq;
+    std::string storage;
+    const char *data;
+    size_t size;
+    std::string output;
+};
+
+static size_t RunBatchParallel(BatchInput &input, size_t numThreads, bool useInt, bool printOld) {
+    std::mutex lock;
+    std::condition_variable workReady;
+    std::condition_variable chunkDone;
+    std::condition_variable spaceFree;
+    std::deque<std::unique_ptr<BatchChunk> > work;
+    std::map<size_t, std::unique_ptr<BatchChunk> > done;       // reorder buffer
+    // Bounds the memory used by chunks read but not written
+    const size_t maxInFlight = numThreads * 4;
+    size_t inFlight = 0;
+    size_t numChunks = 0;
+    size_t numErrors = 0;
+    bool endOfInput = false;
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < numThreads; i++) {
+        workers.emplace_back([&]() {
+            Batch batch;
+            batch.useInt = useInt;
+            batch.printOld = printOld;
+            for (;;) {
+                std::unique_ptr<BatchChunk> chunk;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    workReady.wait(guard, [&]() { return !work.empty() || endOfInput; });
+                    if (work.empty()) {
+                        break;
+                    }
+                    chunk = std::move(work.front());
+                    work.pop_front();
+                }
+                BatchLines(batch, chunk->data, chunk->size);
+                chunk->output.swap(batch.output);
+                batch.output.clear();
+                std::lock_guard<std::mutex> guard(lock);
+                done[chunk->seq] = std::move(chunk);
+                chunkDone.notify_one();
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            numErrors += batch.numErrors;
+        });
+    }
+
+    std::thread writer([&]() {
+        for (size_t next = 0; ; next++) {
+            std::unique_ptr<BatchChunk> chunk;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                chunkDone.wait(guard, [&]() { return (done.count(next) > 0) || (endOfInput && (next == numChunks)); });
+                if (done.count(next) == 0) {
+                    break;
+                }
+                chunk = std::move(done[next]);
+                done.erase(next);
+            }
+            fwrite(chunk->output.data(), 1, chunk->output.size(), stdout);
+            std::lock_guard<std::mutex> guard(lock);
+            inFlight--;
+            spaceFree.notify_one();
+        }
+    });
+
+    for (;;) {
+        auto chunk = std::make_unique<BatchChunk>();
+        if (!input.Next(chunk->storage, &chunk->data, &chunk->size)) {
+            break;
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        spaceFree.wait(guard, [&]() { return inFlight < maxInFlight; });
+        chunk->seq = numChunks++;
+        inFlight++;
+        work.push_back(std::move(chunk));
+        workReady.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        endOfInput = true;
+    }
+    workReady.notify_all();
+    chunkDone.notify_all();
+    for (auto &worker: workers) {
+        worker.join();
+    }
+    writer.join();
+    return numErrors;
+}
+
+static int RunBatch(const char *filename, size_t numThreads, bool useInt, bool printOld) {
+    // Results are written in large blocks
+    static char outBuffer[kBatchOutputSize];
+    setvbuf(stdout, outBuffer, _IOFBF, sizeof(outBuffer));
+
+    BatchInput input;
+    if (!input.Open(filename)) {
+        fflush(stdout);
+        return 1;
+    }
+    size_t numErrors = 0;
+    if (numThreads > 1) {
+        numErrors = RunBatchParallel(input, numThreads, useInt, printOld);
+    } else {
+        Batch batch;
+        batch.useInt = useInt;
+        batch.printOld = printOld;
+        std::string storage;
+        const char *data = nullptr;
+        size_t size = 0;
+        while (input.Next(storage, &data, &size)) {
+            BatchLines(batch, data, size);
+            fwrite(batch.output.data(), 1, batch.output.size(), stdout);
+            batch.output.clear();
+        }
+        numErrors = batch.numErrors;
+    }
+    fflush(stdout);
+    return (numErrors == 0) ? 0 : 1;
+}
+
 static int Usage(char *name) {
     printf("Usage: %s [options] <expression>\n", name);
+    printf("       %s [options] --batch [file|-]\n", name);
     printf("Solves normal expressions, like: '4+5*3/7'\n");
     printf("Prefix supported:\n");
     printf("  %% - binary\n");
     printf("  $/x - hex\n");
     printf("Options:\n");
     printf(" --old   prints binary as a flat (ungrouped) string\n");
+    printf(" --stats prints prepare and evaluation statistics\n");
+    printf(" --batch solves one expression per line from a file or stdin, one result line each\n");
+    printf("    -j N solves batches on N threads (0 - one per hardware thread), results stay in input order, also -jN\n");
+    printf(" --int   evaluates expressions without a '.' with 64 bit integers, the output is exact\n");
+    printf("         the default are doubles, truncated to an integer for the output\n");
     printf("    -h   this stuff..\n");
     return 0;
 }
 
 int main(int argc, char **argv) {
-	double tmp;
+	int64_t tmp = 0;
     bool printOld = false;
+    bool useInt = false;
+    bool printStats = false;
+    bool batchMode = false;
+    size_t numThreads = 1;
+    // The expression, or the batch file - stdin when missing or '-'
     char *expr = nullptr;
 
     for(int i=1;i<argc;i++) {
         if (!strcmp(argv[i],"--old")) {
             printOld = true;
+        } else if (!strcmp(argv[i],"--int")) {
+            useInt = true;
+        } else if (!strcmp(argv[i],"--stats")) {
+            printStats = true;
+        } else if (!strcmp(argv[i],"--batch")) {
+            batchMode = true;
+        } else if (!strncmp(argv[i],"-j",2)) {
+            // '-j N' or '-jN'
+            const char *count = (argv[i][2] != '\0') ? &argv[i][2] : ((i + 1 < argc) ? argv[++i] : "");
+            char *countEnd = nullptr;
+            numThreads = strtoul(count, &countEnd, 10);
+            if (!isdigit((unsigned char) count[0]) || (*countEnd != '\0')) {
+                printf("[!] Error: -j expects a number of threads\n");
+                Usage(argv[0]);
+                return 1;
+            }
+            if (numThreads == 0) {
+                numThreads = std::thread::hardware_concurrency();
+            }
         } else if (!strcmp(argv[i],"-h")) {
             return Usage(argv[0]);
-        } else {
+        } else if (expr == nullptr) {
             expr = argv[i];
+        } else {
+            printf("[!] Error: Unexpected argument '%s'\n", argv[i]);
+            return 1;
         }
     }
+    if (batchMode) {
+        return RunBatch(expr, numThreads, useInt, printOld);
+    }
     if (expr == nullptr) {
         return Usage(argv[0]);
     }
 
-	ExpSolver::Solve(&tmp, expr);
-
-    if (printOld) {
-        char binary[48];
-        num2bin((int)tmp, binary, 48);
-        printf("%d, 0x%.x, %%%s\n",(int)tmp,(int)tmp, binary);
+    // Doubles unless asked for integers, fractions need doubles - the output is an integer either way
+    bool isDouble = !useInt || (strchr(expr, '.') != nullptr);
+    ExpSolverStats stats;
+    ExpSolverError error;
+    bool ok;
+    if (printStats) {
+        // Statistics belong to a solver instance, Solve keeps none
+        ExpSolver exp(expr);
+        exp.EnableBuiltInFunctions();
+        ok = exp.Prepare(isDouble ? kNumericMode_Double : kNumericMode_Int64);
+        if (ok) {
+            tmp = exp.EvaluateInt();
+        }
+        error = exp.GetError();
+        stats = exp.GetStats();
+    } else if (isDouble) {
+        double value = 0.0;
+        ok = ExpSolver::Solve(&value, expr, &error);
+        tmp = intops::FromDouble(value, kNumericMode_Int64);
     } else {
-        char groupedBinary[64];
-        num2bin_grouped((int)tmp, groupedBinary, 64);
-        printf("%d, 0x%.x, %%%s\n",(int)tmp,(int)tmp, groupedBinary);
+        ok = ExpSolver::SolveInt(&tmp, expr, kNumericMode_Int64, &error);
+    }
+    if (!ok) {
+        PrintError(error);
+        return 1;
+    }
+
+    PrintResult(tmp, printOld);
+    if (printStats) {
+        PrintStats(stats);
     }
 
     return 0;
@@ -10,6 +10,9 @@ Modified: $Date: $ by $Author: FKling $
 ---------------------------------------------------------------------------
 
 \History
+- 19.10.26, FKling, Reset to tokenize another input without reallocating, operator lookup by first char
+- 18.10.26, FKling, Look ahead more than one token
+- 18.10.26, FKling, Tokens are stored as spans over the input, no token size limit
 - 23.09.22, FKling, Multi char operators
 - 14.03.14, FKling, published on github
 - 25.10.09, FKling, Implementation
@@ -17,6 +20,7 @@ Modified: $Date: $ by $Author: FKling $
 ---------------------------------------------------------------------------*/
 
 #include <stdlib.h>
+#include <ctype.h>
 #include <vector>
 #include <string>
 #include <string.h>
@@ -25,53 +29,90 @@ Modified: $Date: $ by $Author: FKling $
 
 using namespace gnilk;
 
-Tokenizer::Tokenizer(const char *sInput, const char *sOperators) {
+Tokenizer::Tokenizer(const char *sInput, const char *sOperators, kTokenizerMode mode) {
     iTokenIndex = 0;
+    this->mode = mode;
+    this->sInput = sInput;
     PrepareOperators(sOperators);
     PrepareTokens(sInput);
 }
 
-Tokenizer::Tokenizer(const char *sInput) {
+Tokenizer::Tokenizer(const char *sInput) : Tokenizer(sInput, " ", kTokenizerMode_Copy) {
+}
+
+void Tokenizer::Reset(const char *sInput) {
     iTokenIndex = 0;
-    PrepareOperators(" ");
+    this->sInput = sInput;
+    spans.clear();
+    tokens.clear();
     PrepareTokens(sInput);
 }
 
 bool Tokenizer::HasMore() const {
-    return (iTokenIndex < tokens.size());
+    return (iTokenIndex < spans.size());
 
 }
 
 const char *Tokenizer::Next() {
-    if (iTokenIndex > tokens.size()) return nullptr;
+    if (iTokenIndex >= spans.size()) return nullptr;
+    MaterializeTokens();
     return tokens[iTokenIndex++].c_str();
 }
 
 const char *Tokenizer::Previous() {
-    if (iTokenIndex > 0) return tokens[--iTokenIndex].c_str();
-    return nullptr;
+    if (iTokenIndex == 0) return nullptr;
+    MaterializeTokens();
+    return tokens[--iTokenIndex].c_str();
 }
 
 const char *Tokenizer::Peek() const {
-    if (iTokenIndex < tokens.size()) return tokens[iTokenIndex].c_str();
-    return nullptr;
+    if (iTokenIndex >= spans.size()) return nullptr;
+    MaterializeTokens();
+    return tokens[iTokenIndex].c_str();
+}
+
+std::string_view Tokenizer::NextView() {
+    if (iTokenIndex >= spans.size()) return std::string_view();
+    return View(iTokenIndex++);
+}
+
+std::string_view Tokenizer::PeekView() const {
+    if (iTokenIndex >= spans.size()) return std::string_view();
+    return View(iTokenIndex);
+}
+
+std::string_view Tokenizer::PeekView(size_t ahead) const {
+    if ((iTokenIndex + ahead) >= spans.size()) return std::string_view();
+    return View(iTokenIndex + ahead);
+}
+
+std::string_view Tokenizer::View(size_t idx) const {
+    // In copy mode the input is not guaranteed to be alive
+    if (mode == kTokenizerMode_Copy) {
+        return std::string_view(tokens[idx]);
+    }
+    return std::string_view(sInput + spans[idx].offset, spans[idx].length);
 }
 
 int Tokenizer::Case(const char *sValue, const char *sInput) {
-    Tokenizer tokens(sInput);// = new Tokenizer(sInput);
+    Tokenizer tokens(sInput, " ", kTokenizerMode_Spans);
 
     int idx = 0;
     while (tokens.HasMore()) {
-        if (!strcmp(sValue, tokens.Next())) return idx;
+        if (tokens.NextView() == sValue) return idx;
         idx++;
     }
     return -1;
 }
 
 
-bool Tokenizer::IsOperator(const char *input, int &outSzOperator) {
-    for (auto s: operators) {
-        if (!strncmp(s.c_str(), input, s.size())) {
+bool Tokenizer::IsOperator(const char *input, size_t &outSzOperator) const {
+    // Most characters can not start an operator
+    if (!operatorStart[(unsigned char) *input]) {
+        return false;
+    }
+    for (const auto &s: operators) {
+        if ((s[0] == *input) && !strncmp(s.c_str(), input, s.size())) {
             outSzOperator = s.size();
             return true;
         }
@@ -80,75 +121,79 @@ bool Tokenizer::IsOperator(const char *input, int &outSzOperator) {
 }
 
 void Tokenizer::PrepareOperators(const char *input) {
-    char tmp[256];
-    char *parsepoint = (char *)input;
-    while (GetNextTokenNoOperator(tmp, 256, &parsepoint)) {
-        operators.push_back(std::string(tmp));
+    TokenSpan span;
+    const char *parsepoint = input;
+    while (GetNextSpanNoOperator(span, &parsepoint, input)) {
+        operators.push_back(std::string(input + span.offset, span.length));
+        operatorStart[(unsigned char) input[span.offset]] = true;
     }
 }
 
 
 void Tokenizer::PrepareTokens(const char *input) {
-    char tmp[256];
-    char *parsepoint = (char *) input;
-    while (GetNextToken(tmp, 256, &parsepoint)) {
-        tokens.push_back(std::string(tmp));
+    TokenSpan span;
+    const char *parsepoint = input;
+    while (GetNextSpan(span, &parsepoint, input)) {
+        spans.push_back(span);
+    }
+    if (mode == kTokenizerMode_Copy) {
+        MaterializeTokens();
+        this->sInput = nullptr;
     }
 }
 
-char *Tokenizer::GetNextToken(char *dst, int nMax, char **input) {
+//
+// Copies the spans to strings, only done in copy mode or when using the 'const char *' interface in span mode
+//
+void Tokenizer::MaterializeTokens() const {
+    if (tokens.size() == spans.size()) {
+        return;
+    }
+    tokens.reserve(spans.size());
+    for (const auto &span: spans) {
+        tokens.push_back(std::string(sInput + span.offset, span.length));
+    }
+}
+
+bool Tokenizer::GetNextSpan(TokenSpan &dst, const char **input, const char *base) const {
 
     if (!SkipWhiteSpace(input)) {
-        return nullptr;
+        return false;
     }
 
-    int szOperator = 0;
+    const char *start = *input;
+    size_t szOperator = 0;
 
-    int i = 0;
     if (IsOperator(*input, szOperator)) {
-        strncpy(dst, *input, szOperator);
         (*input) += szOperator;
-        i = szOperator;
+        dst.kind = kTokenKind_Operator;
     } else {
         while (!isspace(**input) && !IsOperator(*input, szOperator) && (**input != '\0')) {
-            dst[i++] = **input;
-
-            // This is a developer problem, ergo - safe to exit..
-            if (i >= nMax) {
-                fprintf(stderr, "ERR: GetNextToken, token size larger than buffer (>nMax)\n");
-                exit(1);
-            }
-
-
             (*input)++;
         }
+        dst.kind = kTokenKind_Text;
     }
-    dst[i] = '\0';
-    return dst;
+    dst.offset = start - base;
+    dst.length = *input - start;
+    return true;
 }
 
-char *Tokenizer::GetNextTokenNoOperator(char *dst, int nMax, char **input) {
+bool Tokenizer::GetNextSpanNoOperator(TokenSpan &dst, const char **input, const char *base) const {
     if (!SkipWhiteSpace(input)) {
-        return nullptr;
+        return false;
     }
 
-    int i = 0;
+    const char *start = *input;
     while (!isspace(**input) && (**input != '\0')) {
-        dst[i++] = **input;
-
-        // This is a developer problem, ergo - safe to exit..
-        if (i >= nMax) {
-            fprintf(stderr, "ERR: GetNextToken, token size larger than buffer (>nMax)\n");
-            exit(1);
-        }
-
         (*input)++;
     }
-    dst[i] = '\0';
-    return dst;
+    dst.kind = kTokenKind_Text;
+    dst.offset = start - base;
+    dst.length = *input - start;
+    return true;
 }
 
-bool Tokenizer::SkipWhiteSpace(char **input) {
+bool Tokenizer::SkipWhiteSpace(const char **input) const {
     if (**input == '\0') {
         return false;
     }
@@ -159,6 +204,4 @@ bool Tokenizer::SkipWhiteSpace(char **input) {
         return false;    // only trailing space
     }
     return true;
-}
-
-
+}
\ No newline at end of file
@@ -4,14 +4,31 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 
 namespace gnilk
 {
+    typedef enum {
+        kTokenKind_Text,
+        kTokenKind_Operator,
+    } kTokenKind;
+
+    // A token is a span over the tokenizer input, no data is copied
+    struct TokenSpan {
+        size_t offset;
+        size_t length;
+        kTokenKind kind;
+    };
 
 	class Tokenizer {
+	public:
+        typedef enum {
+            kTokenizerMode_Copy,        // tokens are copied to strings, input can be released after construction
+            kTokenizerMode_Spans,       // tokens are spans over the input, input must outlive the tokenizer
+        } kTokenizerMode;
 	public:
 		explicit Tokenizer(const char *sInput);
-		Tokenizer(const char *sInput, const char *sOperators);
+		Tokenizer(const char *sInput, const char *sOperators, kTokenizerMode mode = kTokenizerMode_Copy);
 		virtual ~Tokenizer() = default;
 
 		bool HasMore() const;
@@ -19,19 +36,35 @@ namespace gnilk
 		const char *Next();
 		const char *Peek() const;
 
+		// Zero-copy access, the views points into the input buffer - returns an empty view when out of tokens
+		std::string_view NextView();
+		std::string_view PeekView() const;
+		// Token 'ahead' positions after the next token, PeekView(0) == PeekView()
+		std::string_view PeekView(size_t ahead) const;
+		const std::vector<TokenSpan> &Spans() const { return spans; }
+
+		// Tokenizes a new input with the same operators, the token storage is reused
+		void Reset(const char *sInput);
+
 		static int Case(const char *sValue, const char *sInput);
 
     protected:
-        bool IsOperator(const char *input, int &outSzOperator);
-        bool SkipWhiteSpace(char **input);
-        char *GetNextToken(char *dst, int nMax, char **input);
-        char *GetNextTokenNoOperator(char *dst, int nMax, char **input);
+        bool IsOperator(const char *input, size_t &outSzOperator) const;
+        bool SkipWhiteSpace(const char **input) const;
+        bool GetNextSpan(TokenSpan &dst, const char **input, const char *base) const;
+        bool GetNextSpanNoOperator(TokenSpan &dst, const char **input, const char *base) const;
         void PrepareOperators(const char *operators);
         void PrepareTokens(const char *input);
+        void MaterializeTokens() const;
+        std::string_view View(size_t idx) const;
     protected:
+        kTokenizerMode mode;
+        const char *sInput;
         std::vector<std::string> operators;
-        std::vector<std::string> tokens;
+        bool operatorStart[256] = {};       // first characters of all operators
+        std::vector<TokenSpan> spans;
+        mutable std::vector<std::string> tokens;
         size_t iTokenIndex;
 
 	};
-}
\ No newline at end of file
+}
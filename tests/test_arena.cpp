@@ -0,0 +1,88 @@
+//
+// Created by gnilk on 18.10.26.
+//
+#include <testinterface.h>
+#include <stdint.h>
+#include <string.h>
+#include "../src/arena.h"
+#include "../src/expsolver.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_arena(ITesting *t);
+    DLL_EXPORT int test_arena_alloc(ITesting *t);
+    DLL_EXPORT int test_arena_reset(ITesting *t);
+    DLL_EXPORT int test_arena_shared(ITesting *t);
+}
+
+int test_arena(ITesting *t) {
+    return kTR_Pass;
+}
+
+int test_arena_alloc(ITesting *t) {
+    Arena arena(64);
+    char *a = (char *) arena.Alloc(1, 1);
+    double *b = (double *) arena.Alloc(sizeof(double), alignof(double));
+    TR_ASSERT(t, ((uintptr_t) b % alignof(double)) == 0);
+    TR_ASSERT(t, (char *) b > a);
+    *b = 1.0;
+
+    // Larger than a block
+    char *big = (char *) arena.Alloc(1000, 1);
+    memset(big, 0xaa, 1000);
+    TR_ASSERT(t, arena.BytesReserved() >= 1000);
+
+    const char *str = arena.StrDup(std::string_view("hello world", 5));
+    TR_ASSERT(t, !strcmp(str, "hello"));
+    TR_ASSERT(t, *b == 1.0);
+    return kTR_Pass;
+}
+
+int test_arena_reset(ITesting *t) {
+    Arena arena(128);
+    for (int i = 0; i < 100; i++) {
+        arena.Alloc(100);
+    }
+    TR_ASSERT(t, arena.BytesUsed() == 100 * 100);
+    arena.Reset();
+    TR_ASSERT(t, arena.BytesUsed() == 0);
+    TR_ASSERT(t, arena.BytesReserved() == 128);
+
+    // Solvers reset their own arena when preparing again
+    ExpSolver exp("1 + 2*3");
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 7.0);
+    return kTR_Pass;
+}
+
+//
+// Many solvers allocating from one caller supplied arena
+//
+int test_arena_shared(ITesting *t) {
+    Arena arena;
+    ExpSolver *solvers[16];
+    double values[16];
+    for (int i = 0; i < 16; i++) {
+        solvers[i] = new ExpSolver("sqrt(16) + t*2 + max(1, 2, 3)", &arena);
+        solvers[i]->EnableBuiltInFunctions();
+        TR_ASSERT(t, solvers[i]->Prepare());
+        values[i] = i;
+        solvers[i]->BindVariable(0, &values[i]);
+    }
+    size_t used = arena.BytesUsed();
+    TR_ASSERT(t, used > 0);
+    for (int i = 0; i < 16; i++) {
+        TR_ASSERT(t, solvers[i]->Evaluate() == 4 + 2.0*i + 3);
+        TR_ASSERT(t, solvers[i]->Optimize());
+        TR_ASSERT(t, solvers[i]->Evaluate() == 4 + 2.0*i + 3);
+    }
+    // The solvers never release the arena memory
+    TR_ASSERT(t, arena.BytesUsed() >= used);
+    for (int i = 0; i < 16; i++) {
+        delete solvers[i];
+    }
+    TR_ASSERT(t, arena.BytesUsed() >= used);
+    return kTR_Pass;
+}
@@ -0,0 +1,222 @@
+//
+// Created by gnilk on 18.10.26.
+//
+#include <testinterface.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "../src/expsolver.h"
+#include "../src/batchkernels.h"
+#include "../src/bytecode.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_batch(ITesting *t);
+    DLL_EXPORT int test_batch_kernels(ITesting *t);
+    DLL_EXPORT int test_batch_identical(ITesting *t);
+    DLL_EXPORT int test_batch_callbacks(ITesting *t);
+    DLL_EXPORT int test_batch_columnfunctions(ITesting *t);
+}
+
+extern "C" {
+    static double varCallBack(void *pUser, const char *data, int *bOk_out);
+    static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out);
+    static void functionBatchCallBack(void *pUser, const char *data, int args, const double * const *arg, size_t nRows, double *out, int *bOk_out);
+}
+
+// Used for the row-by-row reference, pUser points to the current row values (a, b)
+static double varCallBack(void *pUser, const char *data, int *bOk_out) {
+    auto row = (const double *)pUser;
+    *bOk_out = 1;
+    if (!strcmp(data, "a")) return row[0];
+    if (!strcmp(data, "b")) return row[1];
+    if (!strcmp(data, "k")) return 2.5;
+    *bOk_out = 0;
+    return 0;
+}
+
+static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out) {
+    *bOk_out = 1;
+    if (!strcmp(data, "max") && (args == 2)) {
+        return arg[0] > arg[1] ? arg[0] : arg[1];
+    }
+    *bOk_out = 0;
+    return 0.0;
+}
+
+int test_batch(ITesting *t) {
+    return kTR_Pass;
+}
+
+int test_batch_kernels(ITesting *t) {
+    // Odd count to exercise the scalar tails
+    static const size_t n = 37;
+    double left[n], right[n], outScalar[n], outBest[n];
+    for (size_t i = 0; i < n; i++) {
+        left[i] = (double)i * 1.37 - 20.0;
+        right[i] = 13.0 - (double)i * 0.71;
+    }
+    right[3] = NAN;
+    left[5] = NAN;
+
+    auto &scalar = kernels::GetScalarKernels();
+    auto &best = kernels::GetKernels();
+    for (int op = kOpCode_Add; op < kOpCode_NumOpCodes; op++) {
+        scalar.binop[op](outScalar, left, right, n);
+        best.binop[op](outBest, left, right, n);
+        TR_ASSERT(t, !memcmp(outScalar, outBest, sizeof(outScalar)));
+    }
+    scalar.select(outScalar, left, right, left, n);
+    best.select(outBest, left, right, left, n);
+    TR_ASSERT(t, !memcmp(outScalar, outBest, sizeof(outScalar)));
+    return kTR_Pass;
+}
+
+int test_batch_identical(ITesting *t) {
+    static const char *expressions[] = {
+        "a+b*2-1",
+        "a/b",
+        "a > b ? a*2 : b-1",
+        "a < 3 ? 1 : a < 10 ? 2 : 3",
+        "(a << 2) + (b >> 1)",
+        "max(a, b) * k",
+        "k",
+        "17",
+        nullptr,
+    };
+    // Not a multiple of the block size
+    static const size_t nRows = 1000;
+    std::vector<double> a(nRows), b(nRows), out(nRows);
+    for (size_t i = 0; i < nRows; i++) {
+        a[i] = (double)i * 0.25 - 50.0;
+        b[i] = (double)(i % 17) + 0.5;
+    }
+    BatchColumn columns[] = { { "a", a.data() }, { "b", b.data() } };
+
+    for (int i = 0; expressions[i] != nullptr; i++) {
+        double row[2];
+        ExpSolver exp(expressions[i]);
+        exp.RegisterUserVariableCallback(varCallBack, row);
+        exp.RegisterUserFunctionCallback(functionCallBack, nullptr);
+        TR_ASSERT(t, exp.Prepare());
+        TR_ASSERT(t, exp.EvaluateBatch(out.data(), nRows, columns, 2));
+
+        for (size_t r = 0; r < nRows; r++) {
+            row[0] = a[r];
+            row[1] = b[r];
+            double expected = exp.Evaluate();
+            TR_ASSERT(t, !memcmp(&expected, &out[r], sizeof(double)));
+        }
+    }
+    return kTR_Pass;
+}
+
+int test_batch_callbacks(ITesting *t) {
+    // No columns at all, everything through the callbacks
+    double row[2] = { 4.0, 1.0 };
+    double out[3];
+    ExpSolver exp("a+k");
+    exp.RegisterUserVariableCallback(varCallBack, row);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.EvaluateBatch(out, 3, nullptr, 0));
+    TR_ASSERT(t, out[0] == 6.5);
+    TR_ASSERT(t, out[2] == 6.5);
+    return kTR_Pass;
+}
+
+// Column version of 'mid', counts the calls in pUser - other functions fall back to the per row callback
+static void functionBatchCallBack(void *pUser, const char *data, int args, const double * const *arg, size_t nRows, double *out, int *bOk_out) {
+    *bOk_out = 0;
+    if (strcmp(data, "mid") || (args != 2)) {
+        return;
+    }
+    for (size_t i = 0; i < nRows; i++) {
+        out[i] = (arg[0][i] + arg[1][i]) * 0.5;
+    }
+    (*(int *)pUser)++;
+    *bOk_out = 1;
+}
+
+struct ColumnCalls {
+    int scalar = 0;
+    int batch = 0;
+    bool aliased = false;
+};
+
+static double Scale(void *pUser, double a) {
+    ((ColumnCalls *)pUser)->scalar++;
+    return a * 3.0 + 1.0;
+}
+
+static void ScaleBatch(void *pUser, int, const double * const *arg, size_t nRows, double *out) {
+    auto calls = (ColumnCalls *)pUser;
+    calls->batch++;
+    if (out == arg[0]) {
+        calls->aliased = true;
+    }
+    for (size_t i = 0; i < nRows; i++) {
+        out[i] = arg[0][i] * 3.0 + 1.0;
+    }
+}
+
+int test_batch_columnfunctions(ITesting *t) {
+    static const char *expressions[] = {
+        "scale(a)",
+        "scale(a*2) - b",           // argument computed into the result block
+        "mid(a, b) + other(a)",     // 'other' is not handled by the batch callback
+        "sqrt(abs(a)) + floor(b)",
+        nullptr,
+    };
+    static const size_t nRows = 1000;
+    std::vector<double> a(nRows), b(nRows), out(nRows);
+    for (size_t i = 0; i < nRows; i++) {
+        a[i] = (double)i * 0.25 - 50.0;
+        b[i] = (double)(i % 17) + 0.5;
+    }
+    BatchColumn columns[] = { { "a", a.data() }, { "b", b.data() } };
+    static const int nBlocks = (nRows + EXP_SOLVER_BATCH_BLOCK - 1) / EXP_SOLVER_BATCH_BLOCK;
+
+    for (int i = 0; expressions[i] != nullptr; i++) {
+        double row[2];
+        ColumnCalls calls;
+        int userBatchCalls = 0;
+        ExpSolver exp(expressions[i]);
+        exp.Functions().Register("scale", Scale, &calls);
+        exp.EnableBuiltInFunctions();
+        TR_ASSERT(t, exp.Functions().SetBatch("scale", ScaleBatch));
+        exp.RegisterUserVariableCallback(varCallBack, row);
+        exp.RegisterUserFunctionCallback([](void *, const char *data, int args, double *arg, int *bOk_out) -> double {
+            *bOk_out = 1;
+            if (!strcmp(data, "mid") && (args == 2)) return (arg[0] + arg[1]) * 0.5;
+            if (!strcmp(data, "other") && (args == 1)) return arg[0] * 0.5;
+            *bOk_out = 0;
+            return 0.0;
+        }, nullptr);
+        exp.RegisterUserFunctionBatchCallback(functionBatchCallBack, &userBatchCalls);
+        TR_ASSERT(t, exp.Prepare());
+        TR_ASSERT(t, exp.EvaluateBatch(out.data(), nRows, columns, 2));
+        TR_ASSERT(t, exp.GetError().code == kExpError_None);
+        TR_ASSERT(t, !calls.aliased);
+        TR_ASSERT(t, calls.scalar == 0);
+        if (strstr(expressions[i], "scale") != nullptr) {
+            TR_ASSERT(t, calls.batch == nBlocks);
+        }
+        if (strstr(expressions[i], "mid") != nullptr) {
+            TR_ASSERT(t, userBatchCalls == nBlocks);
+        }
+        // A column call counts once, 'other' is declined by the batch callback and counted again per row
+        if (ExpSolver::HasStats() && !strcmp(expressions[i], "mid(a, b) + other(a)")) {
+            TR_ASSERT(t, exp.GetStats().numFunctionCallbacks == (uint64_t) (2 * nBlocks + nRows));
+        }
+
+        for (size_t r = 0; r < nRows; r++) {
+            row[0] = a[r];
+            row[1] = b[r];
+            double expected = exp.Evaluate();
+            TR_ASSERT(t, !memcmp(&expected, &out[r], sizeof(double)));
+        }
+    }
+    return kTR_Pass;
+}
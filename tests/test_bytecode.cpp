@@ -0,0 +1,151 @@
+//
+// Created by gnilk on 18.10.26.
+//
+#include <testinterface.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include "../src/expsolver.h"
+#include "../src/bytecode.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_bytecode(ITesting *t);
+    DLL_EXPORT int test_bytecode_compile(ITesting *t);
+    DLL_EXPORT int test_bytecode_identical(ITesting *t);
+    DLL_EXPORT int test_bytecode_deepstack(ITesting *t);
+    DLL_EXPORT int test_bytecode_sharedchain(ITesting *t);
+}
+
+extern "C" {
+    static double varCallBack(void *pUser, const char *data, int *bOk_out);
+    static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out);
+}
+
+static double varCallBack(void *pUser, const char *data, int *bOk_out) {
+    *bOk_out = 1;
+    if (!strcmp(data, "a")) return 3.25;
+    if (!strcmp(data, "b")) return -7.5;
+    if (!strcmp(data, "c")) return 1.0/3.0;
+    *bOk_out = 0;
+    return 0;
+}
+
+static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out) {
+    *bOk_out = 1;
+    if (!strcmp(data, "sum")) {
+        double result = 0.0;
+        for (int i = 0; i < args; i++) {
+            result += arg[i];
+        }
+        return result;
+    }
+    if (!strcmp(data, "sqrt") && (args == 1)) {
+        return sqrt(arg[0]);
+    }
+    *bOk_out = 0;
+    return 0.0;
+}
+
+int test_bytecode(ITesting *t) {
+    return kTR_Pass;
+}
+
+int test_bytecode_compile(ITesting *t) {
+    ExpSolver exp("a > 1 ? sum(a, 2) : b");
+    exp.RegisterUserVariableCallback(varCallBack, nullptr);
+    exp.RegisterUserFunctionCallback(functionCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, !exp.IsCompiled());
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.IsCompiled());
+    TR_ASSERT(t, exp.Evaluate() == 5.25);
+    return kTR_Pass;
+}
+
+int test_bytecode_identical(ITesting *t) {
+    static const char *expressions[] = {
+        "1+2*3-4/5",
+        "a*b+c",
+        "a/c - b*c + a*a*a",
+        "1<<4 + a",
+        "$ff >> 2",
+        "a > b ? a : b",
+        "a < b ? a : b",
+        "a < 4 ? b > 2 ? 1 : 2 : 3",
+        "sum(a, b, c, sum(a*2, 1)) / 3",
+        "sqrt(a*a + b*b)",
+        "sum()",
+        "(a + (b - (c * (a / (b + 3)))))",
+        "-4+-1 * c",
+        "c*c*c*c*c*c*c*c + %1011",
+        nullptr,
+    };
+    for (int i = 0; expressions[i] != nullptr; i++) {
+        ExpSolver tree(expressions[i]);
+        tree.RegisterUserVariableCallback(varCallBack, nullptr);
+        tree.RegisterUserFunctionCallback(functionCallBack, nullptr);
+        TR_ASSERT(t, tree.Prepare());
+        double expected = tree.Evaluate();
+
+        ExpSolver compiled(expressions[i]);
+        compiled.RegisterUserVariableCallback(varCallBack, nullptr);
+        compiled.RegisterUserFunctionCallback(functionCallBack, nullptr);
+        TR_ASSERT(t, compiled.Prepare());
+        TR_ASSERT(t, compiled.Compile());
+        double result = compiled.Evaluate();
+
+        // Must be bit-identical, not just equal
+        TR_ASSERT(t, !memcmp(&expected, &result, sizeof(double)));
+    }
+    return kTR_Pass;
+}
+
+int test_bytecode_deepstack(ITesting *t) {
+    // Right leaning tree, requires a deeper stack than the local one
+    std::string expression;
+    for (int i = 0; i < 100; i++) {
+        expression += "1+(";
+    }
+    expression += "1";
+    expression += std::string(100, ')');
+
+    ExpSolver exp(expression.c_str());
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == 101.0);
+    return kTR_Pass;
+}
+
+// t0 = a; t1 = t0 + t0; ... - every name is referenced twice by the next one
+static std::string SharedChain(int links) {
+    std::string chain = "t0 = a";
+    for (int i = 1; i <= links; i++) {
+        std::string prev = "t" + std::to_string(i - 1);
+        chain += "; t" + std::to_string(i) + " = " + prev + " + " + prev;
+    }
+    return chain + "; t" + std::to_string(links);
+}
+
+//
+// Shared expressions are compiled once however often they are referenced, code used to double per link
+//
+int test_bytecode_sharedchain(ITesting *t) {
+    const int links = 200;
+    ExpSolver exp(SharedChain(links).c_str());
+    exp.RegisterUserVariableCallback(varCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == ldexp(3.25, links));
+    TR_ASSERT(t, exp.Evaluate() == ldexp(3.25, links));
+
+    // Batches, the select mode program has the same layout
+    static const double colA[] = { 1, 2, 3 };
+    BatchColumn columns[] = { { "a", colA } };
+    double out[3];
+    TR_ASSERT(t, exp.EvaluateBatch(out, 3, columns, 1));
+    TR_ASSERT(t, (out[0] == ldexp(1, links)) && (out[1] == ldexp(2, links)) && (out[2] == ldexp(3, links)));
+    return kTR_Pass;
+}
@@ -0,0 +1,157 @@
+//
+// Created by gnilk on 18.10.26.
+//
+#include <testinterface.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <string>
+#include <math.h>
+#include "../src/expsolver.h"
+#include "../src/compiledexpression.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_compiledexpression(ITesting *t);
+    DLL_EXPORT int test_compiledexpression_context(ITesting *t);
+    DLL_EXPORT int test_compiledexpression_lifetime(ITesting *t);
+    DLL_EXPORT int test_compiledexpression_threads(ITesting *t);
+    DLL_EXPORT int test_compiledexpression_sharedchain(ITesting *t);
+}
+
+extern "C" {
+    static double varCallBack(void *pUser, const char *data, int *bOk_out);
+    static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out);
+}
+
+// pUser is the value of every variable
+static double varCallBack(void *pUser, const char *data, int *bOk_out) {
+    *bOk_out = 1;
+    return *(double *)pUser;
+}
+
+// scale(x) = x * (*pUser)
+static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out) {
+    *bOk_out = 1;
+    return arg[0] * *(double *)pUser;
+}
+
+int test_compiledexpression(ITesting *t) {
+    return kTR_Pass;
+}
+
+int test_compiledexpression_context(ITesting *t) {
+    ExpSolver exp("scale(a) + b");
+    exp.RegisterUserFunctionCallback(functionCallBack, nullptr);
+    TR_ASSERT(t, exp.GetCompiledExpression() == nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    auto compiled = exp.GetCompiledExpression();
+    TR_ASSERT(t, compiled != nullptr);
+    TR_ASSERT(t, compiled->GetNumVariables() == 2);
+    TR_ASSERT(t, compiled->GetVariableSlot("b") == 1);
+    TR_ASSERT(t, !strcmp(compiled->GetVariableName(0), "a"));
+
+    // Bindings and callback contexts are per call
+    double scale = 2.0;
+    double a = 3.0, b = 4.0;
+    const double *bindings[] = { &a, &b };
+    EvalContext context;
+    context.pSlots = bindings;
+    context.pFuncCallback = functionCallBack;
+    context.pFunctionContext = &scale;
+    TR_ASSERT(t, compiled->Evaluate(context) == 10.0);
+
+    double value = 5.0;
+    double other = 10.0;
+    EvalContext callbacks;
+    callbacks.pVariableCallback = varCallBack;
+    callbacks.pVariableContext = &value;
+    callbacks.pFuncCallback = functionCallBack;
+    callbacks.pFunctionContext = &other;
+    TR_ASSERT(t, compiled->Evaluate(callbacks) == 55.0);
+
+    // Batch, 'a' from a column and 'b' from the callback
+    static const double colA[] = { 1, 2, 3 };
+    BatchColumn columns[] = { { "a", colA } };
+    double out[3];
+    TR_ASSERT(t, compiled->EvaluateBatch(callbacks, out, 3, columns, 1));
+    TR_ASSERT(t, out[0] == 15.0 && out[1] == 25.0 && out[2] == 35.0);
+    return kTR_Pass;
+}
+
+int test_compiledexpression_lifetime(ITesting *t) {
+    std::shared_ptr<const CompiledExpression> compiled;
+    {
+        ExpSolver exp("a*a + sqrt(b) + (a > b ? 1 : 2)");
+        exp.EnableBuiltInFunctions();
+        TR_ASSERT(t, exp.Prepare());
+        TR_ASSERT(t, exp.Optimize());
+        compiled = exp.GetCompiledExpression();
+    }
+    double values[] = { 3, 16 };
+    TR_ASSERT(t, compiled->Evaluate(values) == 9 + 4 + 2);
+
+    // Prepare can be called again, the tokenizer is created for each call
+    ExpSolver again("1+2");
+    TR_ASSERT(t, again.Prepare());
+    TR_ASSERT(t, again.Prepare());
+    TR_ASSERT(t, again.Evaluate() == 3.0);
+    return kTR_Pass;
+}
+
+int test_compiledexpression_threads(ITesting *t) {
+    ExpSolver exp("(a*b + c) > 10 ? a*b + c : c - a");
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Optimize());
+    auto compiled = exp.GetCompiledExpression();
+    TR_ASSERT(t, compiled != nullptr);
+
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; i++) {
+        threads.push_back(std::thread([&errors, compiled, i]() {
+            for (int n = 0; n < 5000; n++) {
+                double values[] = { (double) i, (double) (n % 7), (double) (n % 3) };
+                double expected = (values[0]*values[1] + values[2]) > 10 ? values[0]*values[1] + values[2] : values[2] - values[0];
+                if (compiled->Evaluate(values) != expected) {
+                    errors++;
+                }
+            }
+        }));
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    TR_ASSERT(t, errors == 0);
+    return kTR_Pass;
+}
+
+// t0 = a; t1 = t0 + t0; ... - every name is referenced twice by the next one
+static std::string SharedChain(int links) {
+    std::string chain = "t0 = a";
+    for (int i = 1; i <= links; i++) {
+        std::string prev = "t" + std::to_string(i - 1);
+        chain += "; t" + std::to_string(i) + " = " + prev + " + " + prev;
+    }
+    return chain + "; t" + std::to_string(links);
+}
+
+int test_compiledexpression_sharedchain(ITesting *t) {
+    const int links = 200;
+    ExpSolver exp(SharedChain(links).c_str());
+    TR_ASSERT(t, exp.Prepare());
+    auto compiled = exp.GetCompiledExpression();
+    TR_ASSERT(t, compiled != nullptr);
+    double values[] = { 3 };
+    TR_ASSERT(t, compiled->Evaluate(values) == ldexp(3, links));
+
+    static const double colA[] = { 1, 2, 3 };
+    BatchColumn columns[] = { { "a", colA } };
+    double out[3];
+    TR_ASSERT(t, compiled->EvaluateBatch(EvalContext(), out, 3, columns, 1));
+    TR_ASSERT(t, (out[0] == ldexp(1, links)) && (out[1] == ldexp(2, links)) && (out[2] == ldexp(3, links)));
+    return kTR_Pass;
+}
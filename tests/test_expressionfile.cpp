@@ -0,0 +1,249 @@
+//
+// Created by gnilk on 19.10.26.
+//
+#include <testinterface.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "../src/expsolver.h"
+#include "../src/bytecode.h"
+#include "../src/nodepool.h"
+#include "../src/expressionfile.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_expressionfile(ITesting *t);
+    DLL_EXPORT int test_expressionfile_roundtrip(ITesting *t);
+    DLL_EXPORT int test_expressionfile_mmap(ITesting *t);
+    DLL_EXPORT int test_expressionfile_invalid(ITesting *t);
+    DLL_EXPORT int test_expressionfile_deep(ITesting *t);
+}
+
+extern "C" {
+    static double varCallBack(void *pUser, const char *data, int *bOk_out);
+    static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out);
+}
+
+static double varCallBack(void *pUser, const char *data, int *bOk_out) {
+    *bOk_out = 1;
+    if (!strcmp(data, "a")) return 3.25;
+    if (!strcmp(data, "b")) return -7.5;
+    if (!strcmp(data, "c")) return 1.0/3.0;
+    *bOk_out = 0;
+    return 0;
+}
+
+static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out) {
+    *bOk_out = 1;
+    if (!strcmp(data, "sum")) {
+        double result = 0.0;
+        for (int i = 0; i < args; i++) {
+            result += arg[i];
+        }
+        return result;
+    }
+    *bOk_out = 0;
+    return 0.0;
+}
+
+static double Twice(void *pUser, double a) {
+    return 2*a;
+}
+
+static const char *expressions[] = {
+    "1+2*3-4/5",
+    "a*b+c",
+    "$ff >> 2 + 1<<4",
+    "a > b ? a : b",
+    "a < 4 ? b > 2 ? 1 : 2 : 3",
+    "sum(a, b, c) * sum(1)",
+    "sqrt(a*a + b*b) + max(a, b, c) + pow(c, 2)",
+    "twice(a) + twice(twice(c))",
+    "sin(a*b) + sin(a*b) * (a*b)",
+    "d = a*a + b*b; e = sqrt(d); e > 1 ? d/e : e",
+    nullptr,
+};
+
+static bool PrepareSolver(ExpSolver &exp, bool optimize) {
+    exp.RegisterUserVariableCallback(varCallBack, nullptr);
+    exp.RegisterUserFunctionCallback(functionCallBack, nullptr);
+    exp.Functions().Register("twice", Twice);
+    exp.EnableBuiltInFunctions();
+    if (!exp.Prepare()) {
+        return false;
+    }
+    return optimize ? exp.Optimize() : true;
+}
+
+static double EvaluatePool(const NodePool &pool) {
+    EvalContext context;
+    context.pVariableCallback = varCallBack;
+    context.pFuncCallback = functionCallBack;
+    return pool.Evaluate(context);
+}
+
+int test_expressionfile(ITesting *t) {
+    return kTR_Pass;
+}
+
+int test_expressionfile_roundtrip(ITesting *t) {
+    FunctionRegistry natives;
+    natives.Register("twice", Twice);
+
+    for (int optimize = 0; optimize < 2; optimize++) {
+        for (int i = 0; expressions[i] != nullptr; i++) {
+            ExpSolver exp(expressions[i]);
+            TR_ASSERT(t, PrepareSolver(exp, optimize != 0));
+            double expected = exp.Evaluate();
+
+            std::vector<uint8_t> record;
+            TR_ASSERT(t, exp.Serialize(record));
+            TR_ASSERT(t, (record.size() % 8) == 0);
+
+            NodePool pool;
+            TR_ASSERT(t, pool.Deserialize(record.data(), record.size(), &natives));
+            double result = EvaluatePool(pool);
+            TR_ASSERT(t, !memcmp(&result, &expected, sizeof(double)));
+
+            // Serializing the loaded pool gives the same bytes
+            std::vector<uint8_t> again;
+            pool.Serialize(again);
+            TR_ASSERT(t, again == record);
+        }
+    }
+
+    // Integer mode is not supported
+    ExpSolver exp("1+2");
+    TR_ASSERT(t, exp.Prepare(kNumericMode_Int64));
+    std::vector<uint8_t> record;
+    TR_ASSERT(t, !exp.Serialize(record));
+    return kTR_Pass;
+}
+
+int test_expressionfile_mmap(ITesting *t) {
+    FunctionRegistry natives;
+    natives.Register("twice", Twice);
+
+    ExpressionFileWriter writer;
+    std::vector<double> expected;
+    for (int i = 0; expressions[i] != nullptr; i++) {
+        ExpSolver exp(expressions[i]);
+        TR_ASSERT(t, PrepareSolver(exp, (i % 2) != 0));
+        expected.push_back(exp.Evaluate());
+        TR_ASSERT(t, writer.Add(exp));
+    }
+    TR_ASSERT(t, writer.Count() == expected.size());
+
+    char filename[] = "/tmp/expsolver_test_XXXXXX";
+    int fd = mkstemp(filename);
+    TR_ASSERT(t, fd >= 0);
+    close(fd);
+    TR_ASSERT(t, writer.Write(filename));
+
+    ExpressionFile file;
+    TR_ASSERT(t, file.Open(filename));
+    unlink(filename);
+    TR_ASSERT(t, file.Count() == expected.size());
+    for (size_t i = 0; i < file.Count(); i++) {
+        NodePool pool;
+        TR_ASSERT(t, file.Load(i, pool, &natives));
+        double result = EvaluatePool(pool);
+        TR_ASSERT(t, !memcmp(&result, &expected[i], sizeof(double)));
+    }
+    NodePool pool;
+    TR_ASSERT(t, !file.Load(file.Count(), pool));
+
+    // Opening an image closes the mapping
+    std::vector<uint8_t> image;
+    writer.Write(image);
+    TR_ASSERT(t, file.Open(image.data(), image.size()));
+    TR_ASSERT(t, file.Count() == expected.size());
+    TR_ASSERT(t, file.Load(0, pool, &natives));
+    TR_ASSERT(t, EvaluatePool(pool) == expected[0]);
+    return kTR_Pass;
+}
+
+int test_expressionfile_invalid(ITesting *t) {
+    ExpressionFileWriter writer;
+    ExpSolver exp("twice(a) + sum(b, c)");
+    TR_ASSERT(t, PrepareSolver(exp, false));
+    TR_ASSERT(t, writer.Add(exp));
+    std::vector<uint8_t> image;
+    writer.Write(image);
+
+    FunctionRegistry natives;
+    natives.Register("twice", Twice);
+    ExpressionFile file;
+    NodePool pool;
+    TR_ASSERT(t, file.Open(image.data(), image.size()));
+    TR_ASSERT(t, file.Load(0, pool, &natives));
+    // 'twice' is not a built-in
+    TR_ASSERT(t, !file.Load(0, pool));
+    TR_ASSERT(t, EvaluatePool(pool) == 0.0);
+
+    // Bad magic and version
+    std::vector<uint8_t> broken = image;
+    broken[0] = 'X';
+    TR_ASSERT(t, !file.Open(broken.data(), broken.size()));
+    broken = image;
+    broken[4]++;
+    TR_ASSERT(t, !file.Open(broken.data(), broken.size()));
+
+    // Every truncation is rejected by either the file or the record
+    for (size_t size = 0; size < image.size(); size++) {
+        if (file.Open(image.data(), size)) {
+            TR_ASSERT(t, !file.Load(0, pool, &natives));
+        }
+    }
+
+    // Random damage must never crash, loads either fail or give a valid pool
+    uint32_t seed = 1234;
+    for (int i = 0; i < 2000; i++) {
+        broken = image;
+        seed = seed * 1664525 + 1013904223;
+        size_t pos = 16 + (seed >> 8) % (broken.size() - 16);
+        broken[pos] ^= (uint8_t) (1 + (seed & 0x7f));
+        TR_ASSERT(t, file.Open(broken.data(), broken.size()));
+        if (file.Load(0, pool, &natives)) {
+            EvaluatePool(pool);
+        }
+    }
+    file.Close();
+    TR_ASSERT(t, !file.Open("/nonexistent/expressions.bin"));
+    return kTR_Pass;
+}
+
+//
+// Records deeper than Prepare allows are rejected, the pool evaluates recursively
+//
+static bool SerializeChain(size_t links, std::vector<uint8_t> &record) {
+    Arena arena;
+    BaseNode *node = new (arena) ConstNode(1.0);
+    for (size_t i = 0; i < links; i++) {
+        node = new (arena) BinOpNode(kOpCode_Add, node, new (arena) ConstNode(1.0));
+    }
+    NodePool pool;
+    if (!pool.Build(node)) {
+        return false;
+    }
+    record.clear();
+    pool.Serialize(record);
+    return true;
+}
+
+int test_expressionfile_deep(ITesting *t) {
+    std::vector<uint8_t> record;
+    NodePool pool;
+    TR_ASSERT(t, SerializeChain(EXP_SOLVER_MAX_DEPTH - 1, record));
+    TR_ASSERT(t, pool.Deserialize(record.data(), record.size()));
+    TR_ASSERT(t, EvaluatePool(pool) == EXP_SOLVER_MAX_DEPTH);
+
+    TR_ASSERT(t, SerializeChain(EXP_SOLVER_MAX_DEPTH, record));
+    TR_ASSERT(t, !pool.Deserialize(record.data(), record.size()));
+    TR_ASSERT(t, EvaluatePool(pool) == 0.0);
+    return kTR_Pass;
+}
@@ -4,6 +4,7 @@
 #include <functional>
 #include <math.h>
 #include <string.h>
+#include <string>
 
 // test exports
 extern "C" {
@@ -16,6 +17,15 @@ extern "C" {
     int test_expsolver_rshift(ITesting *t);
     int test_expsolver_hex(ITesting *t);
     int test_expsolver_bin(ITesting *t);
+    int test_expsolver_longtoken(ITesting *t);
+    int test_expsolver_operators(ITesting *t);
+    int test_expsolver_slots(ITesting *t);
+    int test_expsolver_statements(ITesting *t);
+    int test_expsolver_int64(ITesting *t);
+    int test_expsolver_stats(ITesting *t);
+    int test_expsolver_setexpression(ITesting *t);
+    int test_expsolver_nesting(ITesting *t);
+    int test_expsolver_errors(ITesting *t);
 
 }
 
@@ -125,7 +135,6 @@ int test_expsolver_ifop(ITesting *t) {
     }
 
     // Should not work
-    printf("NOTE: Errors Expected\n");
 	if (ExpSolver::Solve(&tmp, "4<1?3*2+1")) {
         return kTR_Fail;
 	}
@@ -196,8 +205,458 @@ int test_expsolver_bin(ITesting *t) {
     TR_ASSERT(t, 25 == (int)tmp);
     TR_ASSERT(t, ExpSolver::Solve(&tmp, "%1111 + 10"));
     TR_ASSERT(t, 25 == (int)tmp);
+    return kTR_Pass;
+}
+
+int test_expsolver_longtoken(ITesting *t) {
+    double tmp;
+    // 300 digit number - longer than the old token limit
+    std::string expression = "1" + std::string(300, '0') + "/1" + std::string(299, '0');
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, expression.c_str()));
+    TR_ASSERT(t, tmp == 10.0);
+    return kTR_Pass;
+}
+
+int test_expsolver_operators(ITesting *t) {
+    double tmp;
+    TR_ASSERT(t, BinOpNode::ClassifyOperator("<<") == kOpCode_ShiftLeft);
+    TR_ASSERT(t, BinOpNode::ClassifyOperator("<") == kOpCode_Less);
+    TR_ASSERT(t, BinOpNode::ClassifyOperator("u") == kOpCode_Invalid);
+
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "2+3*4-8/2"));
+    TR_ASSERT(t, tmp == 10.0);
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "1<<2+1"));
+    TR_ASSERT(t, tmp == 8.0);
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "7>>1 > 2"));
+    TR_ASSERT(t, tmp == 1.0);
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "3 < 2"));
+    TR_ASSERT(t, tmp == 0.0);
+    // right hand side of a comparison is truncated
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "2.5 > 2.9"));
+    TR_ASSERT(t, tmp == 1.0);
+    // Unary minus on names and parenthesis binds tighter than the operator before it
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "8/-(1+1)*2"));
+    TR_ASSERT(t, tmp == -8.0);
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "-max(1, 3) - -2"));
+    TR_ASSERT(t, tmp == -1.0);
+    ExpSolver exp("1 - -t*2 + 8/-t");
+    exp.RegisterUserVariableCallback(varCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 7.0);
+    return kTR_Pass;
+}
+int test_expsolver_slots(ITesting *t) {
+    ExpSolver exp("t*u + v*u + t");
+    exp.RegisterUserVariableCallback(varCallBack, NULL);
+    TR_ASSERT(t, exp.Prepare());
+
+    // Distinct names, in order of appearance
+    TR_ASSERT(t, exp.GetNumVariables() == 3);
+    TR_ASSERT(t, !strcmp(exp.GetVariableName(0), "t"));
+    TR_ASSERT(t, !strcmp(exp.GetVariableName(1), "u"));
+    TR_ASSERT(t, !strcmp(exp.GetVariableName(2), "v"));
+    TR_ASSERT(t, exp.GetVariableName(3) == nullptr);
+    TR_ASSERT(t, exp.GetVariableSlot("v") == 2);
+    TR_ASSERT(t, exp.GetVariableSlot("w") == -1);
+
+    // u and v bound, t still through the callback (t = 4)
+    double u = 2.0, v = 3.0;
+    TR_ASSERT(t, exp.BindVariable(1, &u));
+    TR_ASSERT(t, exp.BindVariable(2, &v));
+    TR_ASSERT(t, !exp.BindVariable(3, &v));
+    TR_ASSERT(t, exp.Evaluate() == 4*2 + 3*2 + 4);
+    // bindings are read on every evaluation
+    u = 10.0;
+    TR_ASSERT(t, exp.Evaluate() == 4*10 + 3*10 + 4);
+
+    // all slots from an array, same for the byte code
+    double values[3] = { 1.0, 2.0, 3.0 };
+    exp.BindVariables(values);
+    TR_ASSERT(t, exp.Evaluate() == 1*2 + 3*2 + 1);
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == 1*2 + 3*2 + 1);
+
+    // no bindings, back to the callback (u and v are unknown = 0)
+    exp.BindVariables(nullptr);
+    TR_ASSERT(t, exp.Evaluate() == 4.0);
+
+    // Variables without any way to get a value can't be solved
+    double tmp;
+    TR_ASSERT(t, !ExpSolver::Solve(&tmp, "u+1"));
+    return kTR_Pass;
+}
+
+//
+// ';' separated statements, assigned values are computed once per evaluation
+//
+static int counterCalls = 0;
+static double counterCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out) {
+    counterCalls++;
+    *bOk_out = 1;
+    return (args > 0) ? arg[0] * 2 : 0.0;
 }
 
+int test_expsolver_statements(ITesting *t) {
+    ExpSolver exp("p = t*3; q = p + 1; p + p/2 + q");
+    exp.RegisterUserVariableCallback(varCallBack, NULL);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 12 + 6 + 13);
+    // Assignments are not variables
+    TR_ASSERT(t, exp.GetNumVariables() == 1);
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == 12 + 6 + 13);
+
+    // Assignments referencing other assignments
+    ExpSolver nested("p = t*3; q = p > 5 ? p*p : 1; q + p");
+    nested.RegisterUserVariableCallback(varCallBack, NULL);
+    TR_ASSERT(t, nested.Prepare());
+    TR_ASSERT(t, nested.Evaluate() == 144 + 12);
+    TR_ASSERT(t, nested.Flatten());
+    TR_ASSERT(t, nested.Evaluate() == 144 + 12);
+    TR_ASSERT(t, nested.CompileJit());
+    TR_ASSERT(t, nested.Evaluate() == 144 + 12);
+
+    // Each assigned expression is evaluated once, the unused one never
+    counterCalls = 0;
+    ExpSolver once("a = twice(t); b = twice(100); c = a*a + a; a > 7 ? a : b");
+    once.RegisterUserVariableCallback(varCallBack, NULL);
+    once.RegisterUserFunctionCallback(counterCallBack, NULL);
+    TR_ASSERT(t, once.Prepare());
+    TR_ASSERT(t, once.Evaluate() == 8);
+    TR_ASSERT(t, counterCalls == 1);
+    TR_ASSERT(t, once.Evaluate() == 8);
+    TR_ASSERT(t, counterCalls == 2);
+    TR_ASSERT(t, once.Optimize());
+    TR_ASSERT(t, once.Compile());
+    TR_ASSERT(t, once.Evaluate() == 8);
+    TR_ASSERT(t, counterCalls == 3);
+
+    // Re-assignment, the right hand side sees the previous value
+    double tmp;
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "n = 2; n = n*n + 1; n;"));
+    TR_ASSERT(t, tmp == 5);
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, ";; 1+1"));
+    TR_ASSERT(t, tmp == 2);
+
+    TR_ASSERT(t, !ExpSolver::Solve(&tmp, ""));
+    TR_ASSERT(t, !ExpSolver::Solve(&tmp, ";"));
+    TR_ASSERT(t, !ExpSolver::Solve(&tmp, "n = ; n"));
+    TR_ASSERT(t, !ExpSolver::Solve(&tmp, "1 = 2"));
+    TR_ASSERT(t, !ExpSolver::Solve(&tmp, "n = 1 = 2"));
+    return kTR_Pass;
+}
+
+//
+// Integer modes are exact for all 64 bits
+//
+int test_expsolver_int64(ITesting *t) {
+    int64_t tmp;
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "$FFFFFFFFFFFFFFFF"));
+    TR_ASSERT(t, tmp == -1);
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "$123456789abcdef1 + 1"));
+    TR_ASSERT(t, tmp == 0x123456789abcdef2LL);
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "1 << 62"));
+    TR_ASSERT(t, tmp == (1LL << 62));
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "(1 << 53) + 1"));
+    TR_ASSERT(t, tmp == (1LL << 53) + 1);
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "9007199254740993"));
+    TR_ASSERT(t, tmp == 9007199254740993LL);
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "%1" "000000000000000000000000000000000000000000000000000000000000001"));
+    TR_ASSERT(t, tmp == (int64_t) 0x8000000000000001ULL);
+
+    // Integer division, truncated towards zero
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "7/2"));
+    TR_ASSERT(t, tmp == 3);
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "-7/2"));
+    TR_ASSERT(t, tmp == -3);
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "1/0"));
+    TR_ASSERT(t, tmp == 0);
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "-16 >> 2"));
+    TR_ASSERT(t, tmp == -4);
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "2.75 * 2"));
+    TR_ASSERT(t, tmp == 4);
+
+    // Unsigned division, shifts and compares
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "-16 >> 60", kNumericMode_UInt64));
+    TR_ASSERT(t, tmp == 15);
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "$FFFFFFFFFFFFFFFF / 2", kNumericMode_UInt64));
+    TR_ASSERT(t, tmp == INT64_MAX);
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "$8000000000000000 > 1 ? 1 : 2", kNumericMode_UInt64));
+    TR_ASSERT(t, tmp == 1);
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "$8000000000000000 > 1 ? 1 : 2"));
+    TR_ASSERT(t, tmp == 2);
+
+    // Variables and functions are converted to and from double
+    ExpSolver exp("t * 3 + max(t, 10) + $10000000000");
+    exp.EnableBuiltInFunctions();
+    exp.RegisterUserVariableCallback(varCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare(kNumericMode_Int64));
+    TR_ASSERT(t, exp.GetNumericMode() == kNumericMode_Int64);
+    TR_ASSERT(t, exp.EvaluateInt() == 12 + 10 + 0x10000000000LL);
+    TR_ASSERT(t, exp.Evaluate() == (double) (22 + 0x10000000000LL));
+    // The compiled forms are double only
+    TR_ASSERT(t, !exp.Optimize());
+    TR_ASSERT(t, !exp.Compile());
+    TR_ASSERT(t, exp.GetCompiledExpression() == nullptr);
+
+    // Statements share their values
+    TR_ASSERT(t, ExpSolver::SolveInt(&tmp, "m = $100000001; m*m"));
+    TR_ASSERT(t, tmp == (int64_t) (0x100000001ULL * 0x100000001ULL));
+
+    TR_ASSERT(t, intops::FromDouble(1e300, kNumericMode_Int64) == INT64_MAX);
+    TR_ASSERT(t, intops::FromDouble(-1e300, kNumericMode_Int64) == INT64_MIN);
+    TR_ASSERT(t, intops::FromDouble(NAN, kNumericMode_UInt64) == 0);
+    TR_ASSERT(t, intops::FromDouble(18446744073709549568.0, kNumericMode_UInt64) == (int64_t) 18446744073709549568ULL);
+    return kTR_Pass;
+}
+
+//
+// Statistics are only collected when built with EXP_SOLVER_STATS
+//
+int test_expsolver_stats(ITesting *t) {
+    ExpSolver exp("inc(t, 1) * t > 4 ? t : inc(2)");
+    exp.RegisterUserVariableCallback(varCallBack, nullptr);
+    exp.RegisterUserFunctionCallback(functionCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 4);
+    TR_ASSERT(t, exp.Evaluate() == 4);
+
+    auto &stats = exp.GetStats();
+    if (!ExpSolver::HasStats()) {
+        TR_ASSERT(t, stats.numNodes == 0);
+        TR_ASSERT(t, stats.numEvaluations == 0);
+        return kTR_Pass;
+    }
+    TR_ASSERT(t, stats.numNodes == 11);
+    TR_ASSERT(t, stats.nodesByType[kNodeType_Func] == 2);
+    TR_ASSERT(t, stats.nodesByType[kNodeType_ConstUser] == 3);
+    TR_ASSERT(t, stats.nodesByType[kNodeType_If] == 1);
+    TR_ASSERT(t, stats.treeDepth == 5);
+    TR_ASSERT(t, stats.numEvaluations == 2);
+    TR_ASSERT(t, stats.maxEvaluationNs <= stats.totalEvaluationNs);
+    // The false branch is not taken
+    TR_ASSERT(t, stats.numVariableCallbacks == 6);
+    TR_ASSERT(t, stats.numFunctionCallbacks == 2);
+
+    // Callbacks from the compiled forms are counted as well
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == 4);
+    TR_ASSERT(t, stats.numEvaluations == 3);
+    TR_ASSERT(t, stats.numVariableCallbacks == 9);
+    TR_ASSERT(t, stats.numFunctionCallbacks == 3);
+
+    exp.ResetStats();
+    TR_ASSERT(t, stats.numEvaluations == 0);
+
+    // A statement is counted once, its height is part of the trees referring to it
+    exp.SetExpression("a = t*2; a + a*t");
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 40);
+    TR_ASSERT(t, stats.numNodes == 9);
+    TR_ASSERT(t, stats.nodesByType[kNodeType_Shared] == 3);
+    TR_ASSERT(t, stats.treeDepth == 5);
+    return kTR_Pass;
+}
+
+//
+// One solver for many expressions, nothing from the previous expression is kept
+//
+int test_expsolver_setexpression(ITesting *t) {
+    ExpSolver exp("t*2");
+    exp.RegisterUserVariableCallback(varCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == 8);
+
+    exp.SetExpression("1 + 2*3");
+    TR_ASSERT(t, !exp.IsCompiled());
+    TR_ASSERT(t, exp.Evaluate() == 0);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.GetNumVariables() == 0);
+    TR_ASSERT(t, exp.Evaluate() == 7);
+
+    std::string line = "n = t + 1; n*n";
+    exp.SetExpression(std::string_view(line).substr(0, 9));
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 5);
+    exp.SetExpression(line);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 25);
+    return kTR_Pass;
+}
+
+int test_expsolver_nesting(ITesting *t) {
+    // The parser does not recurse and parentheses don't add tree levels, nesting is only limited by memory
+    const size_t depth = 1000000;
+    std::string nested = std::string(depth, '(') + "t*2" + std::string(depth, ')');
+    ExpSolver exp(nested.c_str());
+    exp.RegisterUserVariableCallback(varCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 8);
+
+    nested.pop_back();
+    exp.SetExpression(nested);
+    TR_ASSERT(t, !exp.Prepare());
+
+    // Function arguments and '?:' branches, the tree is as deep as the nesting
+    std::string calls;
+    for (int i = 0; i < 1000; i++) {
+        calls += "inc(1, t > 1 ? ";
+    }
+    calls += "0";
+    for (int i = 0; i < 1000; i++) {
+        calls += " : 0)";
+    }
+    exp.SetExpression(calls);
+    exp.RegisterUserFunctionCallback(functionCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 1000);
+
+    // Operators add a tree level each, evaluation recurses once per level - deeper trees fail in Prepare
+    std::string chain = "t";
+    for (int i = 1; i < EXP_SOLVER_MAX_DEPTH; i++) {
+        chain += "+1";
+    }
+    const double chainValue = 4 + EXP_SOLVER_MAX_DEPTH - 1;
+    exp.SetExpression(chain);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == chainValue);
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == chainValue);
+    exp.CompileJit();
+    TR_ASSERT(t, exp.Evaluate() == chainValue);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Flatten());
+    TR_ASSERT(t, exp.Evaluate() == chainValue);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.EnableIncremental());
+    TR_ASSERT(t, exp.Evaluate() == chainValue);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Optimize());
+    TR_ASSERT(t, exp.Evaluate() == chainValue);
+
+    chain += "+1";
+    exp.SetExpression(chain);
+    TR_ASSERT(t, !exp.Prepare());
+    TR_ASSERT(t, exp.GetError().code == kExpError_TooDeep);
+    TR_ASSERT(t, exp.Evaluate() == 0);
+
+    std::string rightChain;
+    for (int i = 0; i < 300000; i++) {
+        rightChain += "1+(";
+    }
+    rightChain += "1" + std::string(300000, ')');
+    exp.SetExpression(rightChain);
+    TR_ASSERT(t, !exp.Prepare());
+    TR_ASSERT(t, exp.GetError().code == kExpError_TooDeep);
+
+    // Statements are evaluated through the trees referring to them, their height adds up
+    std::string statements = "a0 = t";
+    for (int i = 1; i < EXP_SOLVER_MAX_DEPTH; i++) {
+        statements += "; a" + std::to_string(i) + " = a" + std::to_string(i - 1) + "+1";
+    }
+    exp.SetExpression(statements);
+    TR_ASSERT(t, !exp.Prepare());
+    TR_ASSERT(t, exp.GetError().code == kExpError_TooDeep);
+
+    // Precedence and associativity
+    double tmp;
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "100/10/5 - 4 - 3"));
+    TR_ASSERT(t, tmp == -5);
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "1 + 2*3 << 1 > 13 ? 1 : 0 ? 2 : 3"));
+    TR_ASSERT(t, tmp == 1);
+    return kTR_Pass;
+}
+
+int test_expsolver_errors(ITesting *t) {
+    static const struct {
+        const char *expression;
+        kExpError code;
+        const char *token;
+        size_t position;
+    } parseErrors[] = {
+        { "", kExpError_EmptyExpression, "", 0 },
+        { "()", kExpError_EmptyExpression, "", 2 },
+        { "1 + ", kExpError_MissingOperand, "", 4 },
+        { "2*-", kExpError_MissingOperand, "", 3 },
+        { "max(1, -)", kExpError_MissingOperand, ")", 8 },
+        { "2 * (3 + 4", kExpError_MissingParenthesis, "", 10 },
+        { "4<1?", kExpError_IfMismatch, "", 4 },
+        { "4<1?3*2+1", kExpError_MissingColon, "", 9 },
+        { "1 + sqrt(1, 2)", kExpError_ArgumentCount, "sqrt", 4 },
+        { "max(1,)", kExpError_MissingArgument, "max", 0 },
+        { "max(,2)", kExpError_MissingArgument, "max", 0 },
+        { "max(=)", kExpError_UnexpectedAssignment, "=", 4 },
+        { "max(1 2", kExpError_UnterminatedCall, "max", 0 },
+        { "foo(1)", kExpError_NoFunctionCallback, "foo", 0 },
+        { "n = ; n", kExpError_MissingAssignmentValue, "n", 0 },
+        { "n = 1 = 2", kExpError_UnexpectedAssignment, "=", 6 },
+        { "1 = 2", kExpError_InvalidAssignment, "1", 0 },
+        { "n = 2; n + 1; n * 2", kExpError_UnusedStatement, "n", 7 },
+        { "a + 1", kExpError_NoVariableCallback, "a", ExpSolverError::kNoPosition },
+    };
+    for (auto &expected: parseErrors) {
+        double tmp;
+        ExpSolverError error;
+        TR_ASSERT(t, !ExpSolver::Solve(&tmp, expected.expression, &error));
+        TR_ASSERT(t, error.code == expected.code);
+        TR_ASSERT(t, error.token == expected.token);
+        TR_ASSERT(t, error.position == expected.position);
+        TR_ASSERT(t, strlen(ExpSolver::ErrorString(error.code)) > 0);
+    }
+
+    // Failed callbacks, the evaluation goes on with the returned value
+    ExpSolver exp("t + nope + 1");
+    exp.RegisterUserVariableCallback(varCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.GetError().code == kExpError_None);
+    TR_ASSERT(t, exp.Evaluate() == 5);
+    TR_ASSERT(t, exp.GetError().code == kExpError_UnknownVariable);
+    TR_ASSERT(t, exp.GetError().token == "nope");
+    // All evaluators report through the same callbacks
+    TR_ASSERT(t, exp.Flatten());
+    TR_ASSERT(t, exp.Evaluate() == 5);
+    TR_ASSERT(t, exp.GetError().code == kExpError_UnknownVariable);
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == 5);
+    TR_ASSERT(t, exp.GetError().code == kExpError_UnknownVariable);
+    TR_ASSERT(t, exp.CompileJit());
+    TR_ASSERT(t, exp.Evaluate() == 5);
+    TR_ASSERT(t, exp.GetError().code == kExpError_UnknownVariable);
+    double nope = 2;
+    TR_ASSERT(t, exp.BindVariable(exp.GetVariableSlot("nope"), &nope));
+    TR_ASSERT(t, exp.Evaluate() == 7);
+    TR_ASSERT(t, exp.GetError().code == kExpError_None);
+
+    exp.SetExpression("inc(1) + dec(2)");
+    exp.RegisterUserFunctionCallback(functionCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 1);
+    TR_ASSERT(t, exp.GetError().code == kExpError_UnknownFunction);
+    TR_ASSERT(t, exp.GetError().token == "dec");
+
+    exp.SetExpression("1 +");
+    TR_ASSERT(t, !exp.Prepare());
+    TR_ASSERT(t, exp.GetError().code == kExpError_MissingOperand);
+    TR_ASSERT(t, exp.Evaluate() == 0);
+    TR_ASSERT(t, exp.GetError().code == kExpError_NotPrepared);
+
+    // Nothing of the previous error is left after a successful Prepare
+    exp.SetExpression("1 + 2");
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.GetError().code == kExpError_None);
+    TR_ASSERT(t, exp.GetError().token.empty());
+    TR_ASSERT(t, exp.GetError().position == ExpSolverError::kNoPosition);
+
+    // Every input Prepare accepts is free of errors, parse errors fail it
+    static const char *accepted[] = { "t+1 inc(1)", "inc()", "a = 1; ;; a", "(((1)))", "1 ? 2 : 3 ? 4 : 5" };
+    for (auto expression: accepted) {
+        exp.SetExpression(expression);
+        TR_ASSERT(t, exp.Prepare());
+        TR_ASSERT(t, exp.GetError().code == kExpError_None);
+    }
+    return kTR_Pass;
+}
 
 // static void testExpSolver() {
 
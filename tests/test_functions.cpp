@@ -0,0 +1,122 @@
+//
+// Created by gnilk on 18.10.26.
+//
+#include <testinterface.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include "../src/expsolver.h"
+#include "../src/functions.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_functions(ITesting *t);
+    DLL_EXPORT int test_functions_builtins(ITesting *t);
+    DLL_EXPORT int test_functions_native(ITesting *t);
+    DLL_EXPORT int test_functions_arity(ITesting *t);
+    DLL_EXPORT int test_functions_manyargs(ITesting *t);
+}
+
+static double Zero(void *pUser) { return 0.5; }
+static double Twice(void *pUser, double a) { return 2*a; }
+static double Sub3(void *pUser, double a, double b, double c) { return a - b - c; }
+static double Sum4(void *pUser, double a, double b, double c, double d) { return a + b + c + d; }
+static double Count(void *pUser, int args, const double *arg) { return args; }
+static double Counter(void *pUser, double a) {
+    (*(int *)pUser)++;
+    return a;
+}
+
+extern "C" {
+    static double MaxCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out);
+}
+
+static double MaxCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out) {
+    *bOk_out = !strcmp(data, "max");
+    return -1.0;
+}
+
+int test_functions(ITesting *t) {
+    return kTR_Pass;
+}
+
+int test_functions_builtins(ITesting *t) {
+    double tmp;
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "sqrt(16) + abs(-2)"));
+    TR_ASSERT(t, tmp == 6.0);
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "min(4, 2, 8) + max(1, 9, 3)"));
+    TR_ASSERT(t, tmp == 11.0);
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "pow(2, 10) - floor(2.7)"));
+    TR_ASSERT(t, tmp == 1022.0);
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "sin(0) + cos(0)"));
+    TR_ASSERT(t, tmp == 1.0);
+    TR_ASSERT(t, FunctionRegistry::BuiltIns().Find("cos") != nullptr);
+    TR_ASSERT(t, FunctionRegistry::BuiltIns().Find("tan") == nullptr);
+
+    // A function callback gets the built-in names unless the built-ins are enabled
+    ExpSolver exp("max(1, 2)");
+    exp.RegisterUserFunctionCallback(MaxCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == -1.0);
+    exp.EnableBuiltInFunctions();
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 2.0);
+    return kTR_Pass;
+}
+
+int test_functions_native(ITesting *t) {
+    int calls = 0;
+    ExpSolver exp("zero() + twice(3) + sub3(10, 2, 1) + sum4(1, 2, 3, 4) + count(1, 2, 3, 4, 5) + counter(1)");
+    exp.Functions().Register("zero", Zero);
+    exp.Functions().Register("twice", Twice);
+    exp.Functions().Register("sub3", Sub3);
+    exp.Functions().Register("sum4", Sum4);
+    exp.Functions().Register("count", Count);
+    exp.Functions().Register("counter", Counter, &calls);
+    TR_ASSERT(t, exp.Prepare());
+    double expected = 0.5 + 6 + 7 + 10 + 5 + 1;
+    TR_ASSERT(t, exp.Evaluate() == expected);
+    TR_ASSERT(t, calls == 1);
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == expected);
+    TR_ASSERT(t, calls == 2);
+
+    // Registered functions override the built-ins
+    ExpSolver over("sqrt(4)");
+    over.Functions().Register("sqrt", Twice);
+    TR_ASSERT(t, over.Prepare());
+    TR_ASSERT(t, over.Evaluate() == 8.0);
+    return kTR_Pass;
+}
+
+int test_functions_arity(ITesting *t) {
+    double tmp;
+    TR_ASSERT(t, !ExpSolver::Solve(&tmp, "sqrt(1, 2)"));
+    TR_ASSERT(t, !ExpSolver::Solve(&tmp, "pow(1)"));
+    TR_ASSERT(t, !ExpSolver::Solve(&tmp, "max(1,)"));
+    return kTR_Pass;
+}
+
+int test_functions_manyargs(ITesting *t) {
+    // More than the old limit of 32 arguments
+    std::string expression = "count(1";
+    for (int i = 1; i < 100; i++) {
+        expression += ",1";
+    }
+    expression += ") + max(0";
+    for (int i = 1; i < 100; i++) {
+        expression += "," + std::to_string(i);
+    }
+    expression += ")";
+
+    ExpSolver exp(expression.c_str());
+    exp.Functions().Register("count", Count);
+    exp.EnableBuiltInFunctions();
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Evaluate() == 199.0);
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == 199.0);
+    return kTR_Pass;
+}
@@ -0,0 +1,198 @@
+//
+// Created by gnilk on 19.10.26.
+//
+#include <testinterface.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include "../src/expsolver.h"
+#include "../src/incremental.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_incremental(ITesting *t);
+    DLL_EXPORT int test_incremental_recompute(ITesting *t);
+    DLL_EXPORT int test_incremental_callbacks(ITesting *t);
+    DLL_EXPORT int test_incremental_branches(ITesting *t);
+    DLL_EXPORT int test_incremental_identical(ITesting *t);
+}
+
+extern "C" {
+    static double varCallBack(void *pUser, const char *data, int *bOk_out);
+    static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out);
+}
+
+// Counts variable reads in pUser
+static double varCallBack(void *pUser, const char *data, int *bOk_out) {
+    if (pUser != nullptr) {
+        (*(int *)pUser)++;
+    }
+    *bOk_out = 1;
+    if (!strcmp(data, "a")) return 3.25;
+    if (!strcmp(data, "b")) return -7.5;
+    if (!strcmp(data, "c")) return 1.0/3.0;
+    *bOk_out = 0;
+    return 0;
+}
+
+// Counts calls in pUser
+static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out) {
+    if (pUser != nullptr) {
+        (*(int *)pUser)++;
+    }
+    *bOk_out = 1;
+    double result = 0.0;
+    for (int i = 0; i < args; i++) {
+        result += arg[i];
+    }
+    return result;
+}
+
+int test_incremental(ITesting *t) {
+    return kTR_Pass;
+}
+
+//
+// Only the path from a changed variable to the root is recomputed
+//
+int test_incremental_recompute(ITesting *t) {
+    double values[4] = { 1.0, 2.0, 3.0, 4.0 };
+    // ((p*q) + (r*s)) - 1 = 7 nodes + the constant
+    ExpSolver exp("p*q + r*s - 1");
+    TR_ASSERT(t, exp.Prepare());
+    exp.BindVariables(values);
+    TR_ASSERT(t, exp.EnableIncremental());
+    TR_ASSERT(t, exp.IsIncremental());
+    TR_ASSERT(t, exp.Evaluate() == 13.0);
+    TR_ASSERT(t, exp.GetNumRecomputed() == 9);
+
+    // Nothing changed
+    TR_ASSERT(t, exp.Evaluate() == 13.0);
+    TR_ASSERT(t, exp.GetNumRecomputed() == 0);
+
+    // s, r*s, the sum and the subtraction
+    values[3] = 10.0;
+    TR_ASSERT(t, exp.MarkVariableChanged("s"));
+    TR_ASSERT(t, exp.Evaluate() == 31.0);
+    TR_ASSERT(t, exp.GetNumRecomputed() == 4);
+
+    values[0] = 5.0;
+    values[1] = 6.0;
+    TR_ASSERT(t, exp.MarkVariableChanged((size_t) 0));
+    TR_ASSERT(t, exp.MarkVariableChanged((size_t) 1));
+    TR_ASSERT(t, exp.Evaluate() == 59.0);
+    TR_ASSERT(t, exp.GetNumRecomputed() == 5);
+
+    // Binding marks the slot
+    double r = 0.5;
+    TR_ASSERT(t, exp.BindVariable(2, &r));
+    TR_ASSERT(t, exp.Evaluate() == 30 + 5 - 1);
+    TR_ASSERT(t, exp.GetNumRecomputed() == 4);
+
+    exp.MarkAllVariablesChanged();
+    TR_ASSERT(t, exp.Evaluate() == 30 + 5 - 1);
+    TR_ASSERT(t, exp.GetNumRecomputed() == 9);
+
+    TR_ASSERT(t, !exp.MarkVariableChanged("unknown"));
+    TR_ASSERT(t, !exp.MarkVariableChanged((size_t) 4));
+    return kTR_Pass;
+}
+
+//
+// Variable and function callbacks are only made again for changed inputs
+//
+int test_incremental_callbacks(ITesting *t) {
+    int reads = 0;
+    int calls = 0;
+    ExpSolver exp("sum(a, 1) * sum(b, c) + sqrt(a*a)");
+    exp.EnableBuiltInFunctions();
+    exp.RegisterUserVariableCallback(varCallBack, &reads);
+    exp.RegisterUserFunctionCallback(functionCallBack, &calls);
+    TR_ASSERT(t, exp.Prepare());
+    double expected = exp.Evaluate();
+    reads = 0;
+    calls = 0;
+
+    TR_ASSERT(t, exp.EnableIncremental());
+    TR_ASSERT(t, exp.Evaluate() == expected);
+    TR_ASSERT(t, reads == 5);
+    TR_ASSERT(t, calls == 2);
+
+    TR_ASSERT(t, exp.MarkVariableChanged("c"));
+    TR_ASSERT(t, exp.Evaluate() == expected);
+    TR_ASSERT(t, reads == 6);
+    TR_ASSERT(t, calls == 3);
+    return kTR_Pass;
+}
+
+//
+// Nodes in a branch which is not taken are computed when the branch is taken
+//
+int test_incremental_branches(ITesting *t) {
+    double values[3] = { 1.0, 2.0, 3.0 };
+    ExpSolver exp("p > 1 ? q*2 : r*2");
+    TR_ASSERT(t, exp.Prepare());
+    exp.BindVariables(values);
+    TR_ASSERT(t, exp.EnableIncremental());
+    TR_ASSERT(t, exp.Evaluate() == 6.0);
+
+    // Not used by the current result
+    values[1] = 7.0;
+    TR_ASSERT(t, exp.MarkVariableChanged("q"));
+    TR_ASSERT(t, exp.Evaluate() == 6.0);
+
+    values[0] = 2.0;
+    TR_ASSERT(t, exp.MarkVariableChanged("p"));
+    TR_ASSERT(t, exp.Evaluate() == 14.0);
+
+    // Only the '?:' node, r and r*2 stay dirty until the false branch is taken
+    values[2] = 5.0;
+    TR_ASSERT(t, exp.MarkVariableChanged("r"));
+    TR_ASSERT(t, exp.Evaluate() == 14.0);
+    TR_ASSERT(t, exp.GetNumRecomputed() == 1);
+
+    values[0] = 0.0;
+    TR_ASSERT(t, exp.MarkVariableChanged("p"));
+    TR_ASSERT(t, exp.Evaluate() == 10.0);
+    return kTR_Pass;
+}
+
+//
+// Same results as the tree, with statements and shared sub-expressions
+//
+int test_incremental_identical(ITesting *t) {
+    static const char *expressions[] = {
+        "a*b+c",
+        "1<<4 + a",
+        "a < 4 ? b > 2 ? 1 : 2 : 3",
+        "sum(a, b, c, sum(a*2, 1)) / 3",
+        "sqrt(a*a + b*b) + max(a, b, c)",
+        "(a*b)*(a*b) + (a*b)",
+        "d = a*b; e = d > 0 ? d : -d; e + d*c",
+        nullptr,
+    };
+    for (int i = 0; expressions[i] != nullptr; i++) {
+        ExpSolver tree(expressions[i]);
+        tree.EnableBuiltInFunctions();
+        tree.RegisterUserVariableCallback(varCallBack, nullptr);
+        tree.RegisterUserFunctionCallback(functionCallBack, nullptr);
+        TR_ASSERT(t, tree.Prepare());
+        double expected = tree.Evaluate();
+
+        ExpSolver exp(expressions[i]);
+        exp.EnableBuiltInFunctions();
+        exp.RegisterUserVariableCallback(varCallBack, nullptr);
+        exp.RegisterUserFunctionCallback(functionCallBack, nullptr);
+        TR_ASSERT(t, exp.Prepare());
+        TR_ASSERT(t, exp.Optimize());
+        TR_ASSERT(t, exp.EnableIncremental());
+        double result = exp.Evaluate();
+        TR_ASSERT(t, !memcmp(&expected, &result, sizeof(double)));
+        TR_ASSERT(t, exp.MarkVariableChanged("a"));
+        result = exp.Evaluate();
+        TR_ASSERT(t, !memcmp(&expected, &result, sizeof(double)));
+    }
+    return kTR_Pass;
+}
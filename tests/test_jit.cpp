@@ -0,0 +1,267 @@
+//
+// Created by gnilk on 18.10.26.
+//
+#include <testinterface.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include "../src/expsolver.h"
+#include "../src/bytecode.h"
+#include "../src/jit.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_jit(ITesting *t);
+    DLL_EXPORT int test_jit_identical(ITesting *t);
+    DLL_EXPORT int test_jit_bindings(ITesting *t);
+    DLL_EXPORT int test_jit_callbacks(ITesting *t);
+    DLL_EXPORT int test_jit_fallback(ITesting *t);
+    DLL_EXPORT int test_jit_sharedchain(ITesting *t);
+}
+
+extern "C" {
+    static double varCallBack(void *pUser, const char *data, int *bOk_out);
+    static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out);
+}
+
+// Counts variable reads in pUser
+static double varCallBack(void *pUser, const char *data, int *bOk_out) {
+    if (pUser != nullptr) {
+        (*(int *)pUser)++;
+    }
+    *bOk_out = 1;
+    if (!strcmp(data, "a")) return 3.25;
+    if (!strcmp(data, "b")) return -7.5;
+    if (!strcmp(data, "c")) return 1.0/3.0;
+    *bOk_out = 0;
+    return 0;
+}
+
+// Appends the function name to the string in pUser
+static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out) {
+    if (pUser != nullptr) {
+        *(std::string *)pUser += data;
+    }
+    *bOk_out = 1;
+    if (!strcmp(data, "sum")) {
+        double result = 0.0;
+        for (int i = 0; i < args; i++) {
+            result += arg[i];
+        }
+        return result;
+    }
+    if (!strcmp(data, "first")) {
+        return (args > 0) ? arg[0] : -1.0;
+    }
+    *bOk_out = 0;
+    return 0.0;
+}
+
+static double Mad3(void *, double a, double b, double c) { return a * b + c; }
+static double Sum4(void *, double a, double b, double c, double d) { return a + b + c + d; }
+static double Scaled(void *pUser, double a) { return a * *(double *)pUser; }
+
+int test_jit(ITesting *t) {
+    return kTR_Pass;
+}
+
+int test_jit_identical(ITesting *t) {
+    static const char *expressions[] = {
+        "1+2*3-4/5",
+        "a*b+c",
+        "a/c - b*c + a*a*a",
+        "1<<4 + a",
+        "a << 3",
+        "b >> 1",
+        "$ff >> 2",
+        "a > b ? a : b",
+        "a < 4 ? b > 2 ? 1 : 2 : 3",
+        "a > 3.5",
+        "b < -7.9",
+        "c > 0 ? c : -c",
+        "sum(a, b, c, sum(a*2, 1)) / 3",
+        "sum(a, b, c, a, b, c, a, b, c, a, b, c, a, b, c, a, b, c)",
+        "sqrt(a*a + b*b) + max(a, b, c) + min(a, b) + pow(a, 2) + floor(c) + abs(b)",
+        "sin(a) * cos(b)",
+        "mad(a, b, c) + sum4(a, b, c, 1) + scaled(a)",
+        "sum()",
+        "-4+-1 * c",
+        "1/0",
+        "0/0 > 0 ? 1 : 2",
+        "c*c*c*c*c*c*c*c + %1011",
+        "(a*b)*(a*b) + sum(a*b, c) + (a*b)",
+        "a > 1 ? (b+c)*(b+c) : (b+c)",
+        nullptr,
+    };
+    double scale = 2.5;
+    for (int i = 0; expressions[i] != nullptr; i++) {
+        for (int optimize = 0; optimize < 2; optimize++) {
+            ExpSolver tree(expressions[i]);
+            tree.EnableBuiltInFunctions();
+            tree.RegisterUserVariableCallback(varCallBack, nullptr);
+            tree.RegisterUserFunctionCallback(functionCallBack, nullptr);
+            tree.Functions().Register("mad", Mad3);
+            tree.Functions().Register("sum4", Sum4);
+            tree.Functions().Register("scaled", Scaled, &scale);
+            TR_ASSERT(t, tree.Prepare());
+            double expected = tree.Evaluate();
+
+            ExpSolver jit(expressions[i]);
+            jit.EnableBuiltInFunctions();
+            jit.RegisterUserVariableCallback(varCallBack, nullptr);
+            jit.RegisterUserFunctionCallback(functionCallBack, nullptr);
+            jit.Functions().Register("mad", Mad3);
+            jit.Functions().Register("sum4", Sum4);
+            jit.Functions().Register("scaled", Scaled, &scale);
+            TR_ASSERT(t, jit.Prepare());
+            if (optimize) {
+                TR_ASSERT(t, jit.Optimize());
+            }
+            TR_ASSERT(t, jit.CompileJit());
+            TR_ASSERT(t, jit.IsJitCompiled() == JitProgram::IsAvailable());
+            double result = jit.Evaluate();
+            TR_ASSERT(t, !memcmp(&expected, &result, sizeof(double)));
+            // Running again gives the same result, shared values are per run
+            result = jit.Evaluate();
+            TR_ASSERT(t, !memcmp(&expected, &result, sizeof(double)));
+        }
+    }
+    return kTR_Pass;
+}
+
+//
+// Bound slots are read on every run, unbound slots use the callback
+//
+int test_jit_bindings(ITesting *t) {
+    int reads = 0;
+    ExpSolver exp("a*b + c");
+    exp.RegisterUserVariableCallback(varCallBack, &reads);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.CompileJit());
+
+    double a = 2.0;
+    double b = 4.0;
+    TR_ASSERT(t, exp.BindVariable(0, &a));
+    TR_ASSERT(t, exp.BindVariable(1, &b));
+    TR_ASSERT(t, exp.Evaluate() == 8.0 + 1.0/3.0);
+    TR_ASSERT(t, reads == 1);
+    a = 3.0;
+    TR_ASSERT(t, exp.Evaluate() == 12.0 + 1.0/3.0);
+    TR_ASSERT(t, reads == 2);
+
+    // No bindings and no callback
+    ExpSolver unbound("a + 1");
+    TR_ASSERT(t, unbound.Prepare());
+    TR_ASSERT(t, unbound.CompileJit());
+    TR_ASSERT(t, unbound.Evaluate() == 1.0);
+    return kTR_Pass;
+}
+
+//
+// Callbacks are made in expression order, only the taken branch is evaluated
+//
+int test_jit_callbacks(ITesting *t) {
+    std::string calls;
+    int reads = 0;
+    ExpSolver exp("first(sum(a, 1), b) + (a > 1 ? sum(c) : first(b)) + first()");
+    exp.RegisterUserVariableCallback(varCallBack, &reads);
+    exp.RegisterUserFunctionCallback(functionCallBack, &calls);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.CompileJit());
+    TR_ASSERT(t, exp.Evaluate() == (3.25 + 1.0) + 1.0/3.0 - 1.0);
+    TR_ASSERT(t, calls == "sumfirstsumfirst");
+    TR_ASSERT(t, reads == 4);
+
+    // Shared expressions once per run
+    reads = 0;
+    ExpSolver shared("(a*b)*(a*b) + (a*b)");
+    shared.RegisterUserVariableCallback(varCallBack, &reads);
+    TR_ASSERT(t, shared.Prepare());
+    TR_ASSERT(t, shared.Optimize());
+    TR_ASSERT(t, shared.CompileJit());
+    double ab = 3.25 * -7.5;
+    TR_ASSERT(t, shared.Evaluate() == ab*ab + ab);
+    TR_ASSERT(t, reads == 2);
+    TR_ASSERT(t, shared.Evaluate() == ab*ab + ab);
+    TR_ASSERT(t, reads == 4);
+    return kTR_Pass;
+}
+
+//
+// Expressions the code generator can not handle run on the byte code interpreter
+//
+int test_jit_fallback(ITesting *t) {
+    std::string expression = "sum(1";
+    for (int i = 0; i < EXP_SOLVER_JIT_MAX_TEMPS; i++) {
+        expression += ", a";
+    }
+    expression += ")";
+
+    ExpSolver exp(expression.c_str());
+    exp.RegisterUserVariableCallback(varCallBack, nullptr);
+    exp.RegisterUserFunctionCallback(functionCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.CompileJit());
+    TR_ASSERT(t, !exp.IsJitCompiled());
+    TR_ASSERT(t, exp.IsCompiled());
+    TR_ASSERT(t, exp.Evaluate() == 1.0 + 3.25 * EXP_SOLVER_JIT_MAX_TEMPS);
+
+    // Left-deep, one tree level per operator and no temporaries
+    std::string deep = "a";
+    for (int i = 0; i < EXP_SOLVER_JIT_MAX_NESTING; i++) {
+        deep += "+1";
+    }
+    ExpSolver deepExp(deep.c_str());
+    deepExp.RegisterUserVariableCallback(varCallBack, nullptr);
+    TR_ASSERT(t, deepExp.Prepare());
+    TR_ASSERT(t, deepExp.CompileJit());
+    TR_ASSERT(t, !deepExp.IsJitCompiled());
+    TR_ASSERT(t, deepExp.Evaluate() == 3.25 + EXP_SOLVER_JIT_MAX_NESTING);
+
+    JitProgram program;
+    TR_ASSERT(t, !program.Compile(nullptr));
+    TR_ASSERT(t, program.Run(EvalContext()) == 0.0);
+    return kTR_Pass;
+}
+
+// t0 = a; t1 = t0 + t0; ... - every name is referenced twice by the next one
+static std::string SharedChain(int links) {
+    std::string chain = "t0 = a";
+    for (int i = 1; i <= links; i++) {
+        std::string prev = "t" + std::to_string(i - 1);
+        chain += "; t" + std::to_string(i) + " = " + prev + " + " + prev;
+    }
+    return chain + "; t" + std::to_string(links);
+}
+
+//
+// Shared expressions are generated once and called by every reference, code used to double per link
+//
+int test_jit_sharedchain(ITesting *t) {
+    const int links = 200;
+    int reads = 0;
+    ExpSolver exp(SharedChain(links).c_str());
+    exp.RegisterUserVariableCallback(varCallBack, &reads);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.CompileJit());
+    TR_ASSERT(t, exp.IsJitCompiled());
+    TR_ASSERT(t, exp.Evaluate() == ldexp(3.25, links));
+    TR_ASSERT(t, reads == 1);
+    TR_ASSERT(t, exp.Evaluate() == ldexp(3.25, links));
+    TR_ASSERT(t, reads == 2);
+
+    // Still only evaluated when reached, like the tree
+    std::string calls;
+    reads = 0;
+    exp.SetExpression("p = sum(b); q = p * p; a > 1 ? a : q + p");
+    exp.RegisterUserFunctionCallback(functionCallBack, &calls);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.CompileJit());
+    TR_ASSERT(t, exp.IsJitCompiled());
+    TR_ASSERT(t, exp.Evaluate() == 3.25);
+    TR_ASSERT(t, calls.empty());
+    TR_ASSERT(t, reads == 2);
+    return kTR_Pass;
+}
@@ -0,0 +1,137 @@
+//
+// Created by gnilk on 18.10.26.
+//
+#include <testinterface.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include "../src/expsolver.h"
+#include "../src/nodepool.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_nodepool(ITesting *t);
+    DLL_EXPORT int test_nodepool_size(ITesting *t);
+    DLL_EXPORT int test_nodepool_identical(ITesting *t);
+    DLL_EXPORT int test_nodepool_branches(ITesting *t);
+}
+
+extern "C" {
+    static double varCallBack(void *pUser, const char *data, int *bOk_out);
+    static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out);
+}
+
+// Counts variable reads in pUser
+static double varCallBack(void *pUser, const char *data, int *bOk_out) {
+    if (pUser != nullptr) {
+        (*(int *)pUser)++;
+    }
+    *bOk_out = 1;
+    if (!strcmp(data, "a")) return 3.25;
+    if (!strcmp(data, "b")) return -7.5;
+    if (!strcmp(data, "c")) return 1.0/3.0;
+    *bOk_out = 0;
+    return 0;
+}
+
+static double functionCallBack(void *pUser, const char *data, int args, double *arg, int *bOk_out) {
+    *bOk_out = 1;
+    if (!strcmp(data, "sum")) {
+        double result = 0.0;
+        for (int i = 0; i < args; i++) {
+            result += arg[i];
+        }
+        return result;
+    }
+    *bOk_out = 0;
+    return 0.0;
+}
+
+int test_nodepool(ITesting *t) {
+    return kTR_Pass;
+}
+
+int test_nodepool_size(ITesting *t) {
+    TR_ASSERT(t, sizeof(PoolNode) == 16);
+    TR_ASSERT(t, sizeof(PoolNode) * 2 <= sizeof(BinOpNode));
+    TR_ASSERT(t, sizeof(PoolNode) * 2 <= sizeof(FuncNode));
+
+    ExpSolver exp("a > 1 ? sum(a, 2) : b");
+    exp.RegisterUserVariableCallback(varCallBack, nullptr);
+    exp.RegisterUserFunctionCallback(functionCallBack, nullptr);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, !exp.IsFlattened());
+    TR_ASSERT(t, exp.Flatten());
+    TR_ASSERT(t, exp.IsFlattened());
+    TR_ASSERT(t, exp.Evaluate() == 5.25);
+    return kTR_Pass;
+}
+
+int test_nodepool_identical(ITesting *t) {
+    static const char *expressions[] = {
+        "1+2*3-4/5",
+        "a*b+c",
+        "a/c - b*c + a*a*a",
+        "1<<4 + a",
+        "$ff >> 2",
+        "a > b ? a : b",
+        "a < 4 ? b > 2 ? 1 : 2 : 3",
+        "sum(a, b, c, sum(a*2, 1)) / 3",
+        "sum(a, b, c, a, b, c, a, b, c, a, b, c, a, b, c, a, b, c)",
+        "sqrt(a*a + b*b) + max(a, b, c)",
+        "sum()",
+        "-4+-1 * c",
+        "c*c*c*c*c*c*c*c + %1011",
+        nullptr,
+    };
+    for (int i = 0; expressions[i] != nullptr; i++) {
+        ExpSolver tree(expressions[i]);
+        tree.EnableBuiltInFunctions();
+        tree.RegisterUserVariableCallback(varCallBack, nullptr);
+        tree.RegisterUserFunctionCallback(functionCallBack, nullptr);
+        TR_ASSERT(t, tree.Prepare());
+        double expected = tree.Evaluate();
+
+        ExpSolver flat(expressions[i]);
+        flat.EnableBuiltInFunctions();
+        flat.RegisterUserVariableCallback(varCallBack, nullptr);
+        flat.RegisterUserFunctionCallback(functionCallBack, nullptr);
+        TR_ASSERT(t, flat.Prepare());
+        TR_ASSERT(t, flat.Flatten());
+        double result = flat.Evaluate();
+        TR_ASSERT(t, !memcmp(&expected, &result, sizeof(double)));
+
+        // Shared sub-expressions
+        TR_ASSERT(t, flat.Optimize());
+        TR_ASSERT(t, flat.Flatten());
+        result = flat.Evaluate();
+        TR_ASSERT(t, !memcmp(&expected, &result, sizeof(double)));
+    }
+    return kTR_Pass;
+}
+
+//
+// Only the taken branch is evaluated, shared expressions once
+//
+int test_nodepool_branches(ITesting *t) {
+    int reads = 0;
+    ExpSolver exp("a > 1 ? a : b*c");
+    exp.RegisterUserVariableCallback(varCallBack, &reads);
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Flatten());
+    TR_ASSERT(t, exp.Evaluate() == 3.25);
+    TR_ASSERT(t, reads == 2);
+
+    reads = 0;
+    ExpSolver shared("(a*b)*(a*b) + (a*b)");
+    shared.RegisterUserVariableCallback(varCallBack, &reads);
+    TR_ASSERT(t, shared.Prepare());
+    TR_ASSERT(t, shared.Optimize());
+    TR_ASSERT(t, shared.Flatten());
+    double ab = 3.25 * -7.5;
+    TR_ASSERT(t, shared.Evaluate() == ab*ab + ab);
+    TR_ASSERT(t, reads == 2);
+    return kTR_Pass;
+}
@@ -0,0 +1,188 @@
+//
+// Created by gnilk on 18.10.26.
+//
+#include <testinterface.h>
+#include <math.h>
+#include <string.h>
+#include "../src/expsolver.h"
+#include "../src/optimizer.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_optimizer(ITesting *t);
+    DLL_EXPORT int test_optimizer_fold(ITesting *t);
+    DLL_EXPORT int test_optimizer_identity(ITesting *t);
+    DLL_EXPORT int test_optimizer_identical(ITesting *t);
+    DLL_EXPORT int test_optimizer_shared(ITesting *t);
+}
+
+static double Counter(void *pUser, double a) {
+    (*(int *)pUser)++;
+    return a;
+}
+
+// f(x) = x+1, counts the calls
+static double FuncCounter(void *pUser, const char *data, int args, double *arg, int *bOk_out) {
+    (*(int *)pUser)++;
+    *bOk_out = 1;
+    return arg[0] + 1;
+}
+
+int test_optimizer(ITesting *t) {
+    return kTR_Pass;
+}
+
+int test_optimizer_fold(ITesting *t) {
+    ExpSolver exp("2*3 + sqrt(16) + (1 > 0 ? 5 : 7)");
+    exp.EnableBuiltInFunctions();
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.Optimize());
+    TR_ASSERT(t, exp.Evaluate() == 15.0);
+
+    // Entire tree folded to a single constant
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == 15.0);
+
+    // Registered functions are not pure, they are called on every evaluation
+    int calls = 0;
+    ExpSolver impure("counter(2) + 1");
+    impure.Functions().Register("counter", Counter, &calls);
+    TR_ASSERT(t, impure.Prepare());
+    TR_ASSERT(t, impure.Optimize());
+    TR_ASSERT(t, impure.Evaluate() == 3.0);
+    TR_ASSERT(t, impure.Evaluate() == 3.0);
+    TR_ASSERT(t, calls == 2);
+    return kTR_Pass;
+}
+
+int test_optimizer_identity(ITesting *t) {
+    double value = 3.5;
+    ExpSolver exp("t*1 + 1*t + t/1 + t-0");
+    TR_ASSERT(t, exp.Prepare());
+    TR_ASSERT(t, exp.BindVariable(0, &value));
+    TR_ASSERT(t, exp.Optimize());
+    TR_ASSERT(t, exp.Evaluate() == 4*value - value + value);
+
+    // Shifting truncates, 't<<0' is kept unless 't' is already an int
+    ExpSolver shift("t<<0");
+    TR_ASSERT(t, shift.Prepare());
+    TR_ASSERT(t, shift.BindVariable(0, &value));
+    TR_ASSERT(t, shift.Optimize());
+    TR_ASSERT(t, shift.Evaluate() == 3.0);
+    return kTR_Pass;
+}
+
+//
+// Optimized and unoptimized trees must give the same bits, including the sign of zero
+//
+int test_optimizer_identical(ITesting *t) {
+    static const char *expressions[] = {
+        "t+0",
+        "0+t",
+        "t*1",
+        "t-0",
+        "t<<0",
+        "(t>1)+0",
+        "(t<<2)+0",
+        "t*(2-1) + 0*3",
+        "t > 0 ? t+0 : t*1",
+        "pow(2, 3) + t/1",
+        "min(t, 0) + 0",
+        nullptr,
+    };
+    static const double values[] = { 0.0, -0.0, 1.5, -2.75, 1e300, -1e-300 };
+
+    for (int i = 0; expressions[i] != nullptr; i++) {
+        ExpSolver plain(expressions[i]);
+        ExpSolver optimized(expressions[i]);
+        plain.EnableBuiltInFunctions();
+        optimized.EnableBuiltInFunctions();
+        TR_ASSERT(t, plain.Prepare());
+        TR_ASSERT(t, optimized.Prepare());
+        TR_ASSERT(t, optimized.Optimize());
+        for (double value : values) {
+            plain.BindVariable(0, &value);
+            optimized.BindVariable(0, &value);
+            double a = plain.Evaluate();
+            double b = optimized.Evaluate();
+            TR_ASSERT(t, memcmp(&a, &b, sizeof(double)) == 0);
+            TR_ASSERT(t, optimized.Compile());
+            b = optimized.Evaluate();
+            TR_ASSERT(t, memcmp(&a, &b, sizeof(double)) == 0);
+        }
+    }
+    return kTR_Pass;
+}
+
+int test_optimizer_shared(ITesting *t) {
+    static const char *expression = "f(a*b+c) > 10 ? f(a*b+c) : 0";
+    double values[] = { 2, 3, 4 };
+    double a = 0, b = 0;
+    int calls = 0;
+
+    // Pure callback functions are called once per evaluation
+    ExpSolver exp(expression);
+    exp.RegisterUserFunctionCallback(FuncCounter, &calls);
+    exp.SetUserFunctionPure("f");
+    TR_ASSERT(t, exp.Prepare());
+    exp.BindVariables(values);
+    TR_ASSERT(t, exp.Optimize());
+    TR_ASSERT(t, exp.Evaluate() == 11.0);
+    TR_ASSERT(t, calls == 1);
+    TR_ASSERT(t, exp.Evaluate() == 11.0);
+    TR_ASSERT(t, calls == 2);
+
+    calls = 0;
+    TR_ASSERT(t, exp.Compile());
+    TR_ASSERT(t, exp.Evaluate() == 11.0);
+    TR_ASSERT(t, calls == 1);
+
+    // Once per row in batches
+    static const double colA[] = { 2, 1, 0, 5, 3 };
+    static const double colB[] = { 3, 1, 7, 2, 3 };
+    double out[5];
+    BatchColumn columns[] = { { "a", colA }, { "b", colB } };
+    calls = 0;
+    TR_ASSERT(t, exp.EvaluateBatch(out, 5, columns, 2));
+    TR_ASSERT(t, calls == 5);
+    for (int i = 0; i < 5; i++) {
+        double f = colA[i] * colB[i] + values[2] + 1;
+        TR_ASSERT(t, out[i] == ((f > 10) ? f : 0));
+    }
+
+    // Impure functions are not shared
+    calls = 0;
+    ExpSolver impure(expression);
+    impure.RegisterUserFunctionCallback(FuncCounter, &calls);
+    TR_ASSERT(t, impure.Prepare());
+    impure.BindVariables(values);
+    TR_ASSERT(t, impure.Optimize());
+    TR_ASSERT(t, impure.Evaluate() == 11.0);
+    TR_ASSERT(t, calls == 2);
+
+    // Nested and repeated sub-expressions, shared across references from both branches
+    ExpSolver nested("(a*b)*(a*b) + (a > b ? (a*b)*(a*b) : a*b)");
+    ExpSolver plain("(a*b)*(a*b) + (a > b ? (a*b)*(a*b) : a*b)");
+    TR_ASSERT(t, nested.Prepare());
+    TR_ASSERT(t, plain.Prepare());
+    TR_ASSERT(t, nested.Optimize());
+    nested.BindVariable(0, &a);
+    nested.BindVariable(1, &b);
+    plain.BindVariable(0, &a);
+    plain.BindVariable(1, &b);
+    for (a = -3; a < 3; a += 0.75) {
+        for (b = -2; b < 2; b += 0.5) {
+            TR_ASSERT(t, nested.Evaluate() == plain.Evaluate());
+        }
+    }
+    TR_ASSERT(t, nested.Compile());
+    TR_ASSERT(t, plain.Compile());
+    for (a = -3; a < 3; a += 0.75) {
+        for (b = -2; b < 2; b += 0.5) {
+            TR_ASSERT(t, nested.Evaluate() == plain.Evaluate());
+        }
+    }
+    return kTR_Pass;
+}
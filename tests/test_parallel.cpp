@@ -0,0 +1,102 @@
+//
+// Created by gnilk on 18.10.26.
+//
+#include <testinterface.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "../src/expsolver.h"
+#include "../src/compiledexpression.h"
+#include "../src/parallel.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_parallel(ITesting *t);
+    DLL_EXPORT int test_parallel_expressions(ITesting *t);
+    DLL_EXPORT int test_parallel_rows(ITesting *t);
+    DLL_EXPORT int test_parallel_foreach(ITesting *t);
+}
+
+int test_parallel(ITesting *t) {
+    return kTR_Pass;
+}
+
+int test_parallel_expressions(ITesting *t) {
+    // Distinct expressions over one shared variable set
+    std::vector<std::shared_ptr<const CompiledExpression> > compiled;
+    std::vector<const CompiledExpression *> expressions;
+    for (int i = 0; i < 3000; i++) {
+        char buffer[128];
+        snprintf(buffer, sizeof(buffer), "a*%d + b/%d - (a > %d ? c : %d)", i, i + 1, i % 11, i % 5);
+        ExpSolver exp(buffer);
+        TR_ASSERT(t, exp.Prepare());
+        compiled.push_back(exp.GetCompiledExpression());
+        expressions.push_back(compiled.back().get());
+    }
+
+    double a = 7.5, b = 3.0, c = -2.25;
+    const double *bindings[] = { &a, &b, &c };
+    EvalContext context;
+    context.pSlots = bindings;
+
+    std::vector<double> expected(expressions.size());
+    for (size_t i = 0; i < expressions.size(); i++) {
+        expected[i] = expressions[i]->Evaluate(context);
+    }
+
+    static const size_t threadCounts[] = { 1, 3, 8 };
+    static const size_t chunkSizes[] = { 1, 7, 256, 10000 };
+    for (size_t threads : threadCounts) {
+        ParallelEvaluator evaluator(threads);
+        TR_ASSERT(t, evaluator.NumThreads() == threads);
+        for (size_t chunk : chunkSizes) {
+            evaluator.SetChunkSize(chunk);
+            std::vector<double> out(expressions.size(), 0.0);
+            evaluator.Evaluate(expressions.data(), expressions.size(), context, out.data());
+            TR_ASSERT(t, !memcmp(out.data(), expected.data(), out.size() * sizeof(double)));
+        }
+    }
+    return kTR_Pass;
+}
+
+int test_parallel_rows(ITesting *t) {
+    ExpSolver exp("t*t - u > 0 ? sqrt(t*t - u) : 0");
+    exp.EnableBuiltInFunctions();
+    TR_ASSERT(t, exp.Prepare());
+    auto compiled = exp.GetCompiledExpression();
+
+    const size_t nRows = 10007;
+    std::vector<double> values(nRows * 2);
+    for (size_t row = 0; row < nRows; row++) {
+        values[row * 2] = (double) (row % 100) * 0.5;
+        values[row * 2 + 1] = (double) (row % 37);
+    }
+    std::vector<double> out(nRows);
+    ParallelEvaluator evaluator(4, 64);
+    evaluator.Evaluate(*compiled, values.data(), 2, nRows, out.data());
+    for (size_t row = 0; row < nRows; row++) {
+        TR_ASSERT(t, out[row] == compiled->Evaluate(&values[row * 2]));
+    }
+    return kTR_Pass;
+}
+
+int test_parallel_foreach(ITesting *t) {
+    ParallelEvaluator evaluator(4, 10);
+    // Every index exactly once, across many jobs
+    for (size_t count : { (size_t) 0, (size_t) 5, (size_t) 10, (size_t) 11, (size_t) 9999 }) {
+        std::vector<int> visits(count, 0);
+        evaluator.ForEach(count, [&visits](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                visits[i]++;
+            }
+        });
+        for (size_t i = 0; i < count; i++) {
+            TR_ASSERT(t, visits[i] == 1);
+        }
+    }
+    return kTR_Pass;
+}
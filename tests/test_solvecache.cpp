@@ -0,0 +1,93 @@
+//
+// Created by gnilk on 18.10.26.
+//
+#include <testinterface.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include "../src/expsolver.h"
+#include "../src/bytecode.h"
+#include "../src/solvecache.h"
+
+using namespace gnilk;
+
+// test exports
+extern "C" {
+    DLL_EXPORT int test_solvecache(ITesting *t);
+    DLL_EXPORT int test_solvecache_solve(ITesting *t);
+    DLL_EXPORT int test_solvecache_lru(ITesting *t);
+    DLL_EXPORT int test_solvecache_threads(ITesting *t);
+}
+
+int test_solvecache(ITesting *t) {
+    return kTR_Pass;
+}
+
+int test_solvecache_solve(ITesting *t) {
+    auto before = SolveCache::Instance().GetStats();
+    double tmp;
+    TR_ASSERT(t, !ExpSolver::Solve(&tmp, "solvecache(1) + 0*0"));
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "17 + sqrt(16)*2 - 0"));
+    TR_ASSERT(t, tmp == 25.0);
+    TR_ASSERT(t, ExpSolver::Solve(&tmp, "17 + sqrt(16)*2 - 0"));
+    TR_ASSERT(t, tmp == 25.0);
+    auto after = SolveCache::Instance().GetStats();
+    // first call fails, is not cached
+    TR_ASSERT(t, after.misses - before.misses == 2);
+    TR_ASSERT(t, after.hits - before.hits == 1);
+    return kTR_Pass;
+}
+
+int test_solvecache_lru(ITesting *t) {
+    SolveCache cache(2, 1);
+    auto a = std::make_shared<Program>();
+    auto b = std::make_shared<Program>();
+    auto c = std::make_shared<Program>();
+    cache.Insert("a", a);
+    cache.Insert("b", b);
+    TR_ASSERT(t, cache.Find("a") == a);
+    // 'b' is least recently used
+    cache.Insert("c", c);
+    TR_ASSERT(t, cache.Find("b") == nullptr);
+    TR_ASSERT(t, cache.Find("a") == a);
+    TR_ASSERT(t, cache.Find("c") == c);
+
+    auto stats = cache.GetStats();
+    TR_ASSERT(t, stats.hits == 3);
+    TR_ASSERT(t, stats.misses == 1);
+    TR_ASSERT(t, stats.evictions == 1);
+    TR_ASSERT(t, stats.size == 2);
+
+    cache.Clear();
+    cache.ResetStats();
+    TR_ASSERT(t, cache.Find("a") == nullptr);
+    TR_ASSERT(t, cache.GetStats().size == 0);
+    TR_ASSERT(t, cache.GetStats().misses == 1);
+    return kTR_Pass;
+}
+
+int test_solvecache_threads(ITesting *t) {
+    static const char *expressions[] = { "1+2", "3*4+1", "max(1, 5, 2)", "1<<4", "$ff - 1", "7/2" };
+    static const double expected[] = { 3, 13, 5, 16, 254, 3.5 };
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; i++) {
+        threads.push_back(std::thread([&errors, i]() {
+            for (int n = 0; n < 2000; n++) {
+                int idx = (n + i) % 6;
+                double value;
+                if (!ExpSolver::Solve(&value, expressions[idx]) || (value != expected[idx])) {
+                    errors++;
+                }
+            }
+        }));
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    TR_ASSERT(t, errors == 0);
+    return kTR_Pass;
+}
@@ -17,6 +17,9 @@ extern "C" {
     DLL_EXPORT int test_tokenizer_single(ITesting *t);
     DLL_EXPORT int test_tokenizer_multi(ITesting *t);
     DLL_EXPORT int test_tokenizer_peek(ITesting *t);
+    DLL_EXPORT int test_tokenizer_spans(ITesting *t);
+    DLL_EXPORT int test_tokenizer_longtoken(ITesting *t);
+    DLL_EXPORT int test_tokenizer_reset(ITesting *t);
 }
 int test_tokenizer(ITesting *t) {
     return kTR_Pass;
@@ -24,7 +27,7 @@ int test_tokenizer(ITesting *t) {
 
 int test_tokenizer_single(ITesting *t) {
     const char *expression = "4+2";
-    auto tokenizer = new Tokenizer(expression,"* / + - ( ) , < > ? :");
+    Tokenizer tokenizer(expression,"* / + - ( ) , < > ? :");
 
     static const char *expected[]={
             "4",
@@ -33,8 +36,8 @@ int test_tokenizer_single(ITesting *t) {
     };
 
     int idx = 0;
-    while(tokenizer->HasMore()) {
-        auto next = tokenizer->Next();
+    while(tokenizer.HasMore()) {
+        auto next = tokenizer.Next();
         TR_ASSERT(t, strlen(next) == 1);
         TR_ASSERT(t, !strcmp(next, expected[idx]));
         idx++;
@@ -45,10 +48,10 @@ int test_tokenizer_single(ITesting *t) {
 
 int test_tokenizer_multi(ITesting *t) {
     const char *expression = "4<<2";
-    auto tokenizer = new Tokenizer(expression,"<< >> * / + - ( ) , < > ? :");
+    Tokenizer tokenizer(expression,"<< >> * / + - ( ) , < > ? :");
 
-    while(tokenizer->HasMore()) {
-        auto next = tokenizer->Next();
+    while(tokenizer.HasMore()) {
+        auto next = tokenizer.Next();
         printf("next: %s\n", next);
     }
 
@@ -57,11 +60,11 @@ int test_tokenizer_multi(ITesting *t) {
 
 int test_tokenizer_peek(ITesting *t) {
     const char *expression = "4<<2";
-    auto tokenizer = new Tokenizer(expression,"<< >> * / + - ( ) , < > ? :");
+    Tokenizer tokenizer(expression,"<< >> * / + - ( ) , < > ? :");
 
-    auto next = tokenizer->Next();
+    auto next = tokenizer.Next();
     TR_ASSERT(t, !strcmp(next, "4"));
-    auto peek = tokenizer->Peek();
+    auto peek = tokenizer.Peek();
     TR_ASSERT(t, !strcmp(peek, "<<"));
 
 
@@ -69,3 +72,69 @@ int test_tokenizer_peek(ITesting *t) {
     return kTR_Pass;
 }
 
+int test_tokenizer_spans(ITesting *t) {
+    const char *expression = "abc<<  2+x";
+    Tokenizer tokenizer(expression,"<< >> * / + - ( ) , < > ? :", Tokenizer::kTokenizerMode_Spans);
+
+    auto &spans = tokenizer.Spans();
+    TR_ASSERT(t, spans.size() == 5);
+    TR_ASSERT(t, spans[0].offset == 0);
+    TR_ASSERT(t, spans[0].length == 3);
+    TR_ASSERT(t, spans[0].kind == kTokenKind_Text);
+    TR_ASSERT(t, spans[1].offset == 3);
+    TR_ASSERT(t, spans[1].length == 2);
+    TR_ASSERT(t, spans[1].kind == kTokenKind_Operator);
+    TR_ASSERT(t, spans[2].offset == 7);
+
+    // Views point into the input buffer
+    auto view = tokenizer.NextView();
+    TR_ASSERT(t, view == "abc");
+    TR_ASSERT(t, view.data() == expression);
+    TR_ASSERT(t, tokenizer.PeekView() == "<<");
+    tokenizer.NextView();
+    TR_ASSERT(t, tokenizer.NextView() == "2");
+    TR_ASSERT(t, tokenizer.NextView() == "+");
+    TR_ASSERT(t, tokenizer.NextView() == "x");
+    TR_ASSERT(t, !tokenizer.HasMore());
+    TR_ASSERT(t, tokenizer.NextView().empty());
+
+    return kTR_Pass;
+}
+
+int test_tokenizer_longtoken(ITesting *t) {
+    // Tokens used to be limited to 256 characters
+    std::string name(1000, 'a');
+    std::string expression = name + "+" + name;
+    Tokenizer tokenizer(expression.c_str(),"* / + - ( ) , < > ? :");
+
+    TR_ASSERT(t, tokenizer.HasMore());
+    TR_ASSERT(t, strlen(tokenizer.Next()) == 1000);
+    TR_ASSERT(t, !strcmp(tokenizer.Next(), "+"));
+    TR_ASSERT(t, strlen(tokenizer.Peek()) == 1000);
+
+    return kTR_Pass;
+}
+
+int test_tokenizer_reset(ITesting *t) {
+    Tokenizer tokenizer("a << b", "<< >> * / + - ( ) , < > ? :", Tokenizer::kTokenizerMode_Spans);
+    TR_ASSERT(t, tokenizer.NextView() == "a");
+
+    // Same operators, starts from the first token of the new input
+    const char *expression = "1<2 ? 3:4";
+    tokenizer.Reset(expression);
+    TR_ASSERT(t, tokenizer.Spans().size() == 7);
+    TR_ASSERT(t, tokenizer.NextView() == "1");
+    TR_ASSERT(t, tokenizer.NextView() == "<");
+    TR_ASSERT(t, tokenizer.PeekView().data() == expression + 2);
+
+    tokenizer.Reset("");
+    TR_ASSERT(t, !tokenizer.HasMore());
+
+    // Copy mode materializes the new tokens
+    Tokenizer copy("a+b", "+");
+    copy.Reset("c + d");
+    TR_ASSERT(t, !strcmp(copy.Next(), "c"));
+    TR_ASSERT(t, !strcmp(copy.Next(), "+"));
+    TR_ASSERT(t, !strcmp(copy.Next(), "d"));
+    return kTR_Pass;
+}